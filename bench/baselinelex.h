@@ -0,0 +1,17 @@
+#ifndef _BASELINELEX_H_
+#define _BASELINELEX_H_
+
+#include <stddef.h>
+
+/*
+ * the original tokenizer, a list of calloc'd tokens with their text copied 
+ * in and whitespace kept. 'buffer' is nul terminated
+ */
+struct baseline_token;
+
+struct baseline_token *baseline_str_to_tokens(const char *buffer);
+
+/* returns the number of tokens freed */
+size_t baseline_free(struct baseline_token *root);
+
+#endif /* _BASELINELEX_H_ */
\ No newline at end of file
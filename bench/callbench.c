@@ -0,0 +1,102 @@
+#include "pyvscc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *source = 
+    "def scale(x, y):\n"
+    "\tx *= 3\n"
+    "\tx += y\n"
+    "\treturn x\n"
+    "\n"
+    "def repeat(n):\n"
+    "\ti = 0\n"
+    "\ttotal = 0\n"
+    "\twhile i < n:\n"
+    "\t\tx = scale(i, 1)\n"
+    "\t\ttotal += x\n"
+    "\t\ti += 1\n"
+    "\treturn total\n";
+
+static int64_t time_ns(void) 
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + (int64_t)ts.tv_nsec;
+}
+
+/*
+ * the same loop calling scale from compiled code, once with the call and once
+ * with scale inlined into it
+ */
+static bool time_loop(long calls, bool inline_calls, int64_t *elapsed, uint64_t *result)
+{
+    struct pyvscc_options options = { .default_size = sizeof(uint64_t), .threads = 1, .optimize = inline_calls };
+    struct pyvscc_module *module = pyvscc_compile(source, strlen(source), &options);
+    if (module == NULL)
+        return false;
+
+    const struct pyvscc_function *repeat = pyvscc_lookup(module, "repeat");
+    if (repeat == NULL) {
+        printf("err: function 'repeat' not found\n");
+        pyvscc_free(module);
+        return false;
+    }
+
+    struct pyvscc_value args[1] = { PYVSCC_INT(calls) };
+    int64_t start_time = time_ns();
+    pyvscc_call(repeat, args, 1, result);
+    *elapsed = time_ns() - start_time;
+
+    pyvscc_free(module);
+    return true;
+}
+
+/*
+ * compile once, call many times; the per call cost is what an embedder pays
+ * instead of spawning the compiler for every evaluation
+ */
+int main(int argc, char **argv)
+{
+    long calls = argc > 1 ? atol(argv[1]) : 10000000;
+    struct pyvscc_options options = { .default_size = sizeof(uint64_t), .threads = 1, .optimize = argc > 2 };
+
+    int64_t start_time = time_ns();
+    struct pyvscc_module *module = pyvscc_compile(source, strlen(source), &options);
+    int64_t compile_ns = time_ns() - start_time;
+    if (module == NULL)
+        return 1;
+
+    const struct pyvscc_function *scale = pyvscc_lookup(module, "scale");
+    if (scale == NULL) {
+        printf("err: function 'scale' not found\n");
+        return 1;
+    }
+
+    uint64_t sum = 0;
+    start_time = time_ns();
+    for (long i = 0; i < calls; i++) {
+        struct pyvscc_value args[2] = { PYVSCC_INT(i), PYVSCC_INT(1) };
+        uint64_t result;
+        pyvscc_call(scale, args, 2, &result);
+        sum += result;
+    }
+    int64_t call_ns = time_ns() - start_time;
+
+    printf("compiled in %ld us, %ld calls in %ld us (%.1f ns/call, checksum %lu)\n", compile_ns / 1000, calls, call_ns / 1000, 
+        calls ? (double)call_ns / calls : 0.0, sum);
+
+    pyvscc_free(module);
+
+    int64_t called_ns, inlined_ns;
+    uint64_t called, inlined;
+    if (!time_loop(calls, false, &called_ns, &called) || !time_loop(calls, true, &inlined_ns, &inlined))
+        return 1;
+
+    printf("compiled loop: %.1f ns/call, inlined %.1f ns/call (%.2fx)%s\n", calls ? (double)called_ns / calls : 0.0, 
+        calls ? (double)inlined_ns / calls : 0.0, inlined_ns ? (double)called_ns / inlined_ns : 0.0, 
+        called == inlined ? "" : ", results differ");
+    return called == inlined ? 0 : 1;
+}
\ No newline at end of file
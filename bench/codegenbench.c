@@ -0,0 +1,92 @@
+#include "pygen.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+#include "pycodegen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ITERATIONS 3
+
+static const size_t thread_counts[] = { 1, 2, 4, 8 };
+
+static bool same_output(struct vscc_codegen_data *a, struct vscc_codegen_data *b)
+{
+    if (a->length != b->length || memcmp(a->buffer, b->buffer, a->length) != 0)
+        return false;
+
+    struct vscc_symbol *x = a->symbols;
+    struct vscc_symbol *y = b->symbols;
+    for (; x && y; x = x->next, y = y->next)
+        if (x->offset != y->offset || strcmp(x->symbol_name, y->symbol_name) != 0)
+            return false;
+    return x == NULL && y == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 4000;
+
+    /*
+     * 'n' functions with loops, a string and a call to the previous function, 
+     * so every kind of reference the link step resolves is exercised
+     */
+    struct pygen_options options = { .functions = n, .locals = 2, .strings = 1, .nesting = 2, .seed = 1 };
+    size_t length;
+    size_t lines;
+    char *source = pygen_program(&options, &length, &lines);
+
+    struct lexer_stream tokens;
+    str_to_tokens(&tokens, source, length);
+
+    struct pybuild_context ctx = { .tokens = &tokens, .entry_name = "main", .default_size = sizeof(uint64_t) };
+    pyimpl_append_to_context(&ctx.vscc_ctx);
+    if (!parse(&ctx, &tokens)) {
+        printf("err: failed to parse generated program\n");
+        return 1;
+    }
+
+    /*
+     * the single threaded vscc_codegen pass is the baseline and the reference
+     */
+    struct vscc_codegen_interface interface = { 0 };
+    vscc_codegen_implement_x64(&interface, ABI_SYSV);
+
+    struct vscc_codegen_data reference = { 0 };
+    int64_t serial = INT64_MAX;
+    for (int i = 0; i < ITERATIONS; i++) {
+        free(reference.buffer);
+        int64_t start_time = pyperf_time_us();
+        vscc_codegen(&ctx.vscc_ctx, &interface, &reference, true);
+        int64_t elapsed = pyperf_time_us() - start_time;
+        serial = elapsed < serial ? elapsed : serial;
+    }
+
+    printf("%d functions, %zu bytes of code\n", n, reference.length);
+    printf("%8s %12s %8s %10s\n", "threads", "codegen (us)", "speedup", "identical");
+    printf("%8s %12ld %8.2f %10s\n", "serial", serial, 1.0, "-");
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int64_t best = INT64_MAX;
+        bool identical = true;
+
+        for (int i = 0; i < ITERATIONS; i++) {
+            struct vscc_codegen_data data = { 0 };
+            int64_t start_time = pyperf_time_us();
+            bool linked = pycodegen_parallel(&ctx.vscc_ctx, &data, thread_counts[t]);
+            int64_t elapsed = pyperf_time_us() - start_time;
+
+            identical = identical && linked && same_output(&reference, &data);
+            best = elapsed < best ? elapsed : best;
+            free(data.buffer);
+        }
+
+        printf("%8zu %12ld %8.2f %10s\n", thread_counts[t], best, (double)serial / best, identical ? "yes" : "NO");
+    }
+
+    lexer_free(&tokens);
+    free(source);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "pygen.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+#include "pyopt.h"
+#include "pyinline.h"
+
+#include <vscc.h>
+#include "opt/opt.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SWEEP_STEPS 5
+
+/* a step costing this much more per line than the one before is flagged */
+#define CLIFF_GROWTH 1.5
+
+enum phase {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_OPTIMIZE,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = { "lex", "parse", "optimize", "codegen" };
+
+static const char *usage =
+    "usage: pyvscc_compilebench [-f FUNCTIONS] [-l LOCALS] [-s STRINGS] [-d NESTING] [-L LINES] [-n ITERATIONS] [-w WARMUP] [-j THREADS] [-g] [-q]\n"
+    "\n"
+    "options:\n"
+    "  -f [FUNCTIONS]       functions in the program (default: 64)\n"
+    "  -l [LOCALS]          locals per function (default: 8)\n"
+    "  -s [STRINGS]         string literals per function (default: 4)\n"
+    "  -d [NESTING]         loop nesting per function (default: 2)\n"
+    "  -L [LINES]           pad the program to LINES lines (default: no padding)\n"
+    "  -n [ITERATIONS]      measured compilations per program (default: 10)\n"
+    "  -w [WARMUP]          unmeasured compilations before those (default: 2)\n"
+    "  -j [THREADS]         threads passed to the lexer, parser and code generator (default: 1)\n"
+    "  -g                   print the generated program and exit\n"
+    "  -q                   only measure the given shape, skip the sweeps\n";
+
+struct summary {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+struct bench {
+    size_t iterations;
+    size_t warmup;
+    size_t threads;
+};
+
+/*
+ * one full compilation from a fresh context, the way main runs it with -o
+ */
+static bool compile_once(const char *source, size_t length, size_t threads, int64_t times[PHASE_COUNT])
+{
+    struct lexer_stream tokens;
+    struct pybuild_context ctx = { .tokens = &tokens, .entry_name = "main", .default_size = sizeof(uint64_t), .threads = threads, .optimize = true };
+
+    int64_t start_time = pyperf_time_us();
+    bool status = str_to_tokens_parallel(&tokens, source, length, threads);
+    times[PHASE_LEX] = pyperf_time_us() - start_time;
+    if (!status)
+        return false;
+
+    pyimpl_append_to_context(&ctx.vscc_ctx);
+
+    start_time = pyperf_time_us();
+    status = parse(&ctx, &tokens);
+    times[PHASE_PARSE] = pyperf_time_us() - start_time;
+
+    if (status) {
+        start_time = pyperf_time_us();
+        pyinline_functions(&ctx.vscc_ctx, NULL);
+        for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn; fn = fn->next) {
+            pyopt_fold_constants(fn);
+            vscc_optfn_elim_dead_store(fn);
+        }
+        times[PHASE_OPTIMIZE] = pyperf_time_us() - start_time;
+
+        start_time = pyperf_time_us();
+        status = build(&ctx) != -1;
+        times[PHASE_CODEGEN] = pyperf_time_us() - start_time;
+    }
+
+    build_free(&ctx);
+    lexer_free(&tokens);
+    return status;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static struct summary summarize(double *samples, size_t count)
+{
+    struct summary s = { 0 };
+    qsort(samples, count, sizeof(double), compare_double);
+
+    for (size_t i = 0; i < count; i++)
+        s.mean += samples[i];
+    s.mean /= count;
+
+    for (size_t i = 0; i < count; i++)
+        s.stddev += (samples[i] - s.mean) * (samples[i] - s.mean);
+    s.stddev = count > 1 ? sqrt(s.stddev / (count - 1)) : 0.0;
+
+    s.min = samples[0];
+    s.median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+    return s;
+}
+
+/*
+ * warms up, then compiles 'iterations' times; results are per phase in
+ * microseconds, the last entry is the whole compilation
+ */
+static bool measure(const struct bench *bench, const char *source, size_t length, struct summary results[PHASE_COUNT + 1])
+{
+    double *samples = malloc(bench->iterations * (PHASE_COUNT + 1) * sizeof(double));
+    int64_t times[PHASE_COUNT];
+
+    for (size_t i = 0; i < bench->warmup; i++) {
+        if (!compile_once(source, length, bench->threads, times)) {
+            free(samples);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < bench->iterations; i++) {
+        if (!compile_once(source, length, bench->threads, times)) {
+            free(samples);
+            return false;
+        }
+
+        double total = 0.0;
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            samples[phase * bench->iterations + i] = times[phase];
+            total += times[phase];
+        }
+        samples[PHASE_COUNT * bench->iterations + i] = total;
+    }
+
+    for (int phase = 0; phase <= PHASE_COUNT; phase++)
+        results[phase] = summarize(samples + phase * bench->iterations, bench->iterations);
+
+    free(samples);
+    return true;
+}
+
+static bool report_shape(const struct bench *bench, const struct pygen_options *options)
+{
+    size_t length;
+    size_t lines;
+    char *source = pygen_program(options, &length, &lines);
+    struct summary results[PHASE_COUNT + 1];
+
+    printf("%zu functions, %zu locals, %zu strings, nesting %zu: %zu lines, %.2f MB, %zu iterations after %zu warmup\n",
+        options->functions, options->locals, options->strings, options->nesting, lines, length / (1024.0 * 1024.0), bench->iterations, bench->warmup);
+
+    if (!measure(bench, source, length, results)) {
+        printf("err: failed to compile generated program\n");
+        free(source);
+        return false;
+    }
+
+    /* throughput is taken from the median, one slow outlier does not move it */
+    printf("%-10s %10s %12s %10s %12s %12s %10s\n", "phase", "min (us)", "median (us)", "mean (us)", "stddev (us)", "klines/s", "MB/s");
+    for (int phase = 0; phase <= PHASE_COUNT; phase++) {
+        struct summary *s = &results[phase];
+        double seconds = s->median > 0.0 ? s->median / 1e6 : 1e-6;
+        printf("%-10s %10.0f %12.1f %10.1f %12.1f %12.1f %10.2f\n", phase < PHASE_COUNT ? phase_names[phase] : "total",
+            s->min, s->median, s->mean, s->stddev, lines / seconds / 1000.0, length / seconds / (1024.0 * 1024.0));
+    }
+
+    free(source);
+    return true;
+}
+
+/*
+ * doubles the option at offset 'field' every step ('linear' adds one 
+ * instead) and prints the cost per line of every phase. linear phases keep 
+ * ns/line flat, a lookup that scans shows up as growth on what it scans
+ */
+static bool sweep(const struct bench *bench, const struct pygen_options *base, const char *name, size_t field, bool linear)
+{
+    struct pygen_options options = *base;
+    double previous = 0.0;
+    double first = 0.0;
+
+    printf("\nsweep over %s\n", name);
+    printf("%8s %8s", name, "lines");
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+        printf(" %9s ns", phase_names[phase]);
+    printf(" %8s %8s\n", "ns/line", "growth");
+
+    size_t *value = (size_t*)((char*)&options + field);
+    for (int step = 0; step < SWEEP_STEPS; step++) {
+        size_t length;
+        size_t lines;
+        char *source = pygen_program(&options, &length, &lines);
+        struct summary results[PHASE_COUNT + 1];
+
+        if (!measure(bench, source, length, results)) {
+            printf("err: failed to compile generated program\n");
+            free(source);
+            return false;
+        }
+
+        printf("%8zu %8zu", *value, lines);
+        for (int phase = 0; phase < PHASE_COUNT; phase++)
+            printf(" %12.1f", results[phase].median * 1000.0 / lines);
+
+        double per_line = results[PHASE_COUNT].median * 1000.0 / lines;
+        first = first == 0.0 ? per_line : first;
+        printf(" %8.1f %8.2f%s\n", per_line, per_line / first, previous > 0.0 && per_line > previous * CLIFF_GROWTH ? "  <- cliff" : "");
+        previous = per_line;
+
+        free(source);
+        if (linear)
+            *value += 1;
+        else
+            *value = *value ? *value * 2 : 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    struct pygen_options options = { .functions = 64, .locals = 8, .strings = 4, .nesting = 2, .lines = 0, .seed = 1 };
+    struct bench bench = { .iterations = 10, .warmup = 2, .threads = 1 };
+    bool generate = false;
+    bool quick = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            printf("%s", usage);
+            return 1;
+        }
+
+        /* every option but -g and -q takes a value */
+        size_t value = i + 1 < argc ? (size_t)atol(argv[i + 1]) : 0;
+        switch (argv[i][1]) {
+        case 'f':
+            options.functions = value;
+            i++;
+            break;
+        case 'l':
+            options.locals = value;
+            i++;
+            break;
+        case 's':
+            options.strings = value;
+            i++;
+            break;
+        case 'd':
+            options.nesting = value;
+            i++;
+            break;
+        case 'L':
+            options.lines = value;
+            i++;
+            break;
+        case 'n':
+            bench.iterations = value ? value : 1;
+            i++;
+            break;
+        case 'w':
+            bench.warmup = value;
+            i++;
+            break;
+        case 'j':
+            bench.threads = value;
+            i++;
+            break;
+        case 'g':
+            generate = true;
+            break;
+        case 'q':
+            quick = true;
+            break;
+        default:
+            printf("%s", usage);
+            return 1;
+        }
+    }
+
+    if (generate) {
+        size_t length;
+        size_t lines;
+        char *source = pygen_program(&options, &length, &lines);
+        fwrite(source, 1, length, stdout);
+        free(source);
+        return 0;
+    }
+
+    if (!report_shape(&bench, &options))
+        return 1;
+    if (quick)
+        return 0;
+
+    /* the padding sweep starts from the unpadded size of the base shape */
+    struct pygen_options padded = options;
+    size_t length;
+    char *source = pygen_program(&options, &length, &padded.lines);
+    free(source);
+
+    bool status = sweep(&bench, &options, "functions", offsetof(struct pygen_options, functions), false)
+        && sweep(&bench, &options, "locals", offsetof(struct pygen_options, locals), false)
+        && sweep(&bench, &options, "strings", offsetof(struct pygen_options, strings), false)
+        && sweep(&bench, &options, "nesting", offsetof(struct pygen_options, nesting), true)
+        && sweep(&bench, &padded, "lines", offsetof(struct pygen_options, lines), false);
+    return status ? 0 : 1;
+}
\ No newline at end of file
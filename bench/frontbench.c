@@ -0,0 +1,95 @@
+#include "pygen.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_SIZE (8 * 1024 * 1024)
+
+static const size_t thread_counts[] = { 1, 2, 4, 8 };
+
+static bool same_ir(struct vscc_context *a, struct vscc_context *b)
+{
+    struct vscc_function *x = a->function_stream;
+    struct vscc_function *y = b->function_stream;
+
+    for (; x && y; x = x->next, y = y->next) {
+        if (strcmp(x->symbol_name, y->symbol_name) != 0 || x->return_size != y->return_size)
+            return false;
+
+        struct vscc_instruction *i = x->instruction_stream;
+        struct vscc_instruction *j = y->instruction_stream;
+        for (; i && j; i = i->next, j = j->next) {
+            if (i->opcode != j->opcode || (i->dest == NULL) != (j->dest == NULL) || (i->src == NULL) != (j->src == NULL))
+                return false;
+            if (i->dest && strcmp(i->dest->symbol_name, j->dest->symbol_name) != 0)
+                return false;
+            if (i->src && strcmp(i->src->symbol_name, j->src->symbol_name) != 0)
+                return false;
+            if (i->opcode != O_CALL && i->imm1 != j->imm1)
+                return false;
+        }
+        if (i || j)
+            return false;
+    }
+
+    struct vscc_register *g = a->global_stream;
+    struct vscc_register *h = b->global_stream;
+    for (; g && h; g = g->next, h = h->next)
+        if (strcmp(g->symbol_name, h->symbol_name) != 0 || g->size != h->size)
+            return false;
+
+    return !x && !y && !g && !h;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = argc > 1 ? (size_t)atol(argv[1]) * 1024 * 1024 : SOURCE_SIZE;
+    /* many small functions calling into each other, the way generated scripts look */
+    struct pygen_options options = { .functions = 1, .locals = 2, .strings = 1, .nesting = 2, .bytes = size, .seed = 1 };
+    size_t length;
+    size_t lines;
+    char *source = pygen_program(&options, &length, &lines);
+
+    struct vscc_context reference = { 0 };
+    int64_t baseline = 0;
+
+    printf("%.1f MB of source\n", length / (1024.0 * 1024.0));
+    printf("%8s %10s %10s %10s %8s %10s\n", "threads", "lex (us)", "parse (us)", "total (us)", "speedup", "identical");
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        struct lexer_stream tokens;
+        struct pybuild_context ctx = { .tokens = &tokens, .entry_name = "main", .default_size = sizeof(uint64_t), .threads = thread_counts[t] };
+        pyimpl_append_to_context(&ctx.vscc_ctx);
+
+        int64_t start_time = pyperf_time_us();
+        bool lexed = str_to_tokens_parallel(&tokens, source, length, thread_counts[t]);
+        int64_t lex_time = pyperf_time_us() - start_time;
+
+        start_time = pyperf_time_us();
+        bool parsed = lexed && parse(&ctx, &tokens);
+        int64_t parse_time = pyperf_time_us() - start_time;
+
+        if (!parsed) {
+            printf("err: failed to parse generated program\n");
+            return 1;
+        }
+
+        /* the single threaded run is the reference every other run has to match */
+        int64_t total = lex_time + parse_time;
+        if (t == 0) {
+            reference = ctx.vscc_ctx;
+            baseline = total;
+        }
+
+        printf("%8zu %10ld %10ld %10ld %8.2f %10s\n", thread_counts[t], lex_time, parse_time, total, (double)baseline / total, 
+            t == 0 ? "-" : same_ir(&reference, &ctx.vscc_ctx) ? "yes" : "NO");
+        lexer_free(&tokens);
+    }
+
+    free(source);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "pyvscc.h"
+#include "pyimpl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char *source =
+    "def main():\n"
+    "\tprint(0)\n"
+    "\treturn 0\n"
+    "\n"
+    "def count(n):\n"
+    "\tfor i in range(n):\n"
+    "\t\tprint(i)\n"
+    "\treturn 0\n";
+
+static int64_t time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + (int64_t)ts.tv_nsec;
+}
+
+/* every magnitude and both signs, the same sequence for both runs */
+static int64_t *generate_values(long count)
+{
+    int64_t *values = malloc(count * sizeof(int64_t));
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (long i = 0; i < count; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        values[i] = (int64_t)(state >> (state % 64));
+        if (state & 1)
+            values[i] = -values[i];
+    }
+    return values;
+}
+
+/*
+ * either the given values or, without them, 0 up to 'count' the way a 
+ * loop counter passed to print(i) goes
+ */
+struct print_job {
+    const struct pyvscc_function *fn;
+    const int64_t *values;
+    long count;
+};
+
+/* the buffering print does, flushed the same way */
+static void print_snprintf(const struct print_job *job)
+{
+    char buffer[PYIMPL_STDOUT_SIZE];
+    size_t length = 0;
+    for (long i = 0; i < job->count; i++) {
+        if (length > PYIMPL_STDOUT_SIZE - PYIMPL_INT_LENGTH) {
+            write(STDOUT_FILENO, buffer, length);
+            length = 0;
+        }
+        length += snprintf(buffer + length, PYIMPL_STDOUT_SIZE - length, "%ld", job->values ? (long)job->values[i] : i);
+    }
+    write(STDOUT_FILENO, buffer, length);
+}
+
+static void print_native(const struct print_job *job)
+{
+    uint64_t (*print_int)(int64_t) = job->fn->address;
+    uint64_t (*flush)(void) = job->fn->flush;
+    for (long i = 0; i < job->count; i++)
+        print_int(job->values[i]);
+    flush();
+}
+
+/* the compiled loop, print(i) on a variable */
+static void count_native(const struct print_job *job)
+{
+    uint64_t (*count)(int64_t) = job->fn->address;
+    uint64_t (*flush)(void) = job->fn->flush;
+    count(job->count);
+    flush();
+}
+
+/* runs one side with stdout sent to 'path', returns the time it took */
+static int64_t run(const char *path, void (*side)(const struct print_job*), const struct print_job *job)
+{
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+
+    int64_t start_time = time_ns();
+    side(job);
+    int64_t elapsed = time_ns() - start_time;
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return elapsed;
+}
+
+static char *read_file(const char *path, size_t *length)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    *length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *buffer = malloc(*length + 1);
+    *length = fread(buffer, 1, *length, f);
+    fclose(f);
+    return buffer;
+}
+
+/* one side against snprintf of the same values, false if the outputs differ */
+static bool compare(const char *name, const struct print_job *job, void (*side)(const struct print_job*))
+{
+    char native_path[] = "/tmp/pyvscc_intbench_XXXXXX";
+    char libc_path[] = "/tmp/pyvscc_intbench_XXXXXX";
+    close(mkstemp(native_path));
+    close(mkstemp(libc_path));
+
+    int64_t native_ns = run(native_path, side, job);
+    int64_t libc_ns = run(libc_path, print_snprintf, job);
+
+    size_t native_length = 0, libc_length = 0;
+    char *native = read_file(native_path, &native_length);
+    char *libc = read_file(libc_path, &libc_length);
+    bool same = native && libc && native_length == libc_length && memcmp(native, libc, native_length) == 0;
+
+    long count = job->count;
+    printf("%s: %ld numbers, %zu bytes: %.1f ns/number, snprintf %.1f ns/number (%.2fx)%s\n", name, count, libc_length,
+        count ? (double)native_ns / count : 0.0, count ? (double)libc_ns / count : 0.0,
+        native_ns ? (double)libc_ns / native_ns : 0.0, same ? "" : ", outputs differ");
+
+    unlink(native_path);
+    unlink(libc_path);
+    free(native);
+    free(libc);
+    return same;
+}
+
+/*
+ * print of an integer, called directly and from a compiled loop printing 
+ * its counter, against libc formatting the same values into a buffer of the
+ * same size, both written to a file so the terminal is not measured
+ */
+int main(int argc, char **argv)
+{
+    long count = argc > 1 ? atol(argv[1]) : 10000000;
+    struct pyvscc_options options = { .default_size = sizeof(uint64_t), .threads = 1, .optimize = argc > 2 };
+
+    struct pyvscc_module *module = pyvscc_compile(source, strlen(source), &options);
+    if (module == NULL)
+        return 1;
+
+    const struct pyvscc_function *print = pyvscc_lookup(module, "pyimpl_print_int");
+    const struct pyvscc_function *loop = pyvscc_lookup(module, "count");
+    if (print == NULL || print->flush == NULL || loop == NULL) {
+        printf("err: function 'pyimpl_print_int' or 'count' not found\n");
+        return 1;
+    }
+
+    int64_t *values = generate_values(count);
+    bool same = compare("print", &(struct print_job){ print, values, count }, print_native);
+    same = compare("print(i)", &(struct print_job){ loop, NULL, count }, count_native) && same;
+
+    free(values);
+    pyvscc_free(module);
+    return same ? 0 : 1;
+}
\ No newline at end of file
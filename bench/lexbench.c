@@ -0,0 +1,86 @@
+#include "pygen.h"
+#include "lexer.h"
+#include "baselinelex.h"
+#include "pyperf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_SIZE (64 * 1024 * 1024)
+#define ITERATIONS 5
+
+static double run(enum lexer_simd simd, const char *source, size_t length, struct lexer_stream *result)
+{
+    static const char *names[] = { "auto", "scalar", "sse2", "avx2" };
+    int64_t best = INT64_MAX;
+
+    if (lexer_set_simd(simd) != simd) {
+        printf("%-8s unsupported\n", names[simd]);
+        return 0.0;
+    }
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int64_t start_time = pyperf_time_us();
+        str_to_tokens(result, source, length);
+        int64_t end_time = pyperf_time_us();
+
+        if (end_time - start_time < best)
+            best = end_time - start_time;
+        if (i != ITERATIONS - 1)
+            lexer_free(result);
+    }
+
+    double mbps = (double)length / (best ? best : 1);
+    printf("%-8s %8ld us  %8.1f MB/s  %zu tokens\n", names[simd], best, mbps, result->count);
+    return mbps;
+}
+
+/* the tokenizer the spans replaced, its list is freed outside the timing */
+static double run_baseline(const char *source, size_t length)
+{
+    int64_t best = INT64_MAX;
+    size_t count = 0;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int64_t start_time = pyperf_time_us();
+        struct baseline_token *tokens = baseline_str_to_tokens(source);
+        int64_t end_time = pyperf_time_us();
+
+        if (end_time - start_time < best)
+            best = end_time - start_time;
+        count = baseline_free(tokens);
+    }
+
+    double mbps = (double)length / (best ? best : 1);
+    printf("%-8s %8ld us  %8.1f MB/s  %zu tokens (whitespace included)\n", "baseline", best, mbps, count);
+    return mbps;
+}
+
+int main(int argc, char **argv)
+{
+    /* long identifiers, numeric and string literals, the way generated scripts look */
+    struct pygen_options options = { .functions = 1, .locals = 2, .strings = 1, .nesting = 2, .bytes = argc > 1 ? atol(argv[1]) : SOURCE_SIZE, .seed = 1 };
+    size_t length;
+    size_t lines;
+    char *source = pygen_program(&options, &length, &lines);
+
+    double baseline = run_baseline(source, length);
+
+    struct lexer_stream streams[3] = { 0 };
+    double scalar = run(LEXER_SIMD_NONE, source, length, &streams[0]);
+    double sse2 = run(LEXER_SIMD_SSE2, source, length, &streams[1]);
+    double avx2 = run(LEXER_SIMD_AVX2, source, length, &streams[2]);
+
+    /* every path must produce the same stream */
+    for (int i = 1; i < 3; i++) {
+        if (streams[i].tokens && (streams[i].count != streams[0].count || memcmp(streams[i].tokens, streams[0].tokens, streams[0].count * sizeof(struct lexer_token)) != 0)) {
+            printf("err: token stream mismatch\n");
+            return 1;
+        }
+    }
+
+    printf("speedup over baseline: scalar %.2fx, sse2 %.2fx, avx2 %.2fx\n", scalar / baseline, sse2 / baseline, avx2 / baseline);
+    printf("speedup over scalar: sse2 %.2fx, avx2 %.2fx\n", sse2 / scalar, avx2 / scalar);
+    return 0;
+}
\ No newline at end of file
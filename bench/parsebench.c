@@ -0,0 +1,50 @@
+#include "pygen.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STEPS 6
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 250;
+    double first = 0.0;
+
+    printf("%8s %8s %12s %10s %8s\n", "n", "lines", "parse (us)", "ns/line", "growth");
+    for (int step = 0; step < STEPS; step++, n *= 2) {
+        /* 'n' functions, each calling the previous one, global lookups scale with 'n' */
+        struct pygen_options options = { .functions = n, .locals = 8, .strings = 1, .nesting = 1, .seed = 1 };
+        size_t length;
+        size_t lines;
+        char *source = pygen_program(&options, &length, &lines);
+
+        struct lexer_stream tokens;
+        str_to_tokens(&tokens, source, length);
+
+        struct pybuild_context ctx = { .tokens = &tokens, .entry_name = "main", .default_size = sizeof(uint64_t) };
+        pyimpl_append_to_context(&ctx.vscc_ctx);
+
+        int64_t start_time = pyperf_time_us();
+        bool status = parse(&ctx, &tokens);
+        int64_t end_time = pyperf_time_us();
+
+        if (!status) {
+            printf("err: failed to parse generated program\n");
+            return 1;
+        }
+
+        /* linear scaling keeps ns/line flat, growth stays near 1.0 */
+        double per_line = (end_time - start_time) * 1000.0 / lines;
+        first = first == 0.0 ? per_line : first;
+        printf("%8d %8zu %12ld %10.1f %8.2f\n", n, lines, end_time - start_time, per_line, per_line / first);
+
+        lexer_free(&tokens);
+        free(source);
+    }
+
+    return 0;
+}
\ No newline at end of file
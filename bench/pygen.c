@@ -0,0 +1,117 @@
+#include "pygen.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct generator {
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    size_t lines;
+    uint64_t state;
+};
+
+static uint64_t next_random(struct generator *gen)
+{
+    /* xorshift64, a zero state would stay zero */
+    gen->state ^= gen->state << 13;
+    gen->state ^= gen->state >> 7;
+    gen->state ^= gen->state << 17;
+    return gen->state;
+}
+
+static size_t pick(struct generator *gen, size_t count)
+{
+    return next_random(gen) % count;
+}
+
+static void emit(struct generator *gen, size_t depth, const char *format, ...)
+{
+    if (gen->length + depth + 256 > gen->capacity) {
+        gen->capacity = gen->capacity * 2 + depth + 256;
+        gen->buffer = realloc(gen->buffer, gen->capacity);
+    }
+
+    memset(gen->buffer + gen->length, '\t', depth);
+    gen->length += depth;
+
+    va_list args;
+    va_start(args, format);
+    gen->length += vsnprintf(gen->buffer + gen->length, gen->capacity - gen->length, format, args);
+    va_end(args);
+
+    gen->buffer[gen->length++] = '\n';
+    gen->lines++;
+}
+
+/*
+ * loops alternate between counted for loops and while loops, the innermost
+ * body holds the string prints and the padding
+ */
+static void emit_function(struct generator *gen, const struct pygen_options *options, size_t index, size_t locals, size_t padding)
+{
+    emit(gen, 0, "def synthetic_function_%zu(first_argument, second_argument):", index);
+    emit(gen, 1, "local_%zu_0 = first_argument", index);
+    emit(gen, 1, "local_%zu_1 = second_argument", index);
+    for (size_t i = 2; i < locals; i++)
+        emit(gen, 1, "local_%zu_%zu = %zu", index, i, pick(gen, 100000));
+
+    size_t depth = 1;
+    for (size_t level = 0; level < options->nesting; level++, depth++) {
+        if (level % 2 == 0) {
+            emit(gen, depth, "for loop_%zu_%zu in range(%zu):", index, level, 1 + pick(gen, 64));
+        } else {
+            emit(gen, depth, "while local_%zu_0 < %zu:", index, 1 + pick(gen, 100000));
+            emit(gen, depth + 1, "local_%zu_0 += 1", index);
+        }
+    }
+
+    for (size_t i = 0; i < options->strings; i++) {
+        emit(gen, depth, "if local_%zu_%zu == %zu:", index, pick(gen, locals), pick(gen, 100000));
+        emit(gen, depth + 1, "print('synthetic string %zu of function %zu\\n')", i, index);
+    }
+
+    static const char *operators[] = { "+=", "-=", "*=" };
+    for (size_t i = 0; i < padding; i++)
+        emit(gen, depth, "local_%zu_%zu %s local_%zu_%zu", index, pick(gen, locals), operators[pick(gen, 3)], index, pick(gen, locals));
+
+    if (!options->strings && !padding)
+        emit(gen, depth, "local_%zu_1 += 1", index);
+
+    if (index > 0)
+        emit(gen, 1, "local_%zu_0 = synthetic_function_%zu(local_%zu_1, %zu)", index, index - 1, index, pick(gen, 1000));
+    emit(gen, 1, "return local_%zu_0", index);
+    emit(gen, 0, "");
+}
+
+char *pygen_program(const struct pygen_options *options, size_t *length, size_t *lines)
+{
+    struct generator gen = { .state = options->seed ? options->seed : 0x9e3779b97f4a7c15ull };
+    size_t functions = options->functions ? options->functions : 1;
+    size_t locals = options->locals < 2 ? 2 : options->locals;
+
+    /*
+     * lines of one function without padding: header, locals, loops (while
+     * loops take two), prints, call, return and the blank line
+     */
+    size_t fixed = 1 + locals + options->nesting + options->nesting / 2 + 2 * options->strings + 3;
+    size_t needed = functions * fixed + 3;
+    size_t padding = options->lines > needed ? options->lines - needed : 0;
+
+    size_t i = 0;
+    for (; i < functions || gen.length < options->bytes; i++) {
+        size_t extra = padding / functions + (i < padding % functions);
+        emit_function(&gen, options, i, locals, extra);
+    }
+
+    emit(&gen, 0, "def main():");
+    emit(&gen, 1, "result = synthetic_function_%zu(1, 2)", i - 1);
+    emit(&gen, 1, "return result");
+
+    gen.buffer[gen.length] = 0;
+    *length = gen.length;
+    *lines = gen.lines;
+    return gen.buffer;
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef _PYGEN_H_
+#define _PYGEN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * shape of a synthetic program. every function has 'locals' locals (at
+ * least two), 'strings' distinct string literals and loops nested 'nesting'
+ * deep. bodies are padded with statements until the program has 'lines'
+ * lines, fewer than the shape needs is ignored. functions are added past
+ * 'functions' until the program is at least 'bytes' long
+ */
+struct pygen_options {
+    size_t functions;
+    size_t locals;
+    size_t strings;
+    size_t nesting;
+    size_t lines;
+    size_t bytes;
+    uint64_t seed;
+};
+
+/* the same options always produce the same program, followed by a main */
+char *pygen_program(const struct pygen_options *options, size_t *length, size_t *lines);
+
+#endif /* _PYGEN_H_ */
\ No newline at end of file
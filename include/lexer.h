@@ -1,6 +1,10 @@
 #ifndef _LEXER_H_
 #define _LEXER_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 enum lexer_token_type {
     TOKEN_NONE,
     TOKEN_OPEN_BRACE,
@@ -16,6 +20,8 @@ enum lexer_token_type {
     TOKEN_QUOTE,
     TOKEN_STRING,
     TOKEN_IF,
+    TOKEN_ELIF,
+    TOKEN_ELSE,
     TOKEN_WHILE,
     TOKEN_FOR,
     TOKEN_DEF,
@@ -36,16 +42,59 @@ enum lexer_token_type {
 
     TOKEN_WHITESPACE,
     TOKEN_NEWLINE,
-    TOKEN_TAB
+    TOKEN_TAB,
+    TOKEN_EOF
 };
 
+/*
+ * tokens do not own their text, they are spans into the source buffer
+ */
 struct lexer_token {
     enum lexer_token_type type;
-    char contents[64];
+    uint32_t offset;
+    uint32_t length;
+};
+
+/*
+ * tokens are stored contiguously and terminated by a TOKEN_EOF token, 
+ * whitespace is not stored at all
+ */
+struct lexer_stream {
+    const char *source;
+
+    struct lexer_token *tokens;
+    size_t count;
+    size_t capacity;
+};
 
-    struct lexer_token *next;
+enum lexer_simd {
+    LEXER_SIMD_AUTO,
+    LEXER_SIMD_NONE,
+    LEXER_SIMD_SSE2,
+    LEXER_SIMD_AVX2
 };
 
-struct lexer_token *str_to_tokens(const char *buffer);
+enum lexer_simd lexer_set_simd(enum lexer_simd simd);
+
+/*
+ * identifiers name vscc registers and functions, whose names are 64 byte 
+ * arrays, so longer ones fail the lex instead of colliding once cut short
+ */
+#define LEXER_MAX_IDENTIFIER 63
+
+bool str_to_tokens(struct lexer_stream *stream, const char *buffer, size_t length);
+
+/*
+ * splits the source at top level defs and lexes the pieces on 'threads' 
+ * threads (0 for every cpu), the stream matches str_to_tokens token for 
+ * token. sources under two chunks are lexed on the caller
+ */
+#define LEXER_MIN_CHUNK (64 * 1024)
+
+bool str_to_tokens_parallel(struct lexer_stream *stream, const char *buffer, size_t length, size_t threads);
+void lexer_free(struct lexer_stream *stream);
+
+char *lexer_token_text(const struct lexer_stream *stream, const struct lexer_token *token, char *buffer, size_t size);
+size_t lexer_unescape(const struct lexer_stream *stream, const struct lexer_token *token, char *buffer);
 
 #endif /* _LEXER_H_ */
\ No newline at end of file
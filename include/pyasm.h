@@ -0,0 +1,108 @@
+#ifndef _PYASM_H_
+#define _PYASM_H_
+
+#include <vscc.h>
+
+/*
+ * general purpose register numbers, as encoded
+ */
+enum pyasm_gpr {
+    GPR_RAX, GPR_RCX, GPR_RDX, GPR_RBX, GPR_RSP, GPR_RBP, GPR_RSI, GPR_RDI,
+    GPR_R8, GPR_R9, GPR_R10, GPR_R11, GPR_R12, GPR_R13, GPR_R14, GPR_R15
+};
+
+#define GPR_MASK(r) (1u << (r))
+#define GPR_ALL 0xffffu
+
+struct pyasm_insn {
+    uint32_t offset;
+    uint8_t length;
+
+    uint8_t rex;
+    /* opcode map of vex encoded instructions (1 for 0f), 0 otherwise */
+    uint8_t vex;
+    bool opsize;
+    bool rep;
+    bool two_byte;
+    uint8_t opcode;
+    uint8_t opcode_at;
+
+    bool has_modrm;
+    uint8_t modrm;
+    uint8_t modrm_at;
+    bool has_sib;
+    uint8_t sib;
+
+    uint8_t disp_at;
+    uint8_t disp_size;
+    int32_t disp;
+
+    uint8_t imm_at;
+    uint8_t imm_size;
+    int64_t imm;
+
+    /* relative branches and rip-relative operands, target is an offset into the image */
+    bool rip_relative;
+    bool relative;
+    uint8_t rel_at;
+    uint8_t rel_size;
+    int64_t target;
+};
+
+struct pyasm_edit {
+    uint8_t prefix[16];
+    uint8_t prefix_length;
+
+    bool replaced;
+    uint8_t bytes[16];
+    uint8_t length;
+
+    /* position of a rel8/rel32 in 'bytes' still pointing at the original target, -1 if none */
+    int8_t rel_at;
+    uint8_t rel_size;
+
+    /* replaces the instruction with a longer, self contained sequence, nothing in it is relocated */
+    const uint8_t *code;
+    uint32_t code_length;
+};
+
+struct pyasm_function {
+    struct vscc_symbol *symbol;
+    uint32_t start;
+    uint32_t end;
+
+    size_t first;
+    size_t count;
+};
+
+/*
+ * decoded view of the code in a vscc_codegen_data, functions come first and
+ * everything from 'code_end' onwards is data. after a successful relink only
+ * 'code_end' is still meaningful
+ */
+struct pyasm_image {
+    struct vscc_codegen_data *data;
+    uint32_t code_end;
+
+    /* relinked data starts at an offset congruent to 'data_phase' modulo 'data_align' */
+    uint32_t data_align;
+    uint32_t data_phase;
+
+    struct pyasm_function *functions;
+    size_t functionc;
+
+    struct pyasm_insn *insns;
+    struct pyasm_edit *edits;
+    size_t insnc;
+};
+
+bool pyasm_decode(const uint8_t *code, size_t length, size_t offset, struct pyasm_insn *insn);
+
+bool pyasm_image_init(struct pyasm_image *image, struct vscc_codegen_data *data, struct vscc_context *ctx);
+void pyasm_image_free(struct pyasm_image *image);
+
+size_t pyasm_find(struct pyasm_image *image, uint64_t offset);
+uint16_t pyasm_registers_used(struct pyasm_insn *insn);
+bool pyasm_relink(struct pyasm_image *image);
+
+#endif /* _PYASM_H_ */
\ No newline at end of file
@@ -3,13 +3,60 @@
 
 #include <vscc.h>
 #include "lexer.h"
+#include "pysym.h"
+#include "pyreg.h"
+#include "pypeep.h"
+#include "pyperf.h"
+#include "pyprofile.h"
 
+/*
+ * string body queued for the global 'dst', written behind its length (see
+ * PYIMPL_STRING_PREFIX) once the global has an offset. bodies pointing into
+ * the source are borrowed, unescaped ones are 'owned' and freed with the node
+ */
 struct pybuild_memcpy {
     struct pybuild_memcpy *next;
 
     char *dst;
     void *src;
     size_t length;
+    bool owned;
+
+    uintptr_t offset;
+};
+
+/*
+ * a value passed to a parameter at a call site: an integer, a string or 
+ * the untyped parameter of the caller it is passed on from, see 
+ * 'string_values'
+ */
+struct pybuild_argument {
+    struct pybuild_argument *next;
+
+    struct vscc_function *callee;
+    size_t index;
+    const void *value;
+};
+
+/* a builtin called on an untyped parameter, 'call' is switched to the string variant when needed */
+struct pybuild_deferred {
+    struct pybuild_deferred *next;
+
+    struct vscc_instruction *call;
+    char *name;
+    struct vscc_function *fn;
+    struct vscc_register *parameter;
+};
+
+/*
+ * if/elif chain comparing one register against distinct literals, 'labels' 
+ * holds the body label of every arm in source order
+ */
+struct pybuild_switch {
+    int *labels;
+    size_t count;
+    size_t current;
+    int default_label;
 };
 
 struct pybuild_branch {
@@ -18,11 +65,38 @@ struct pybuild_branch {
     int type;
     int start_label;
     int end_label;
+
+    /* if/elif/else chains, -1 until an arm has to jump past the chain */
+    int exit_label;
+    struct pybuild_switch *cases;
+
+    /* 
+     * counted loops, 'end_label' marks the loop condition at the bottom. 
+     * 'counter' is hidden, the named variable is a copy of it
+     */
+    struct vscc_register *counter;
+    struct vscc_register *bound;
+    int64_t bound_value;
+    int64_t step;
+
+    /*
+     * profile guided layout: a cold arm is entered through 'start_label' and 
+     * moved behind the function, a hot while loop tests 'condition' at its 
+     * bottom, under 'test_label'
+     */
+    bool cold;
+    struct vscc_instruction *cold_after;
+    bool rotated;
+    struct lexer_token *condition;
+    int test_label;
 };
 
 struct pybuild_context {
     struct vscc_context vscc_ctx;
     struct vscc_codegen_data compiled_data;
+    struct lexer_stream *tokens;
+
+    /* NULL when no entry is needed, the build then returns 0 for it */
     char *entry_name;
 
     int current_label;
@@ -32,11 +106,81 @@ struct pybuild_context {
     struct vscc_register *return_reg;
     size_t default_size;
 
+    /* names of compiler generated registers, numbered per function */
+    int autogen;
+    char autogen_name[64];
+
     struct pybuild_memcpy *memcpy_queue;
     struct pybuild_branch *branch_queue;
+    struct pybuild_branch *chain;
+
+    struct pysym_table strings;
+    struct pysym_table locals;
+    struct pysym_table globals;
+    struct pysym_table functions;
+    struct pysym_table builtins;
+    struct pysym_table symbols;
+
+    /*
+     * registers holding strings and functions declared '-> str', print picks 
+     * its variant by them. parameters without a type hold whatever their 
+     * callers pass, builtins called on them are 'deferred' until every 
+     * 'argument' is known. 'inferred' counts the calls decided that way
+     */
+    struct pysym_table string_values;
+    struct pybuild_argument *arguments;
+    struct pybuild_deferred *deferred;
+    size_t inferred;
+
+    /*
+     * instrumented builds count entries and conditionals, see pyprofile.h. 
+     * with a profile, cold arms collect in 'cold' until the function ends
+     */
+    bool instrument;
+    const struct pyprofile *profile;
+    const struct pyprofile_function *profile_function;
+    size_t profile_site;
+    struct vscc_instruction *cold;
+    size_t cold_arms;
+    size_t rotated_loops;
+
+    /* set on contexts parsing function bodies on the pool, read only meanwhile */
+    const struct pybuild_context *parent;
+
+    size_t threads;
+    bool optimize;
+    struct pyreg_stats regalloc;
+    struct pypeep_stats peephole;
+    int64_t bytes_saved;
+
+    /*
+     * runtime routines running as machine code, see pynative.h. calls to 
+     * builtins without a working ir body (pyimpl_requires_native) fail the 
+     * build when they were not swapped, functions whose ir is gone report 
+     * their calls in 'requires_natives'
+     */
+    size_t natives;
+    bool requires_natives;
+    bool natives_missing;
+
+    /* phases of build are added to the report when one is attached */
+    struct pyperf *perf;
 };
 
-bool parse(struct pybuild_context *ctx, struct lexer_token *lex_tokens);
+bool parse(struct pybuild_context *ctx, struct lexer_stream *stream);
 uintptr_t build(struct pybuild_context *ctx);
 
+/*
+ * swaps in native routines and applies queued writes to code already in 
+ * 'compiled_data', returns the entry offset. -1 without an entry and when 
+ * 'natives_missing' is set, which is reported here. build returns the same
+ */
+uintptr_t build_linked(struct pybuild_context *ctx);
+
+/* whether 'fn' calls a builtin that only works as machine code */
+bool build_requires_natives(const struct vscc_function *fn);
+
+/* releases the ir, generated code and every table, the context can be reused */
+void build_free(struct pybuild_context *ctx);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef _PYCACHE_H_
+#define _PYCACHE_H_
+
+#include <vscc.h>
+
+#define PYVSCC_VERSION "0.1.0"
+
+/* bump whenever the layout of the image or of the entry changes */
+#define PYCACHE_MAGIC "PYVC"
+#define PYCACHE_FORMAT 3
+
+/*
+ * compiled binaries are stored as <dir>/<key>.bin, the key covers the source,
+ * every flag affecting code generation and the compiler itself: a hash of 
+ * the running executable, so every rebuild of pyvscc starts a fresh cache
+ */
+uint64_t pycache_key(const char *source, size_t length, const char *flags);
+
+/* 'code_end' keeps code apart from data once the ir is gone, see pyperfmap_code_end */
+bool pycache_load(const char *dir, uint64_t key, struct vscc_codegen_data *data, uintptr_t *entry_offset, size_t *code_end, int64_t *compile_us);
+bool pycache_store(const char *dir, uint64_t key, const struct vscc_codegen_data *data, uintptr_t entry_offset, size_t code_end, int64_t compile_us);
+
+#endif /* _PYCACHE_H_ */
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef _PYCODEGEN_H_
+#define _PYCODEGEN_H_
+
+#include <vscc.h>
+
+/* below this many functions the pool costs more than it saves */
+#define CODEGEN_MIN_FUNCTIONS 16
+
+/*
+ * a rel32 leaving its function, 'name' indexes the piece's names and 
+ * 'addend' is the offset into that symbol. 'at' and 'next' (the end of the 
+ * referencing instruction) are relative to the start of the function
+ */
+struct pycodegen_reloc {
+    uint32_t at;
+    uint32_t next;
+    uint32_t name;
+    int64_t addend;
+};
+
+/*
+ * machine code of a single function, position independent apart from its
+ * relocations
+ */
+struct pycodegen_piece {
+    char symbol_name[64];
+
+    uint8_t *code;
+    size_t length;
+
+    struct pycodegen_reloc *relocs;
+    size_t relocc;
+
+    char (*names)[64];
+    size_t namec;
+};
+
+bool pycodegen_function(struct vscc_function *fn, struct vscc_codegen_interface *interface, struct pycodegen_piece *piece);
+void pycodegen_piece_free(struct pycodegen_piece *piece);
+
+/*
+ * lays pieces out in the given order followed by 'globals' (placed by vscc 
+ * exactly as they would follow the code) and resolves every relocation, 
+ * fails if a name can not be found
+ */
+bool pycodegen_link(struct pycodegen_piece **pieces, size_t count, struct vscc_register *globals, struct vscc_codegen_interface *interface, 
+    struct vscc_codegen_data *data, size_t threads);
+
+/*
+ * generates every function on its own (spread over 'threads' workers, 0 for 
+ * every cpu) and links the pieces in source order. the result matches a 
+ * single vscc_codegen call over the whole context byte for byte, returns 
+ * false (leaving 'data' untouched) if any piece could not be linked
+ */
+bool pycodegen_parallel(struct vscc_context *ctx, struct vscc_codegen_data *data, size_t threads);
+
+#endif /* _PYCODEGEN_H_ */
\ No newline at end of file
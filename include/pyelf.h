@@ -0,0 +1,17 @@
+#ifndef _PYELF_H_
+#define _PYELF_H_
+
+#include <vscc.h>
+
+#define ELF_BASE 0x400000
+#define ELF_PAGE 4096
+
+/*
+ * write a static x86-64 executable whose _start calls the entry, flushes 
+ * print output and exits with the entry's return value. code and data get their own segments when the 
+ * code can be relinked to put the data on a page of its own, 'split' reports
+ * whether that happened
+ */
+bool pyelf_write(const char *path, struct vscc_codegen_data *data, struct vscc_context *ctx, uintptr_t entry_offset, bool *split);
+
+#endif /* _PYELF_H_ */
\ No newline at end of file
@@ -15,9 +15,121 @@ enum pyimpl_implementation {
     PYIMPL_FIRST_ARG_STRING,
 };
 
+/*
+ * string literals are stored behind their length, values point at the nul
+ * terminated body. strlen and print read the length instead of scanning
+ */
+#define PYIMPL_STRING_PREFIX sizeof(uint64_t)
+
+/*
+ * functions named like this are replaced by machine code once generated 
+ * (see pynative.h), their ir bodies must not be inlined
+ */
+#define PYIMPL_NATIVE_PREFIX "pyimpl_native_"
+
+/*
+ * print appends to a buffer in the '__stdout' global, which is written out 
+ * when it fills and by PYIMPL_FLUSH, called once the entry returns. line 
+ * buffering is asked for before running, the first print checks whether
+ * stdout is a terminal and turns it on or off for good
+ */
+#define PYIMPL_STDOUT "__stdout"
+#define PYIMPL_STDOUT_SIZE 4096
+#define PYIMPL_FLUSH "pyimpl_flush"
+
+enum pyimpl_line_buffering {
+    PYIMPL_LINE_OFF,
+    PYIMPL_LINE_REQUESTED,
+    PYIMPL_LINE_ON
+};
+
+/* layout of '__stdout', the machine code of print depends on it */
+struct pyimpl_stdout {
+    uint64_t length;
+    uint64_t line;
+    uint64_t writes;
+    uint64_t written;
+    uint8_t buffer[PYIMPL_STDOUT_SIZE];
+};
+
+/*
+ * print of an integer formats into the buffer directly, two digits at a 
+ * time out of the '__digits' global. powers[n] is 10^n for the digit count,
+ * powers[0] is zero so that values below ten come out with one digit
+ */
+#define PYIMPL_DIGITS "__digits"
+#define PYIMPL_INT_LENGTH 21
+
+/* layout of '__digits', the machine code of print depends on it */
+struct pyimpl_digits {
+    char pairs[200];
+    char sign;
+    uint8_t padding[7];
+    uint64_t powers[20];
+};
+
+/*
+ * find and strcmp scan with sse2, which every x86-64 cpu has, or with avx2.
+ * the first call of the image resolves the level into '__cpu' with cpuid
+ */
+#define PYIMPL_CPU "__cpu"
+
+enum pyimpl_cpu_level {
+    PYIMPL_CPU_UNKNOWN,
+    PYIMPL_CPU_SSE2,
+    PYIMPL_CPU_AVX2
+};
+
+/*
+ * alloc and free manage one region of 'capacity' bytes (-m), mapped by the
+ * first alloc. blocks are powers of two from 16 bytes, freed blocks go on a
+ * list per size and new ones are cut from the top of the region. a block 
+ * starts with its requested size and class, alloc returns 0 once nothing 
+ * fits
+ */
+#define PYIMPL_HEAP "__heap"
+#define PYIMPL_HEAP_CLASSES 40
+#define PYIMPL_HEAP_MAX ((uint64_t)1 << (PYIMPL_HEAP_CLASSES + 2))
+
+/* layout of '__heap', the machine code of alloc and free depends on it */
+struct pyimpl_heap {
+    uint64_t base;
+    uint64_t capacity;
+    uint64_t top;
+    uint64_t used;
+    uint64_t requested;
+    uint64_t peak;
+    uint64_t failures;
+    uint64_t free[PYIMPL_HEAP_CLASSES];
+};
+
 void pyimpl_append_to_context(struct vscc_context *ctx);
-struct vscc_function *pyimpl_get(struct vscc_context *ctx, char *fn, enum pyimpl_implementation impl);
+const char *pyimpl_get_name(char *fn, enum pyimpl_implementation impl);
 
 enum pyimpl_implementation_status pyimpl_get_implementation_status(char *fn);
 
+/* builtins and native routines (by symbol) without a working ir body, calls to them need pynative_apply */
+bool pyimpl_requires_native(const char *symbol);
+
+/* fills the tables of the runtime once code is generated, false if they are missing */
+bool pyimpl_link(struct vscc_codegen_data *data);
+
+/* offset of a symbol in generated code, -1 if it is missing */
+uintptr_t pyimpl_find_symbol(const struct vscc_codegen_data *data, const char *name);
+
+/* asks for line buffering in the image, false if it has no '__stdout' */
+bool pyimpl_request_line_buffering(struct vscc_codegen_data *data);
+
+/* caps the heap of the image, false if it has no '__heap' */
+bool pyimpl_set_heap_capacity(struct vscc_codegen_data *data, uint64_t capacity);
+
+/* state of the heap in the image mapped at 'base' */
+bool pyimpl_heap_stats(const struct vscc_codegen_data *data, const void *base, struct pyimpl_heap *heap);
+
+/* unmaps the region of the heap in the image mapped at 'base', if it has one */
+void pyimpl_heap_release(const struct vscc_codegen_data *data, void *base);
+
+/* write syscalls and bytes print made so far in the image mapped at 'base' */
+bool pyimpl_stdout_stats(const struct vscc_codegen_data *data, const void *base, uint64_t *writes, uint64_t *written);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef _PYINLINE_H_
+#define _PYINLINE_H_
+
+#include <vscc.h>
+#include "pyprofile.h"
+
+/*
+ * callees up to this many instructions (labels excluded) are inlined, callers
+ * stop growing once they reach the second limit
+ */
+#define INLINE_MAX_COST 24
+#define INLINE_MAX_CALLER 4096
+
+/* with a profile, hot callees may be this large and callers that never ran are left alone */
+#define INLINE_MAX_HOT_COST 96
+
+/*
+ * walks the call graph callees first, returns the number of call sites replaced
+ */
+size_t pyinline_functions(struct vscc_context *ctx, const struct pyprofile *profile);
+
+#endif /* _PYINLINE_H_ */
\ No newline at end of file
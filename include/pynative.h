@@ -0,0 +1,17 @@
+#ifndef _PYNATIVE_H_
+#define _PYNATIVE_H_
+
+#include <vscc.h>
+
+/*
+ * machine code for runtime routines the ir has no instructions for, like 
+ * stores through a pointer. each routine is declared by pyimpl with an ir 
+ * body (named PYIMPL_NATIVE_PREFIX...) that does a simpler version of the 
+ * same job, after code generation the body is swapped for the machine code.
+ * routines follow the sysv abi and only use caller saved registers
+ */
+
+/* returns how many routines were swapped, images that can not be decoded keep their ir bodies */
+size_t pynative_apply(struct vscc_codegen_data *data, struct vscc_context *ctx);
+
+#endif /* _PYNATIVE_H_ */
\ No newline at end of file
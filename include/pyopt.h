@@ -0,0 +1,8 @@
+#ifndef _PYOPT_H_
+#define _PYOPT_H_
+
+#include <vscc.h>
+
+size_t pyopt_fold_constants(struct vscc_function *fn);
+
+#endif /* _PYOPT_H_ */
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef _PYPEEP_H_
+#define _PYPEEP_H_
+
+#include "pyasm.h"
+
+enum pypeep_pattern {
+    PEEP_STORE_BACK,    /* mov r, m; mov m, r */
+    PEEP_SELF_MOVE,     /* mov r, r */
+    PEEP_JUMP_NEXT,     /* jmp to the following instruction */
+    PEEP_SHORT_IMM,     /* mov r64, imm with a zero extended 32-bit encoding */
+    PEEP_PATTERN_COUNT
+};
+
+struct pypeep_stats {
+    size_t hits[PEEP_PATTERN_COUNT];
+    size_t bytes[PEEP_PATTERN_COUNT];
+};
+
+const char *pypeep_pattern_name(enum pypeep_pattern pattern);
+
+/*
+ * rewrite wasteful sequences in generated code, edits are recorded in the 
+ * image and take effect on pyasm_relink
+ */
+void pypeep_optimize(struct pyasm_image *image, struct pypeep_stats *stats);
+
+#endif /* _PYPEEP_H_ */
\ No newline at end of file
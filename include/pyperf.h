@@ -0,0 +1,69 @@
+#ifndef _PYPERF_H_
+#define _PYPERF_H_
+
+#include <vscc.h>
+#include "lexer.h"
+
+#define PERF_MAX_PHASES 16
+
+/* peak_rss is the high water mark of the whole process when the phase ended, in kB */
+struct pyperf_phase {
+    const char *name;
+    int64_t us;
+    size_t allocations;
+    size_t allocated_bytes;
+    size_t peak_rss;
+};
+
+struct pyperf_function {
+    char name[64];
+    size_t instructions;
+    size_t bytes;
+};
+
+/*
+ * phases are kept in the order they ran. allocations are the ones made 
+ * through the pyperf_ wrappers below, vscc allocates on its own and is 
+ * not counted
+ */
+struct pyperf {
+    struct pyperf_phase phases[PERF_MAX_PHASES];
+    size_t phasec;
+
+    int64_t start;
+    size_t start_allocations;
+    size_t start_allocated_bytes;
+
+    size_t tokens;
+    size_t code_bytes;
+    size_t data_bytes;
+    struct pyperf_function *functions;
+    size_t functionc;
+};
+
+/* the compiler allocates through these, counting starts with the first phase */
+void *pyperf_malloc(size_t size);
+void *pyperf_calloc(size_t count, size_t size);
+void *pyperf_realloc(void *ptr, size_t size);
+void *pyperf_aligned_alloc(size_t alignment, size_t size);
+
+int64_t pyperf_time_us(void);
+size_t pyperf_peak_rss(void);
+
+/* phases do not nest, both do nothing without a report */
+void pyperf_begin(struct pyperf *perf, const char *name);
+void pyperf_end(struct pyperf *perf);
+
+/* 
+ * token, instruction and byte counts of a finished build, any part may be 
+ * missing. without functions the whole image counts as code
+ */
+void pyperf_summarize(struct pyperf *perf, const struct lexer_stream *tokens, const struct vscc_context *ctx, const struct vscc_codegen_data *data);
+
+void pyperf_print(const struct pyperf *perf);
+
+/* 'path' of "-" writes to stdout */
+bool pyperf_write_json(const struct pyperf *perf, const char *path, const char *source, bool optimize, size_t threads);
+void pyperf_free(struct pyperf *perf);
+
+#endif /* _PYPERF_H_ */
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef _PYPERFMAP_H_
+#define _PYPERFMAP_H_
+
+#include <vscc.h>
+
+/*
+ * linux perf's interfaces for jit code. symbols of 'data' are described at
+ * 'base', where the code was mapped; symbols below 'code_end' are code, 
+ * the rest is data
+ */
+#define PERFMAP_PATH "/tmp/perf-%d.map"
+#define JITDUMP_PATH "/tmp/jit-%d.dump"
+
+/* 
+ * where the data starts, the lowest symbol that is not a function of 'ctx'.
+ * taken while the ir is there, cached binaries store it
+ */
+size_t pyperfmap_code_end(const struct vscc_codegen_data *data, const struct vscc_context *ctx);
+
+/* one "start size name" line per symbol, enough for perf report */
+bool pyperfmap_write(const struct vscc_codegen_data *data, size_t code_end, const void *base);
+
+/*
+ * jitdump carries the code bytes as well, so perf inject --jit can build
+ * objects for perf annotate. the file stays mapped until it is closed,
+ * that mapping is how perf finds it
+ */
+struct pyperfmap_jitdump {
+    int fd;
+    void *marker;
+    size_t marker_length;
+    uint64_t index;
+};
+
+bool pyperfmap_jitdump_open(struct pyperfmap_jitdump *dump);
+bool pyperfmap_jitdump_load(struct pyperfmap_jitdump *dump, const struct vscc_codegen_data *data, size_t code_end, const void *base);
+void pyperfmap_jitdump_close(struct pyperfmap_jitdump *dump);
+
+#endif /* _PYPERFMAP_H_ */
\ No newline at end of file
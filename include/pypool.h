@@ -0,0 +1,17 @@
+#ifndef _PYPOOL_H_
+#define _PYPOOL_H_
+
+#include <stddef.h>
+
+typedef void(*pypool_job)(void *arg, size_t index);
+
+/*
+ * runs job(arg, i) for every i below 'count' on up to 'threads' workers (the 
+ * caller being one of them) and returns once all of them finished. a value 
+ * of 0 uses every online cpu
+ */
+void pypool_run(size_t threads, size_t count, pypool_job job, void *arg);
+
+size_t pypool_cpus(void);
+
+#endif /* _PYPOOL_H_ */
\ No newline at end of file
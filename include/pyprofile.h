@@ -0,0 +1,54 @@
+#ifndef _PYPROFILE_H_
+#define _PYPROFILE_H_
+
+#include <vscc.h>
+#include "pysym.h"
+
+/*
+ * instrumented builds keep one counter per site in a global named after a
+ * hash of the function and the site. site 0 counts entries, every if, elif
+ * and while adds two: evaluations of its condition and runs of its body
+ */
+#define PROFILE_PREFIX "__profile_"
+#define PROFILE_HEADER "# pyvscc profile 1"
+
+#define PROFILE_ENTRY 0
+#define PROFILE_REACHED(n) (1 + 2 * (n))
+#define PROFILE_TAKEN(n) (2 + 2 * (n))
+
+/* arms running less often than once in this many evaluations move out of line */
+#define PROFILE_COLD_RATIO 8
+
+/* functions entered at least 1/PROFILE_HOT_RATIO as often as the hottest one are hot */
+#define PROFILE_HOT_RATIO 16
+
+struct pyprofile_function {
+    uint64_t *counts;
+    size_t countc;
+};
+
+struct pyprofile {
+    struct pysym_table strings;
+    struct pysym_table functions;
+    uint64_t max_entry;
+    uint64_t hash;
+};
+
+uint64_t pyprofile_hash(const char *name);
+void pyprofile_counter_name(char *buffer, size_t size, const char *function, size_t site);
+
+/* reads the counters of an instrumented image mapped at 'base' */
+bool pyprofile_store(const char *path, const struct vscc_codegen_data *data, const struct vscc_context *ctx, const void *base);
+
+bool pyprofile_load(struct pyprofile *profile, const char *path);
+void pyprofile_free(struct pyprofile *profile);
+
+/* NULL for functions the profile has never seen */
+const struct pyprofile_function *pyprofile_function(const struct pyprofile *profile, const char *name);
+uint64_t pyprofile_count(const struct pyprofile_function *fn, size_t site);
+bool pyprofile_is_hot(const struct pyprofile *profile, const struct pyprofile_function *fn);
+
+/* hottest functions first, functions that never ran last, stable otherwise */
+void pyprofile_order_functions(struct vscc_context *ctx, const struct pyprofile *profile);
+
+#endif /* _PYPROFILE_H_ */
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef _PYREG_H_
+#define _PYREG_H_
+
+#include "pyasm.h"
+
+struct pyreg_stats {
+    size_t functions;
+    size_t skipped;
+
+    size_t promoted;
+    size_t spilled;
+    size_t callee_saved;
+};
+
+/*
+ * linear scan register allocation over the stack slots of generated code,
+ * edits are recorded in the image and take effect on pyasm_relink
+ */
+void pyreg_allocate(struct pyasm_image *image, struct pyreg_stats *stats);
+
+#endif /* _PYREG_H_ */
\ No newline at end of file
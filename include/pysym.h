@@ -0,0 +1,35 @@
+#ifndef _PYSYM_H_
+#define _PYSYM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct pysym_entry {
+    const char *key;
+    uint32_t hash;
+    void *value;
+};
+
+/*
+ * open addressing hash table, used both to intern identifiers (keyed by 
+ * contents) and to index symbols (keyed by interned pointer)
+ */
+struct pysym_table {
+    struct pysym_entry *entries;
+    size_t capacity;
+    size_t count;
+};
+
+const char *pysym_intern(struct pysym_table *strings, const char *str, size_t length);
+
+/* never inserts, safe on a table other threads only read */
+const char *pysym_lookup(const struct pysym_table *strings, const char *str, size_t length);
+
+void *pysym_get(const struct pysym_table *table, const char *key);
+void pysym_put(struct pysym_table *table, const char *key, void *value);
+
+void pysym_clear(struct pysym_table *table);
+void pysym_free(struct pysym_table *table, bool free_keys);
+
+#endif /* _PYSYM_H_ */
\ No newline at end of file
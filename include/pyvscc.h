@@ -0,0 +1,77 @@
+#ifndef _PYVSCC_H_
+#define _PYVSCC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * embedding interface, a module is compiled once and its functions may be
+ * called any number of times until the module is freed. diagnostics are 
+ * printed to stdout, exactly like the command line compiler does.
+ * 
+ * a module must not be called from several threads at once, every function
+ * of a module shares its print buffer and its heap. separate modules may 
+ * run side by side
+ */
+
+/* arguments are passed in registers only (rdi, rsi, rdx, rcx, r8, r9) */
+#define PYVSCC_MAX_ARGS 6
+
+/*
+ * 'threads' of 0 compiles on every cpu, 1 keeps everything on the caller.
+ * 'max_memory' bounds what alloc hands out over the life of the module
+ */
+struct pyvscc_options {
+    size_t default_size;
+    size_t max_memory;
+    size_t threads;
+    bool optimize;
+};
+
+enum pyvscc_type {
+    PYVSCC_TYPE_INT,
+    PYVSCC_TYPE_PTR
+};
+
+struct pyvscc_value {
+    enum pyvscc_type type;
+    union {
+        int64_t i;
+        void *p;
+    };
+};
+
+#define PYVSCC_INT(x) ((struct pyvscc_value){ .type = PYVSCC_TYPE_INT, .i = (int64_t)(x) })
+#define PYVSCC_PTR(x) ((struct pyvscc_value){ .type = PYVSCC_TYPE_PTR, .p = (void*)(x) })
+
+struct pyvscc_function {
+    const char *name;
+    void *address;
+
+    /* writes out print output buffered by the module, pyvscc_call does so after every call */
+    void *flush;
+
+    size_t paramc;
+    size_t param_sizes[PYVSCC_MAX_ARGS];
+    size_t return_size;
+};
+
+struct pyvscc_module;
+
+/* 'options' may be NULL, returns NULL if the source fails to compile */
+struct pyvscc_module *pyvscc_compile(const char *source, size_t length, const struct pyvscc_options *options);
+void pyvscc_free(struct pyvscc_module *module);
+
+/* exact name match, returns NULL for unknown or uncallable functions */
+const struct pyvscc_function *pyvscc_lookup(const struct pyvscc_module *module, const char *name);
+
+/*
+ * 'argc' has to match the parameter count, pointers are only accepted by 
+ * pointer sized parameters. returns false without calling on a mismatch.
+ * strings handed to print or strlen need their length as a uint64_t right
+ * in front of the first character, like compiled literals have
+ */
+bool pyvscc_call(const struct pyvscc_function *fn, const struct pyvscc_value *args, size_t argc, uint64_t *result);
+
+#endif /* _PYVSCC_H_ */
\ No newline at end of file
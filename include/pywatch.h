@@ -0,0 +1,32 @@
+#ifndef _PYWATCH_H_
+#define _PYWATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* how often the watched file is checked for changes */
+#define WATCH_POLL_MS 100
+
+struct pywatch_options {
+    const char *filepath;
+    char *entry;
+    size_t default_size;
+    size_t max_memory;
+    size_t threads;
+    bool line;
+    bool optimize;
+    bool perf;
+};
+
+/*
+ * compiles and runs the file, then again after every change, only 
+ * recompiling the defs whose text (or the signature of a callee) changed. 
+ * code of the others is reused and only linked again. -o is limited to 
+ * constant folding and dead store elimination: inlining, register 
+ * allocation and the peephole pass span the whole program and are skipped, 
+ * so the code differs from a regular -o build.
+ * returns only if the file can not be watched
+ */
+int pywatch_run(const struct pywatch_options *options);
+
+#endif /* _PYWATCH_H_ */
\ No newline at end of file
@@ -1,6 +1,18 @@
 #ifndef _MUTIL_H_
 #define _MUTIL_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+
+struct mapped_file {
+    const char *data;
+    size_t length;
+    size_t mapped_length;
+};
+
+bool file_map(const char *file_path, struct mapped_file *file);
+void file_unmap(struct mapped_file *file);
+
 char *file_to_str(const char *file_path);
 
 #endif /* _MUTIL_H_ */
\ No newline at end of file
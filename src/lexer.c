@@ -1,180 +1,529 @@
 #include "lexer.h"
+#include "pypool.h"
+#include "pyperf.h"
 #include <stdio.h>
 #include <vscc.h>
 
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
-static struct lexer_token *add_token(struct lexer_token **root, struct lexer_token **last, enum lexer_token_type type, char *contents)
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+struct lexer_scanner {
+    enum lexer_simd simd;
+
+    const char *(*identifier)(const char *c, const char *end);
+    const char *(*literal)(const char *c, const char *end);
+    const char *(*string)(const char *c, const char *end);
+};
+
+/* 
+ * class of every byte, anything not listed is part of an operator
+ */
+static const unsigned char char_class[256] = {
+    ['a' ... 'z'] = TOKEN_IDENTIFIER,
+    ['A' ... 'Z'] = TOKEN_IDENTIFIER,
+    ['_'] = TOKEN_IDENTIFIER,
+    ['0' ... '9'] = TOKEN_LITERAL,
+
+    ['{'] = TOKEN_OPEN_BRACE,
+    ['}'] = TOKEN_CLOSE_BRACE,
+    ['('] = TOKEN_OPEN_PAREN,
+    [')'] = TOKEN_CLOSE_PAREN,
+    [';'] = TOKEN_SEMICOLON,
+    [':'] = TOKEN_COLON,
+    ['#'] = TOKEN_COMMENT,
+    ['\"'] = TOKEN_QUOTE,
+    ['\''] = TOKEN_QUOTE,
+    [','] = TOKEN_COMMA,
+
+    [' '] = TOKEN_WHITESPACE,
+    ['\r'] = TOKEN_WHITESPACE,
+    ['\n'] = TOKEN_NEWLINE,
+    ['\t'] = TOKEN_TAB,
+};
+
+#define CLASS(c) ((enum lexer_token_type)char_class[(unsigned char)(c)])
+#define IS_IDENTIFIER(c) (CLASS(c) == TOKEN_IDENTIFIER || CLASS(c) == TOKEN_LITERAL)
+
+/*
+ * perfect hashes, every keyword and operator lands in its own slot so a 
+ * lookup is one hash and one compare
+ */
+#define KEYWORD_HASH(s, len) (((unsigned char)(s)[0] + (unsigned char)(s)[(len) - 1] * 6 + (len)) & 15)
+#define OPERATOR_HASH(s, len) (((unsigned char)(s)[0] + ((len) > 1 ? (unsigned char)(s)[1] * 3 : 0)) & 31)
+
+static const struct {
+    char cmp[8];
+    enum lexer_token_type new_type;
+} keyword_table[16] = {
+    [11] = { .cmp = "def",     .new_type = TOKEN_DEF },
+    [15] = { .cmp = "if",      .new_type = TOKEN_IF },
+    [13] = { .cmp = "elif",    .new_type = TOKEN_ELIF },
+    [7]  = { .cmp = "else",    .new_type = TOKEN_ELSE },
+    [10] = { .cmp = "while",   .new_type = TOKEN_WHILE },
+    [5]  = { .cmp = "for",     .new_type = TOKEN_FOR },
+    [12] = { .cmp = "return",  .new_type = TOKEN_RETURN },
+    [4]  = { .cmp = "int",     .new_type = TOKEN_TYPE_INT },
+};
+
+static const struct {
+    char operator[4];
+    enum lexer_token_type new_type;
+} operator_table[32] = {
+    [29] = { .operator = "=",     .new_type = TOKEN_EQUAL },
+    [2]  = { .operator = "+=",    .new_type = TOKEN_ADDEQ },
+    [4]  = { .operator = "-=",    .new_type = TOKEN_SUBEQ },
+    [1]  = { .operator = "*=",    .new_type = TOKEN_MULEQ },
+    [6]  = { .operator = "/=",    .new_type = TOKEN_DIVEQ },
+    [7]  = { .operator = "->",    .new_type = TOKEN_RARROW },
+
+    [20] = { .operator = "==",    .new_type = TOKEN_EQUALS },
+    [24] = { .operator = "!=",    .new_type = TOKEN_NEQUALS },
+    [28] = { .operator = "<",     .new_type = TOKEN_LESSTHAN },
+    [30] = { .operator = ">",     .new_type = TOKEN_GREATERTHAN },
+};
+
+static struct lexer_token *add_token(struct lexer_stream *stream, enum lexer_token_type type, size_t offset, size_t length)
 {
-    if (unlikely(*last == NULL)) {
-        *root = calloc(1, sizeof(struct lexer_token));
-        *last = *root;
-    }
-    else {
-        (*last)->next = calloc(1, sizeof(struct lexer_token));
-        (*last) = (*last)->next;
+    if (unlikely(stream->count == stream->capacity)) {
+        stream->capacity *= 2;
+        stream->tokens = pyperf_realloc(stream->tokens, stream->capacity * sizeof(struct lexer_token));
     }
 
-    (*last)->type = type;
-    strcpy((*last)->contents, contents);
-
-    return *last;
-}
-
-static enum lexer_token_type get_token_type_c(char c)
-{
-    /* small table for "special characters" */
-    static const struct {
-        char c;
-        enum lexer_token_type type;
-    } lookup_table[] = {
-        { .c = '{', .type = TOKEN_OPEN_BRACE },
-        { .c = '}', .type = TOKEN_CLOSE_BRACE },
-        { .c = '(', .type = TOKEN_OPEN_PAREN },
-        { .c = ')', .type = TOKEN_CLOSE_PAREN },
-        { .c = ';', .type = TOKEN_SEMICOLON },
-        { .c = ':', .type = TOKEN_COLON },
-        { .c = '#', .type = TOKEN_COMMENT },
-        { .c = '\"', .type = TOKEN_QUOTE },
-        { .c = '\'', .type = TOKEN_QUOTE },
-        { .c = ',', .type = TOKEN_COMMA },
-
-        { .c = ' ', .type = TOKEN_WHITESPACE },
-        { .c = '\n', .type = TOKEN_NEWLINE },
-        { .c = '\t', .type = TOKEN_TAB },
-    };
-
-    /* check if regular character */
-    if (isalpha(c) || c == '_')
+    struct lexer_token *token = &stream->tokens[stream->count++];
+    token->type = type;
+    token->offset = offset;
+    token->length = length;
+
+    return token;
+}
+
+static enum lexer_token_type keyword_type(const char *s, size_t length)
+{
+    /* shortest keyword is "if", longest is "return" */
+    if (length < 2 || length > 6)
         return TOKEN_IDENTIFIER;
-    if (isdigit(c))
-        return TOKEN_LITERAL;
 
-    /* check if "special character" */
-    for (int i = 0; i < sizeof(lookup_table) / sizeof(*lookup_table); i++) {
-        if (c == lookup_table[i].c)
-            return lookup_table[i].type;
-    }
+    int i = KEYWORD_HASH(s, length);
+    if (keyword_table[i].cmp[length] == 0 && memcmp(keyword_table[i].cmp, s, length) == 0)
+        return keyword_table[i].new_type;
+    return TOKEN_IDENTIFIER;
+}
+
+static enum lexer_token_type operator_type(const char *s, size_t length)
+{
+    if (length > 2)
+        return TOKEN_NONE;
 
-    /* else */
+    int i = OPERATOR_HASH(s, length);
+    if (operator_table[i].operator[length] == 0 && memcmp(operator_table[i].operator, s, length) == 0)
+        return operator_table[i].new_type;
     return TOKEN_NONE;
-} 
-
-struct lexer_token *str_to_tokens(const char *buffer)
-{
-    struct lexer_token *root = NULL;
-    struct lexer_token *last = NULL;
-
-    static const struct {
-        char cmp[16];
-        enum lexer_token_type new_type;
-    } identifier_to_new_type[] = {
-        { .cmp = "int",     .new_type = TOKEN_TYPE_INT },
-        { .cmp = "return",  .new_type = TOKEN_RETURN },
-        { .cmp = "if",      .new_type = TOKEN_IF },
-        { .cmp = "while",   .new_type = TOKEN_WHILE },
-        { .cmp = "for",     .new_type = TOKEN_FOR },
-        { .cmp = "def",     .new_type = TOKEN_DEF },
-    };
-
-    static const struct {
-        char operator[4];
-        enum lexer_token_type new_type;
-    } operator_to_type[] = {
-        { .operator = "=",     .new_type = TOKEN_EQUAL },
-        { .operator = "+=",    .new_type = TOKEN_ADDEQ },
-        { .operator = "-=",    .new_type = TOKEN_SUBEQ },
-        { .operator = "*=",    .new_type = TOKEN_MULEQ },
-        { .operator = "/=",    .new_type = TOKEN_DIVEQ },
-        { .operator = "->",    .new_type = TOKEN_RARROW },
-
-        { .operator = "==",    .new_type = TOKEN_EQUALS },
-        { .operator = "!=",    .new_type = TOKEN_NEQUALS },
-        { .operator = "<",     .new_type = TOKEN_LESSTHAN },
-        { .operator = ">",     .new_type = TOKEN_GREATERTHAN },
-    };
-
-    enum lexer_token_type current_token_type = get_token_type_c(*buffer);
-    add_token(&root, &last, current_token_type, "");
-    int i = 0;
-
-    bool in_string = false;
-
-    for (char c = *buffer; c; c = *++buffer) {
-        enum lexer_token_type current_type = get_token_type_c(*buffer);
-
-        /* begin new token */
-        if (current_token_type != current_type || current_token_type == TOKEN_TAB) {
-            /* initial string check */
-            if (in_string && current_type != TOKEN_QUOTE) {
-                if (c == '\\') {
-                    switch (*(buffer + 1)) {
-                    case 'n':
-                        last->contents[i++] = '\n';
-                        break;
-                    default:
-                        last->contents[i++] = c;
-                        continue;
-                    }
-
-                    buffer++;
-                    continue;
-                }
-
-                last->contents[i++] = c;
-                continue;
-            }
+}
 
-            /* check if identifier can be converted into more accurate type */
-            if (current_token_type == TOKEN_IDENTIFIER) {
-                for (int i = 0; i < sizeof(identifier_to_new_type) / sizeof(*identifier_to_new_type); i++) {
-                    if (strcmp(last->contents, identifier_to_new_type[i].cmp) == 0) {
-                        last->type = identifier_to_new_type[i].new_type;
-                        break;
-                    }
-                }
-            }
+/*
+ * scalar scanners, each returns the first byte which does not continue the run
+ */
+static const char *scan_identifier_scalar(const char *c, const char *end)
+{
+    while (c < end && IS_IDENTIFIER(*c))
+        c++;
+    return c;
+}
 
-            /* check if string started */
-            if (current_type == TOKEN_QUOTE) {
-                if (!in_string) {
-                    current_type = TOKEN_IDENTIFIER;
-                    in_string = true;
-                }
-                else {
-                    last->type = TOKEN_STRING;
-                    in_string = false;
-                    last->contents[i++] = c;
-                    continue;
-                }
-            }
+static const char *scan_literal_scalar(const char *c, const char *end)
+{
+    while (c < end && CLASS(*c) == TOKEN_LITERAL)
+        c++;
+    return c;
+}
 
-            /* check if token is none to fix */
-            if (current_token_type == TOKEN_NONE) {
-                for (int i = 0; i < sizeof(operator_to_type) / sizeof(*operator_to_type); i++) {
-                    if (strcmp(last->contents, operator_to_type[i].operator) == 0) {
-                        last->type = operator_to_type[i].new_type;
-                        break;
-                    }
-                }
-            }
-            
-            add_token(&root, &last, current_type, "");
-            current_token_type = current_type;
-            last->contents[0] = c;
-            i = 1;
+static const char *scan_string_scalar(const char *c, const char *end)
+{
+    /* strings run until the next quote of either kind */
+    while (c < end && CLASS(*c) != TOKEN_QUOTE)
+        c++;
+    return c;
+}
+
+static const struct lexer_scanner scanner_scalar = {
+    .simd = LEXER_SIMD_NONE,
+    .identifier = scan_identifier_scalar,
+    .literal = scan_literal_scalar,
+    .string = scan_string_scalar
+};
+
+#ifdef __SSE2__
+/*
+ * sse2 scanners, 16 bytes per step; bytes past 'end' are never read, the
+ * scalar scanners finish the tail
+ */
+#define RANGE_SSE2(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8((hi) + 1)))
+
+static inline unsigned int identifier_mask_sse2(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i res = _mm_or_si128(RANGE_SSE2(lower, 'a', 'z'), RANGE_SSE2(v, '0', '9'));
+    res = _mm_or_si128(res, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return _mm_movemask_epi8(res);
+}
+
+static const char *scan_identifier_sse2(const char *c, const char *end)
+{
+    for (; c + 16 <= end; c += 16) {
+        unsigned int stop = ~identifier_mask_sse2(_mm_loadu_si128((const __m128i*)c)) & 0xffff;
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_identifier_scalar(c, end);
+}
+
+static const char *scan_literal_sse2(const char *c, const char *end)
+{
+    for (; c + 16 <= end; c += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)c);
+        unsigned int stop = ~_mm_movemask_epi8(RANGE_SSE2(v, '0', '9')) & 0xffff;
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_literal_scalar(c, end);
+}
+
+static const char *scan_string_sse2(const char *c, const char *end)
+{
+    for (; c + 16 <= end; c += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)c);
+        __m128i quotes = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));
+        unsigned int stop = _mm_movemask_epi8(quotes);
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_string_scalar(c, end);
+}
+
+static const struct lexer_scanner scanner_sse2 = {
+    .simd = LEXER_SIMD_SSE2,
+    .identifier = scan_identifier_sse2,
+    .literal = scan_literal_sse2,
+    .string = scan_string_sse2
+};
+
+/*
+ * avx2 scanners, 32 bytes per step
+ */
+#define RANGE_AVX2(v, lo, hi) _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((lo) - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), v))
+
+__attribute__((target("avx2")))
+static const char *scan_identifier_avx2(const char *c, const char *end)
+{
+    for (; c + 32 <= end; c += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)c);
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i res = _mm256_or_si256(RANGE_AVX2(lower, 'a', 'z'), RANGE_AVX2(v, '0', '9'));
+        res = _mm256_or_si256(res, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(res);
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_identifier_sse2(c, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_literal_avx2(const char *c, const char *end)
+{
+    for (; c + 32 <= end; c += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)c);
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(RANGE_AVX2(v, '0', '9'));
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_literal_sse2(c, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_string_avx2(const char *c, const char *end)
+{
+    for (; c + 32 <= end; c += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)c);
+        __m256i quotes = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));
+        unsigned int stop = _mm256_movemask_epi8(quotes);
+        if (stop)
+            return c + __builtin_ctz(stop);
+    }
+    return scan_string_sse2(c, end);
+}
+
+static const struct lexer_scanner scanner_avx2 = {
+    .simd = LEXER_SIMD_AVX2,
+    .identifier = scan_identifier_avx2,
+    .literal = scan_literal_avx2,
+    .string = scan_string_avx2
+};
+#endif
+
+static const struct lexer_scanner *scanner = NULL;
+
+enum lexer_simd lexer_set_simd(enum lexer_simd simd)
+{
+    scanner = &scanner_scalar;
+
+#ifdef __SSE2__
+    if (simd == LEXER_SIMD_AUTO)
+        simd = __builtin_cpu_supports("avx2") ? LEXER_SIMD_AVX2 : LEXER_SIMD_SSE2;
+
+    switch (simd) {
+    case LEXER_SIMD_AVX2:
+        if (__builtin_cpu_supports("avx2")) {
+            scanner = &scanner_avx2;
+            break;
+        }
+        /* fall through */
+    case LEXER_SIMD_SSE2:
+        scanner = &scanner_sse2;
+        break;
+    default:
+        break;
+    }
+#endif
+
+    return scanner->simd;
+}
+
+bool str_to_tokens(struct lexer_stream *stream, const char *buffer, size_t length)
+{
+    /* offsets are stored as 32-bit values */
+    if (length > UINT32_MAX)
+        return false;
+
+    if (unlikely(scanner == NULL))
+        lexer_set_simd(LEXER_SIMD_AUTO);
+
+    /* 
+     * roughly one token per two bytes of source, so large inputs 
+     * rarely need to grow the stream 
+     */
+    stream->source = buffer;
+    stream->count = 0;
+    stream->capacity = length / 2 + 16;
+    stream->tokens = pyperf_malloc(stream->capacity * sizeof(struct lexer_token));
+
+    const char *c = buffer;
+    const char *end = buffer + length;
+
+    while (c < end) {
+        const char *start = c;
+        enum lexer_token_type type = CLASS(*c);
+
+        switch (type) {
+        case TOKEN_WHITESPACE:
+            while (c < end && CLASS(*c) == TOKEN_WHITESPACE)
+                c++;
             continue;
-        } 
+        case TOKEN_QUOTE:
+            c = scanner->string(c + 1, end);
+            c += c < end;
+            type = TOKEN_STRING;
+            break;
+        case TOKEN_COMMENT:
+            c = memchr(c, '\n', end - c);
+            c = c ? c : end;
+            break;
+        case TOKEN_IDENTIFIER:
+            c = scanner->identifier(c + 1, end);
+            if (unlikely(c - start > LEXER_MAX_IDENTIFIER)) {
+                printf("err: identifier '%.*s...' is longer than %d characters\n", LEXER_MAX_IDENTIFIER, start, LEXER_MAX_IDENTIFIER);
+                lexer_free(stream);
+                return false;
+            }
+            type = keyword_type(start, c - start);
+            break;
+        case TOKEN_LITERAL:
+            c = scanner->literal(c + 1, end);
+            break;
+        case TOKEN_NONE:
+            while (c < end && CLASS(*c) == TOKEN_NONE)
+                c++;
+            type = operator_type(start, c - start);
+            break;
+        default:
+            c++;
+            break;
+        }
+
+        add_token(stream, type, start - buffer, c - start);
+    }
+
+    add_token(stream, TOKEN_EOF, length, 0);
+    return true;
+}
+
+/*
+ * a piece of the source starting at a top level def (or the beginning of 
+ * the file), 'first' is where its tokens land in the joined stream
+ */
+struct lexer_chunk {
+    const char *source;
+    size_t length;
+
+    struct lexer_stream stream;
+    size_t first;
+    bool lexed;
+};
+
+struct lexer_split {
+    struct lexer_chunk *chunks;
+    size_t count;
+    struct lexer_stream *result;
+};
+
+static void lex_chunk(void *arg, size_t index)
+{
+    struct lexer_split *split = arg;
+    struct lexer_chunk *chunk = &split->chunks[index];
+    chunk->lexed = str_to_tokens(&chunk->stream, chunk->source, chunk->length);
+}
+
+static void join_chunk(void *arg, size_t index)
+{
+    struct lexer_split *split = arg;
+    struct lexer_chunk *chunk = &split->chunks[index];
+    struct lexer_token *dst = split->result->tokens + chunk->first;
+    uint32_t base = chunk->source - split->result->source;
+
+    /* every chunk but the last drops its eof token */
+    size_t count = chunk->stream.count - (index + 1 < split->count);
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = chunk->stream.tokens[i];
+        dst[i].offset += base;
+    }
+    lexer_free(&chunk->stream);
+}
+
+/*
+ * next line starting with 'def' at or after 'from', or 'end'. the scan begins 
+ * at 'start', which is outside of any string, and steps over strings and 
+ * comments the way str_to_tokens does, a def line inside a string spanning 
+ * several lines is not a place to split
+ */
+static const char *next_def(const char *start, const char *from, const char *end)
+{
+    for (const char *c = start; c < end; c++) {
+        switch (CLASS(*c)) {
+        case TOKEN_QUOTE:
+            c = scanner->string(c + 1, end);
+            if (c == end)
+                return end;
+            break;
+        case TOKEN_COMMENT:
+            /* the newline ending it is looked at on the next step */
+            c = memchr(c, '\n', end - c);
+            if (c == NULL)
+                return end;
+            c--;
+            break;
+        case TOKEN_NEWLINE:
+            if (c >= from && end - c > 4 && c[1] == 'd' && c[2] == 'e' && c[3] == 'f' && (c[4] == ' ' || c[4] == '\t'))
+                return c + 1;
+            break;
+        default:
+            break;
+        }
+    }
+    return end;
+}
+
+bool str_to_tokens_parallel(struct lexer_stream *stream, const char *buffer, size_t length, size_t threads)
+{
+    if (threads == 0)
+        threads = pypool_cpus();
+    if (threads == 1 || length < 2 * LEXER_MIN_CHUNK || length > UINT32_MAX)
+        return str_to_tokens(stream, buffer, length);
+
+    /* pick the scanner before the workers race to do it */
+    if (unlikely(scanner == NULL))
+        lexer_set_simd(LEXER_SIMD_AUTO);
+
+    /* a few chunks per thread leave room for stealing when sizes are uneven */
+    size_t target = length / (threads * 4);
+    target = target < LEXER_MIN_CHUNK ? LEXER_MIN_CHUNK : target;
+
+    struct lexer_split split = { .chunks = NULL, .count = 0, .result = stream };
+    size_t capacity = 0;
+    const char *end = buffer + length;
+
+    for (const char *c = buffer; c < end;) {
+        const char *stop = end - c > target ? next_def(c, c + target, end) : end;
+        if (split.count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            split.chunks = pyperf_realloc(split.chunks, capacity * sizeof(struct lexer_chunk));
+        }
+        split.chunks[split.count++] = (struct lexer_chunk){ .source = c, .length = stop - c };
+        c = stop;
+    }
+
+    pypool_run(threads, split.count, lex_chunk, &split);
+
+    bool lexed = true;
+    size_t total = 0;
+    stream->source = buffer;
+    for (size_t i = 0; i < split.count; i++) {
+        lexed = lexed && split.chunks[i].lexed;
+        split.chunks[i].first = total;
+        total += split.chunks[i].stream.count - (i + 1 < split.count);
+    }
+
+    if (!lexed) {
+        for (size_t i = 0; i < split.count; i++)
+            lexer_free(&split.chunks[i].stream);
+        free(split.chunks);
+        return false;
+    }
+
+    stream->count = total;
+    stream->capacity = total;
+    stream->tokens = pyperf_malloc(total * sizeof(struct lexer_token));
+    pypool_run(threads, split.count, join_chunk, &split);
+
+    free(split.chunks);
+    return true;
+}
+
+void lexer_free(struct lexer_stream *stream)
+{
+    free(stream->tokens);
+    stream->tokens = NULL;
+    stream->count = 0;
+    stream->capacity = 0;
+}
+
+char *lexer_token_text(const struct lexer_stream *stream, const struct lexer_token *token, char *buffer, size_t size)
+{
+    size_t length = token->length < size ? token->length : size - 1;
+    memcpy(buffer, stream->source + token->offset, length);
+    buffer[length] = 0;
+    return buffer;
+}
 
-        /* otherwise continue onto current token */
-        else {
-            assert(i < 64);
-            last->contents[i++] = c;
+size_t lexer_unescape(const struct lexer_stream *stream, const struct lexer_token *token, char *buffer)
+{
+    /* strip the surrounding quotes */
+    const char *src = stream->source + token->offset + 1;
+    const char *end = stream->source + token->offset + token->length - 1;
+    size_t length = 0;
+
+    while (src < end) {
+        if (src[0] == '\\' && src + 1 < end && src[1] == 'n') {
+            buffer[length++] = '\n';
+            src += 2;
+            continue;
         }
-    }    
+        buffer[length++] = *src++;
+    }
 
-    return root;
+    return length;
 }
\ No newline at end of file
@@ -6,6 +6,14 @@
 #include "lexer.h"
 #include "pyimpl.h"
 #include "pybuild.h"
+#include "pyopt.h"
+#include "pyinline.h"
+#include "pycache.h"
+#include "pyelf.h"
+#include "pywatch.h"
+#include "pyperf.h"
+#include "pyperfmap.h"
+#include "pyprofile.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -21,7 +29,7 @@
 typedef uint64_t(*entry_point_fnptr)();
 
 static const char *usage = 
-    "usage: pyvscc [-h] [-i FILE_PATH] [-e ENTRY_POINT] [-m SIZE] [-s SIZE] [-o] [-p] [-u]\n"
+    "usage: pyvscc [-h] [-i FILE_PATH] [-e ENTRY_POINT] [-m SIZE] [-s SIZE] [-c CACHE_DIR] [-a OUTPUT] [-j THREADS] [-w] [-l] [-g MODE] [-t PROFILE] [-u PROFILE] [-o] [-p] [-r REPORT]\n"
     "\n"
     "options:\n"
     "  -h                   display help information\n"
@@ -29,16 +37,34 @@ static const char *usage =
     "  -e [ENTRY_POINT]     specify entry function (if not specified, searches for any function containing 'main')\n"
     "  -m [SIZE]            max amount of bytes program may allocate (default: 4096 bytes)\n"
     "  -s [SIZE]            amount of bytes variables/functions with an unspecified type take up (default: 8 bytes)\n"
+    "  -c [CACHE_DIR]       reuse compiled binaries stored in CACHE_DIR (disabled by default)\n"
+    "  -a [OUTPUT]          write a standalone executable to OUTPUT instead of running\n"
+    "  -j [THREADS]         lex, parse and generate code on THREADS threads, 0 for every cpu (default: 1)\n"
+    "  -w                   watch the input file, recompile changed functions and run again after every change (-o only runs the per function passes)\n"
+    "  -l                   flush print output at every newline when stdout is a terminal (default: when the buffer fills and when the entry returns)\n"
+    "  -g [MODE]            describe the mapped code to linux perf, 'map' writes /tmp/perf-PID.map, 'jitdump' also writes /tmp/jit-PID.dump for perf annotate\n"
+    "  -t [PROFILE]         count function entries and branches, write the counts to PROFILE when the entry returns\n"
+    "  -u [PROFILE]         with -o, lay out branches and functions and steer inlining by the counts in PROFILE\n"
     "  -o                   enable optimizations\n"
-    "  -p                   print performance information\n";
+    "  -p                   print performance information\n"
+    "  -r [REPORT]          write time, pyvscc's own allocations (not vscc's) and peak memory of every phase plus token, instruction and byte counts as json to REPORT ('-' for stdout)\n";
 
 struct args {
     char *filepath;
     char *entry;
     size_t default_size;
     size_t max_mem;
+    char *cache_dir;
+    char *output;
+    size_t threads;
+    bool watch;
+    bool line;
+    char *perfmap;
+    char *instrument;
+    char *guide;
     bool optimize;
     bool perf;
+    char *report;
 };
 
 static void *map(struct vscc_codegen_data *compiled)
@@ -48,18 +74,110 @@ static void *map(struct vscc_codegen_data *compiled)
     return exe;
 }
 
-static int64_t time_ms(void) 
+static int64_t time_us(void) 
 {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (int64_t)ts.tv_sec * 1000 + (int64_t)ts.tv_nsec / 1000000;
+    return (int64_t)ts.tv_sec * 1000000 + (int64_t)ts.tv_nsec / 1000;
 }
 
-static int64_t time_us(void) 
+static void finish_report(struct args *args, struct pybuild_context *ctx)
 {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (int64_t)ts.tv_sec * 1000000 + (int64_t)ts.tv_nsec / 1000;
+    if (!ctx->perf)
+        return;
+
+    if (args->perf)
+        pyperf_print(ctx->perf);
+    if (args->report && !pyperf_write_json(ctx->perf, args->report, args->filepath, args->optimize, args->threads))
+        printf("wrn: could not write report '%s'\n", args->report);
+    pyperf_free(ctx->perf);
+}
+
+/*
+ * lex, parse, optimize and generate code, returns the entry offset or -1
+ */
+static uintptr_t compile(struct args *args, struct mapped_file *file, struct lexer_stream *tokens, struct pybuild_context *ctx)
+{
+    /*
+     * lex input
+     */
+    pyperf_begin(ctx->perf, "lex");
+    bool lexed = str_to_tokens_parallel(tokens, file->data, file->length, args->threads);
+    pyperf_end(ctx->perf);
+    if (!lexed) {
+        printf("err: failed to lex file '%s'\n", args->filepath);
+        return -1;
+    }
+
+    /*
+     * append python functions & environmental variables
+     */
+    pyperf_begin(ctx->perf, "runtime");
+    pyimpl_append_to_context(&ctx->vscc_ctx);
+    pyperf_end(ctx->perf);
+
+    /*
+     * parse file and construct intermediate representation
+     */
+    pyperf_begin(ctx->perf, "parse");
+    bool status = parse(ctx, tokens);
+    pyperf_end(ctx->perf);
+    if (!status) {
+        printf("err: failed to compile\n");
+        return -1;
+    }
+
+    /*
+     * perform optimizations
+     */
+    size_t inlined = 0;
+    size_t folded = 0;
+    if (args->optimize) {
+        pyperf_begin(ctx->perf, "optimize");
+        if (ctx->profile)
+            pyprofile_order_functions(&ctx->vscc_ctx, ctx->profile);
+        inlined = pyinline_functions(&ctx->vscc_ctx, ctx->profile);
+        for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn; fn = fn->next) {
+            folded += pyopt_fold_constants(fn);
+            vscc_optfn_elim_dead_store(fn);
+        }
+        pyperf_end(ctx->perf);
+    }
+
+    /*
+     * perf numbers
+     */
+    if (args->perf && args->optimize) {
+        printf("pyvscc: inlined %zu call sites\n", inlined);
+        printf("pyvscc: constant folding removed %zu instructions\n", folded);
+        if (ctx->profile)
+            printf("pyvscc: profile moved %zu arms out of line and rotated %zu loops\n", ctx->cold_arms, ctx->rotated_loops);
+    }
+
+    /*
+     * compile code and obtain entry point offset, build adds its own phases
+     */
+    uintptr_t entry_offset = build(ctx);
+    if (entry_offset == -1) {
+        if (!ctx->natives_missing)
+            printf("err: entry point not found\n");
+        return -1;
+    }
+
+    /*
+     * perf numbers
+     */
+    if (args->perf && args->optimize) {
+        printf("pyvscc: register allocation promoted %zu slots, spilled %zu, saved %zu callee saved registers (%zu of %zu functions skipped)\n", 
+            ctx->regalloc.promoted, ctx->regalloc.spilled, ctx->regalloc.callee_saved, ctx->regalloc.skipped, ctx->regalloc.functions);
+        for (int i = 0; i < PEEP_PATTERN_COUNT; i++)
+            printf("pyvscc: peephole '%s' applied %zu times, %zu bytes saved\n", pypeep_pattern_name(i), ctx->peephole.hits[i], ctx->peephole.bytes[i]);
+        printf("pyvscc: code size changed by %ld bytes\n", -ctx->bytes_saved);
+    }
+    if (args->perf)
+        printf("pyvscc: %zu runtime routines run as machine code\n", ctx->natives);
+
+    return entry_offset;
 }
 
 int main(int argc, char **argv)
@@ -74,8 +192,17 @@ int main(int argc, char **argv)
         .entry = "main",
         .default_size = sizeof(uint64_t),
         .max_mem = 4096,
+        .cache_dir = NULL,
+        .output = NULL,
+        .threads = 1,
+        .watch = false,
+        .line = false,
+        .perfmap = NULL,
+        .instrument = NULL,
+        .guide = NULL,
         .optimize = false,
-        .perf = false
+        .perf = false,
+        .report = NULL
     };
 
     for (int i = 1; i < argc; i++) {
@@ -100,12 +227,50 @@ int main(int argc, char **argv)
                 program_args.default_size = atoi(argv[i + 1]);
                 i++;
                 break;
+            case 'c':
+                program_args.cache_dir = argv[i + 1];
+                i++;
+                break;
+            case 'a':
+                program_args.output = argv[i + 1];
+                i++;
+                break;
+            case 'j':
+                program_args.threads = atoi(argv[i + 1]);
+                i++;
+                break;
+            case 'w':
+                program_args.watch = true;
+                break;
+            case 'l':
+                program_args.line = true;
+                break;
+            case 'g':
+                program_args.perfmap = argv[i + 1];
+                i++;
+                if (!program_args.perfmap || (strcmp(program_args.perfmap, "map") != 0 && strcmp(program_args.perfmap, "jitdump") != 0)) {
+                    printf("wrn: unknown -g mode '%s', expected 'map' or 'jitdump'\n", program_args.perfmap ? program_args.perfmap : "");
+                    program_args.perfmap = NULL;
+                }
+                break;
+            case 't':
+                program_args.instrument = argv[i + 1];
+                i++;
+                break;
+            case 'u':
+                program_args.guide = argv[i + 1];
+                i++;
+                break;
             case 'o':
                 program_args.optimize = true;
                 break;
             case 'p':
                 program_args.perf = true;
                 break;
+            case 'r':
+                program_args.report = argv[i + 1];
+                i++;
+                break;
             default:
                 printf("wrn: unknown argument '%s'\n", argv[i]);
             }
@@ -114,22 +279,80 @@ int main(int argc, char **argv)
         }
     }
 
+    /*
+     * stays resident, every change to the file is compiled and run
+     */
+    if (program_args.watch) {
+        const char *unsupported = program_args.cache_dir ? "-c" : program_args.output ? "-a" : program_args.perfmap ? "-g" : 
+            program_args.instrument ? "-t" : program_args.guide ? "-u" : program_args.report ? "-r" : NULL;
+        if (unsupported) {
+            printf("err: %s can not be combined with -w\n", unsupported);
+            return 1;
+        }
+
+        struct pywatch_options watch = {
+            .filepath = program_args.filepath,
+            .entry = program_args.entry,
+            .default_size = program_args.default_size,
+            .max_memory = program_args.max_mem,
+            .threads = program_args.threads,
+            .line = program_args.line,
+            .optimize = program_args.optimize,
+            .perf = program_args.perf
+        };
+        return pywatch_run(&watch);
+    }
+
+    /*
+     * every phase from here on is timed when a report was asked for
+     */
+    struct pyperf perf = { 0 };
+    struct pyperf *report = program_args.perf || program_args.report ? &perf : NULL;
+
     /*
      * get file
      */
-    char *buffer = file_to_str(program_args.filepath);
-    if (buffer == NULL) {
+    struct mapped_file file;
+    pyperf_begin(report, "read");
+    bool mapped_file = file_map(program_args.filepath, &file);
+    pyperf_end(report);
+    if (!mapped_file) {
         printf("err: could not open file '%s'\n", program_args.filepath);
         return 0;
     }
-    
+
+    /*
+     * perf helper
+     */
+    int64_t start_time = 0;
+    int64_t end_time = 0;
+
     /*
-     * basic setup and lex input
+     * counts can only be written back by a run in this process, and only 
+     * guide optimized builds
      */
-    struct lexer_token *tokens = str_to_tokens(buffer);
+    struct pyprofile profile = { 0 };
+    bool guided = false;
+
+    if (program_args.instrument && program_args.output) {
+        printf("wrn: executables can not write a profile, ignoring -t\n");
+        program_args.instrument = NULL;
+    }
+    if (program_args.guide && program_args.instrument)
+        printf("wrn: instrumented builds do not read a profile, ignoring -u\n");
+    else if (program_args.guide && !program_args.optimize)
+        printf("wrn: -u needs -o, ignoring it\n");
+    else if (program_args.guide && !(guided = pyprofile_load(&profile, program_args.guide)))
+        printf("wrn: could not read profile '%s'\n", program_args.guide);
+
+    /*
+     * basic setup
+     */
+    struct lexer_stream tokens = { 0 };
     struct pybuild_context ctx = {  
         .vscc_ctx = { 0 },
         .compiled_data = { 0 },
+        .tokens = &tokens,
         .entry_name = program_args.entry,
 
         .current_label = 0,
@@ -139,84 +362,183 @@ int main(int argc, char **argv)
         .return_reg = NULL,
         .default_size = program_args.default_size,
 
+        .autogen = 0,
+        .autogen_name = { 0 },
+
         .memcpy_queue = NULL,
-        .branch_queue = NULL
+        .branch_queue = NULL,
+        .chain = NULL,
+
+        .strings = { 0 },
+        .locals = { 0 },
+        .globals = { 0 },
+        .functions = { 0 },
+        .builtins = { 0 },
+        .symbols = { 0 },
+        .string_values = { 0 },
+        .arguments = NULL,
+        .deferred = NULL,
+        .inferred = 0,
+
+        .instrument = program_args.instrument != NULL,
+        .profile = guided ? &profile : NULL,
+        .profile_function = NULL,
+        .profile_site = 0,
+        .cold = NULL,
+        .cold_arms = 0,
+        .rotated_loops = 0,
+
+        .parent = NULL,
+
+        .threads = program_args.threads,
+        .optimize = program_args.optimize,
+        .regalloc = { 0 },
+        .peephole = { { 0 } },
+        .bytes_saved = 0,
+        .natives = 0,
+        .requires_natives = false,
+        .natives_missing = false,
+        .perf = report
     };
 
     /*
-     * perf helper
+     * a cached binary skips everything up to execution, executables are 
+     * always built from source since the image has to be relinked
      */
-    int64_t start_time = 0;
-    int64_t end_time = 0;
+    uintptr_t entry_offset = -1;
+    size_t code_end = 0;
+    uint64_t cache_key = 0;
+    int64_t compile_us = 0;
 
-    /*
-     * append python functions & environmental variables
-     */
-    pyimpl_append_to_context(&ctx.vscc_ctx);
+    bool cached = program_args.cache_dir && !program_args.output && !program_args.instrument;
 
-    /*
-     * parse file and construct intermediate representation
-     */
-    start_time = time_us();
-    bool status = parse(&ctx, tokens);
-    end_time = time_us();
-    if (!status) {
-        printf("err: failed to compile\n");
-        return 0;
+    if (cached) {
+        char flags[256];
+        snprintf(flags, sizeof(flags), "s=%zu;o=%d;e=%s;u=%016lx", program_args.default_size, program_args.optimize, program_args.entry, 
+            guided ? profile.hash : 0);
+        cache_key = pycache_key(file.data, file.length, flags);
+
+        pyperf_begin(report, "cache");
+        start_time = time_us();
+        bool hit = pycache_load(program_args.cache_dir, cache_key, &ctx.compiled_data, &entry_offset, &code_end, &compile_us);
+        end_time = time_us();
+        pyperf_end(report);
+
+        if (program_args.perf && hit)
+            printf("pyvscc: cache hit (%016lx), loaded in %ld us, %ld us of compilation saved\n", cache_key, end_time - start_time, 
+                compile_us - (end_time - start_time));
     }
 
-    /*
-     * perform optimizations
-     */
-    if (program_args.optimize) {
-        for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn; fn = fn->next)
-            vscc_optfn_elim_dead_store(fn);
+    if (entry_offset == -1) {
+        start_time = time_us();
+        entry_offset = compile(&program_args, &file, &tokens, &ctx);
+        compile_us = time_us() - start_time;
+        if (entry_offset == -1)
+            return 0;
+
+        code_end = pyperfmap_code_end(&ctx.compiled_data, &ctx.vscc_ctx);
+        if (cached) {
+            bool stored = pycache_store(program_args.cache_dir, cache_key, &ctx.compiled_data, entry_offset, code_end, compile_us);
+            if (program_args.perf)
+                printf("pyvscc: cache miss (%016lx), %s\n", cache_key, stored ? "stored for the next run" : "could not store");
+        }
     }
 
     /*
-     * perf numbers
+     * sizes are taken before the image is relinked for output, a cached 
+     * binary comes without its ir
      */
-    if (program_args.perf)
-        printf("pyvscc: parsed and constructed intermediate representation in %ld us\n", end_time - start_time);
+    pyperf_summarize(report, &tokens, &ctx.vscc_ctx, &ctx.compiled_data);
 
     /*
-     * compile code and obtain entry point offset
+     * the image goes into the cache as generated, line buffering and the size
+     * of the heap are set in this copy only
      */
-    start_time = time_us();
-    uintptr_t entry_offset = build(&ctx);
-    end_time = time_us();
-    if (entry_offset == -1) {
-        printf("err: entry point not found\n");
-        return 0;
-    }
+    if (program_args.line && !pyimpl_request_line_buffering(&ctx.compiled_data))
+        printf("wrn: image has no output buffer, ignoring -l\n");
+    pyimpl_set_heap_capacity(&ctx.compiled_data, program_args.max_mem);
 
     /*
-     * perf numbers
+     * ahead of time output, nothing is executed
      */
-    if (program_args.perf)
-        printf("pyvscc: compiled into binary in %ld us\n", end_time - start_time);
+    if (program_args.output) {
+        bool split;
+        pyperf_begin(report, "write");
+        start_time = time_us();
+        bool written = pyelf_write(program_args.output, &ctx.compiled_data, &ctx.vscc_ctx, entry_offset, &split);
+        end_time = time_us();
+        pyperf_end(report);
+
+        if (!written)
+            printf("err: could not write executable '%s'\n", program_args.output);
+        else if (program_args.perf)
+            printf("pyvscc: wrote executable '%s' in %ld us (%s)\n", program_args.output, end_time - start_time, 
+                split ? "separate text and data segments" : "single segment, code could not be relinked");
+
+        finish_report(&program_args, &ctx);
+        lexer_free(&tokens);
+        file_unmap(&file);
+        return written ? 0 : 1;
+    }
 
     /*
      * map bytecode into executable memory and execute
      */
+    pyperf_begin(report, "map");
     void *mapped = map(&ctx.compiled_data);
     entry_point_fnptr entry = mapped + entry_offset;
+    uintptr_t flush_offset = pyimpl_find_symbol(&ctx.compiled_data, PYIMPL_FLUSH);
+    pyperf_end(report);
+
+    /*
+     * let perf resolve samples inside the mapping
+     */
+    struct pyperfmap_jitdump jitdump = { .fd = -1 };
+    if (program_args.perfmap) {
+        if (!pyperfmap_write(&ctx.compiled_data, code_end, mapped))
+            printf("wrn: could not write perf map\n");
+        if (strcmp(program_args.perfmap, "jitdump") == 0 && 
+            (!pyperfmap_jitdump_open(&jitdump) || !pyperfmap_jitdump_load(&jitdump, &ctx.compiled_data, code_end, mapped)))
+            printf("wrn: could not write jitdump\n");
+    }
 
     /*
      * execution
      */
-    start_time = time_us();
+    pyperf_begin(report, "execute");
+    fflush(stdout);
     entry();
-    end_time = time_us();
+    if (flush_offset != -1)
+        ((entry_point_fnptr)(mapped + flush_offset))();
+    pyperf_end(report);
 
     /*
      * perf numbers
      */
-    if (program_args.perf)
-        printf("pyvscc: executed for %ld us\n", end_time - start_time);
+    uint64_t writes = 0;
+    uint64_t written = 0;
+    if (program_args.perf && pyimpl_stdout_stats(&ctx.compiled_data, mapped, &writes, &written) && writes)
+        printf("pyvscc: print wrote %lu bytes in %lu write syscalls\n", written, writes);
+
+    /* blocks are powers of two, what the requests left unused is padding */
+    struct pyimpl_heap heap;
+    if (program_args.perf && pyimpl_heap_stats(&ctx.compiled_data, mapped, &heap) && (heap.top || heap.failures))
+        printf("pyvscc: heap peaked at %lu of %lu bytes, %lu cut from the region, %lu on free lists, %lu padding, %lu failed allocations\n",
+            heap.peak, heap.capacity, heap.top, heap.top - heap.used, heap.used - heap.requested, heap.failures);
+
+    finish_report(&program_args, &ctx);
+
+    if (program_args.instrument && !pyprofile_store(program_args.instrument, &ctx.compiled_data, &ctx.vscc_ctx, mapped))
+        printf("wrn: could not write profile '%s'\n", program_args.instrument);
 
     /*
      * free mapped memory
      */
+    pyperfmap_jitdump_close(&jitdump);
+    if (guided)
+        pyprofile_free(&profile);
+    pyimpl_heap_release(&ctx.compiled_data, mapped);
     munmap(mapped, ctx.compiled_data.length);
+    lexer_free(&tokens);
+    file_unmap(&file);
 }
\ No newline at end of file
@@ -0,0 +1,580 @@
+#include "pyasm.h"
+#include "pysym.h"
+#include "pyperf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IMM_Z(opsize) ((opsize) ? 2 : 4)
+
+/*
+ * operand layout of one-byte opcodes, false if unsupported
+ */
+static bool decode_one_byte(uint8_t op, bool w, bool opsize, bool *modrm, int *imm, int *rel)
+{
+    if (op < 0x40) {
+        switch (op & 7) {
+        case 0: case 1: case 2: case 3:
+            *modrm = true;
+            return true;
+        case 4:
+            *imm = 1;
+            return true;
+        case 5:
+            *imm = IMM_Z(opsize);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    if (op >= 0x50 && op <= 0x5f)
+        return true;
+    if (op >= 0x70 && op <= 0x7f) {
+        *rel = 1;
+        return true;
+    }
+    if (op >= 0x90 && op <= 0x99)
+        return true;
+    if ((op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf))
+        return true;
+    if (op >= 0xb0 && op <= 0xb7) {
+        *imm = 1;
+        return true;
+    }
+    if (op >= 0xb8 && op <= 0xbf) {
+        *imm = w ? 8 : IMM_Z(opsize);
+        return true;
+    }
+
+    switch (op) {
+    case 0x63: case 0x84: case 0x85: case 0x86: case 0x87: case 0x88: case 0x89: case 0x8a: case 0x8b: 
+    case 0x8d: case 0x8f: case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xf6: case 0xf7: case 0xfe: case 0xff:
+        *modrm = true;
+        return true;
+    case 0x6b: case 0x80: case 0x83: case 0xc0: case 0xc1: case 0xc6:
+        *modrm = true;
+        *imm = 1;
+        return true;
+    case 0x69: case 0x81: case 0xc7:
+        *modrm = true;
+        *imm = IMM_Z(opsize);
+        return true;
+    case 0x6a: case 0xa8:
+        *imm = 1;
+        return true;
+    case 0x68: case 0xa9:
+        *imm = IMM_Z(opsize);
+        return true;
+    case 0xc2:
+        *imm = 2;
+        return true;
+    case 0xc3: case 0xc9: case 0xcc:
+        return true;
+    case 0xe8: case 0xe9:
+        *rel = 4;
+        return true;
+    case 0xeb:
+        *rel = 1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * operand layout of 0f-escaped opcodes
+ */
+static bool decode_two_byte(uint8_t op, bool *modrm, int *imm, int *rel)
+{
+    if (op >= 0x80 && op <= 0x8f) {
+        *rel = 4;
+        return true;
+    }
+
+    if ((op >= 0x10 && op <= 0x17) || (op >= 0x28 && op <= 0x2f) || (op >= 0x40 && op <= 0x6f) || 
+        (op >= 0x74 && op <= 0x76) || (op >= 0x78 && op <= 0x7f) || (op >= 0x90 && op <= 0x9f) || (op >= 0xd0 && op <= 0xfe)) {
+        *modrm = true;
+        return true;
+    }
+
+    switch (op) {
+    case 0x05: case 0x0b: case 0x31: case 0x77: case 0xa2:
+        return true;
+    case 0x01: case 0x1f: case 0xa3: case 0xab: case 0xaf: case 0xb3: case 0xb6: case 0xb7:
+    case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+        *modrm = true;
+        return true;
+    case 0x70: case 0x71: case 0x72: case 0x73: case 0xba: case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+        *modrm = true;
+        *imm = 1;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int64_t read_signed(const uint8_t *p, int size)
+{
+    switch (size) {
+    case 1: return (int8_t)p[0];
+    case 2: { int16_t v; memcpy(&v, p, 2); return v; }
+    case 4: { int32_t v; memcpy(&v, p, 4); return v; }
+    case 8: { int64_t v; memcpy(&v, p, 8); return v; }
+    default: return 0;
+    }
+}
+
+bool pyasm_decode(const uint8_t *code, size_t length, size_t offset, struct pyasm_insn *insn)
+{
+    const uint8_t *start = code + offset;
+    const uint8_t *end = code + length;
+    const uint8_t *p = start;
+
+    memset(insn, 0, sizeof(*insn));
+    insn->offset = offset;
+
+    /* 
+     * legacy prefixes
+     */
+    for (; p < end; p++) {
+        if (*p == 0x66)
+            insn->opsize = true;
+        else if (*p == 0xf2 || *p == 0xf3)
+            insn->rep = true;
+        else if (*p != 0xf0 && *p != 0x2e && *p != 0x3e && *p != 0x26 && *p != 0x36 && *p != 0x64 && *p != 0x65 && *p != 0x67)
+            break;
+    }
+
+    /*
+     * vex prefixes stand for rex and the escape bytes, register extensions 
+     * are stored inverted
+     */
+    if (p < end && (*p == 0xc4 || *p == 0xc5)) {
+        bool three_byte = *p++ == 0xc4;
+        if (p + three_byte >= end)
+            return false;
+
+        insn->vex = three_byte ? (*p & 0x1f) : 1;
+        if (insn->vex == 0 || insn->vex > 3)
+            return false;
+
+        insn->rex = 0x40 | ((~*p >> 5) & (three_byte ? 7 : 4));
+        if (three_byte)
+            insn->rex |= (*++p >> 4) & 8;
+        p++;
+    }
+    else if (p < end && (*p & 0xf0) == 0x40)
+        insn->rex = *p++;
+    if (p >= end)
+        return false;
+
+    /*
+     * opcode
+     */
+    bool modrm = false;
+    int imm = 0;
+    int rel = 0;
+
+    if (insn->vex > 1) {
+        /* 0f38 and 0f3a maps, the latter always with an 8 bit immediate */
+        insn->opcode = *p;
+        insn->opcode_at = p++ - start;
+        modrm = true;
+        imm = insn->vex == 3;
+    }
+    else if (insn->vex || *p == 0x0f) {
+        if (!insn->vex && ++p >= end)
+            return false;
+        insn->two_byte = true;
+        insn->opcode = *p;
+        insn->opcode_at = p++ - start;
+        if (!decode_two_byte(insn->opcode, &modrm, &imm, &rel))
+            return false;
+    }
+    else {
+        insn->opcode = *p;
+        insn->opcode_at = p++ - start;
+        if (!decode_one_byte(insn->opcode, insn->rex & 8, insn->opsize, &modrm, &imm, &rel))
+            return false;
+    }
+
+    /*
+     * modrm, sib and displacement
+     */
+    int disp = 0;
+    if (modrm) {
+        if (p >= end)
+            return false;
+
+        insn->has_modrm = true;
+        insn->modrm = *p;
+        insn->modrm_at = p++ - start;
+
+        int mod = insn->modrm >> 6;
+        int rm = insn->modrm & 7;
+
+        if (mod != 3 && rm == 4) {
+            if (p >= end)
+                return false;
+            insn->has_sib = true;
+            insn->sib = *p++;
+            if (mod == 0 && (insn->sib & 7) == 5)
+                disp = 4;
+        }
+
+        if (mod == 0 && rm == 5) {
+            disp = 4;
+            insn->rip_relative = true;
+        }
+        else if (mod == 1)
+            disp = 1;
+        else if (mod == 2)
+            disp = 4;
+
+        /* test has an immediate, the other members of the group do not */
+        if (!insn->two_byte && (insn->opcode == 0xf6 || insn->opcode == 0xf7) && ((insn->modrm >> 3) & 7) < 2)
+            imm = insn->opcode == 0xf6 ? 1 : IMM_Z(insn->opsize);
+    }
+
+    if (p + disp + imm + rel > end)
+        return false;
+
+    if (disp) {
+        insn->disp_at = p - start;
+        insn->disp_size = disp;
+        insn->disp = read_signed(p, disp);
+        p += disp;
+    }
+
+    if (imm) {
+        insn->imm_at = p - start;
+        insn->imm_size = imm;
+        insn->imm = read_signed(p, imm);
+        p += imm;
+    }
+
+    if (rel) {
+        insn->relative = true;
+        insn->rel_at = p - start;
+        insn->rel_size = rel;
+        p += rel;
+    }
+
+    insn->length = p - start;
+
+    if (insn->relative)
+        insn->target = (int64_t)offset + insn->length + read_signed(start + insn->rel_at, insn->rel_size);
+    else if (insn->rip_relative) {
+        insn->rel_at = insn->disp_at;
+        insn->rel_size = 4;
+        insn->target = (int64_t)offset + insn->length + insn->disp;
+    }
+
+    return true;
+}
+
+static bool is_group(struct pyasm_insn *insn)
+{
+    /* opcodes whose modrm.reg selects the operation rather than a register */
+    if (insn->two_byte)
+        return insn->opcode == 0x01 || insn->opcode == 0x1f || insn->opcode == 0xba || (insn->opcode >= 0x71 && insn->opcode <= 0x73);
+
+    switch (insn->opcode) {
+    case 0x80: case 0x81: case 0x83: case 0x8f: case 0xc0: case 0xc1: case 0xc6: case 0xc7:
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xf6: case 0xf7: case 0xfe: case 0xff:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint16_t pyasm_registers_used(struct pyasm_insn *insn)
+{
+    uint16_t used = 0;
+    uint8_t rex = insn->rex;
+    uint8_t op = insn->opcode;
+
+    /*
+     * explicit operands
+     */
+    if (insn->has_modrm) {
+        int mod = insn->modrm >> 6;
+        int rm = insn->modrm & 7;
+
+        if (!is_group(insn))
+            used |= GPR_MASK(((rex & 4) << 1) | ((insn->modrm >> 3) & 7));
+
+        if (mod == 3)
+            used |= GPR_MASK(((rex & 1) << 3) | rm);
+        else if (insn->has_sib) {
+            if (!(mod == 0 && (insn->sib & 7) == 5))
+                used |= GPR_MASK(((rex & 1) << 3) | (insn->sib & 7));
+            if (((insn->sib >> 3) & 7) != 4 || (rex & 2))
+                used |= GPR_MASK(((rex & 2) << 2) | ((insn->sib >> 3) & 7));
+        }
+        else if (!insn->rip_relative)
+            used |= GPR_MASK(((rex & 1) << 3) | rm);
+    }
+
+    /* vex encoded instructions have no implicit general purpose operands */
+    if (insn->vex)
+        return used;
+
+    if (!insn->two_byte && ((op >= 0x50 && op <= 0x5f) || (op >= 0x90 && op <= 0x97) || (op >= 0xb0 && op <= 0xbf)))
+        used |= GPR_MASK(((rex & 1) << 3) | (op & 7));
+
+    /*
+     * implicit operands
+     */
+    if (insn->rep)
+        used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RCX) | GPR_MASK(GPR_RSI) | GPR_MASK(GPR_RDI);
+
+    if (insn->two_byte) {
+        switch (op) {
+        case 0x05:
+            used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RCX) | GPR_MASK(GPR_RDX) | GPR_MASK(GPR_RSI) | GPR_MASK(GPR_RDI) |
+                GPR_MASK(GPR_R8) | GPR_MASK(GPR_R9) | GPR_MASK(GPR_R10) | GPR_MASK(GPR_R11);
+            break;
+        case 0xa2:
+            used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RBX) | GPR_MASK(GPR_RCX) | GPR_MASK(GPR_RDX);
+            break;
+        case 0x31:
+            used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RDX);
+            break;
+        case 0x01:
+            if (insn->modrm == 0xd0)
+                used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RCX) | GPR_MASK(GPR_RDX);
+            break;
+        }
+        return used;
+    }
+
+    if ((op < 0x40 && ((op & 7) == 4 || (op & 7) == 5)) || op == 0xa8 || op == 0xa9 || op == 0x98)
+        used |= GPR_MASK(GPR_RAX);
+    if ((op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf))
+        used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RSI) | GPR_MASK(GPR_RDI);
+    if (op == 0x99 || ((op == 0xf6 || op == 0xf7) && ((insn->modrm >> 3) & 7) >= 4))
+        used |= GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RDX);
+    if (op == 0xd2 || op == 0xd3)
+        used |= GPR_MASK(GPR_RCX);
+    if (op == 0xc9)
+        used |= GPR_MASK(GPR_RSP) | GPR_MASK(GPR_RBP);
+
+    return used;
+}
+
+static int compare_function(const void *a, const void *b)
+{
+    const struct pyasm_function *x = a;
+    const struct pyasm_function *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+bool pyasm_image_init(struct pyasm_image *image, struct vscc_codegen_data *data, struct vscc_context *ctx)
+{
+    memset(image, 0, sizeof(*image));
+    image->data = data;
+    image->code_end = data->length;
+
+    /*
+     * symbols naming a function are code, everything else is data
+     */
+    struct pysym_table strings = { 0 };
+    struct pysym_table names = { 0 };
+    size_t symbolc = 0;
+
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        pysym_put(&names, pysym_intern(&strings, fn->symbol_name, strlen(fn->symbol_name)), fn);
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        symbolc++;
+
+    image->functions = pyperf_calloc(symbolc + 1, sizeof(struct pyasm_function));
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next) {
+        if (pysym_get(&names, pysym_intern(&strings, symbol->symbol_name, strlen(symbol->symbol_name))))
+            image->functions[image->functionc++] = (struct pyasm_function){ .symbol = symbol, .start = symbol->offset };
+        else if (symbol->offset < image->code_end)
+            image->code_end = symbol->offset;
+    }
+
+    pysym_free(&names, false);
+    pysym_free(&strings, true);
+
+    image->data_align = 16;
+    image->data_phase = image->code_end & 15;
+
+    qsort(image->functions, image->functionc, sizeof(struct pyasm_function), compare_function);
+    for (size_t i = 0; i < image->functionc; i++)
+        image->functions[i].end = i + 1 < image->functionc ? image->functions[i + 1].start : image->code_end;
+
+    /*
+     * decode all code, every function must start on an instruction boundary
+     */
+    size_t capacity = image->code_end / 4 + 16;
+    image->insns = pyperf_malloc(capacity * sizeof(struct pyasm_insn));
+
+    size_t fn = 0;
+    for (size_t offset = 0; offset < image->code_end; ) {
+        if (image->insnc == capacity) {
+            capacity *= 2;
+            image->insns = pyperf_realloc(image->insns, capacity * sizeof(struct pyasm_insn));
+        }
+
+        if (fn < image->functionc && image->functions[fn].start < offset)
+            return false;
+        if (fn < image->functionc && image->functions[fn].start == offset)
+            image->functions[fn++].first = image->insnc;
+
+        struct pyasm_insn *insn = &image->insns[image->insnc];
+        if (!pyasm_decode(data->buffer, image->code_end, offset, insn))
+            return false;
+
+        image->insnc++;
+        offset += insn->length;
+    }
+
+    if (fn != image->functionc)
+        return false;
+
+    for (size_t i = 0; i < image->functionc; i++)
+        image->functions[i].count = (i + 1 < image->functionc ? image->functions[i + 1].first : image->insnc) - image->functions[i].first;
+
+    image->edits = pyperf_calloc(image->insnc, sizeof(struct pyasm_edit));
+    return true;
+}
+
+void pyasm_image_free(struct pyasm_image *image)
+{
+    free(image->functions);
+    free(image->insns);
+    free(image->edits);
+    memset(image, 0, sizeof(*image));
+}
+
+size_t pyasm_find(struct pyasm_image *image, uint64_t offset)
+{
+    size_t lo = 0;
+    size_t hi = image->insnc;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (image->insns[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < image->insnc && image->insns[lo].offset == offset ? lo : (size_t)-1;
+}
+
+/*
+ * new location of an offset into the old image, -1 if it is not an instruction boundary
+ */
+static int64_t relocate(struct pyasm_image *image, uint32_t *new_offsets, int64_t delta, int64_t target)
+{
+    if (target >= image->code_end)
+        return target < image->data->length ? target + delta : -1;
+    if (target < 0)
+        return -1;
+
+    size_t i = pyasm_find(image, target);
+    return i == (size_t)-1 ? -1 : new_offsets[i];
+}
+
+bool pyasm_relink(struct pyasm_image *image)
+{
+    struct vscc_codegen_data *data = image->data;
+    uint32_t *new_offsets = pyperf_malloc((image->insnc + 1) * sizeof(uint32_t));
+
+    /*
+     * lay out code, then pad so the data lands at the requested alignment
+     */
+    uint32_t pos = 0;
+    for (size_t i = 0; i < image->insnc; i++) {
+        struct pyasm_edit *edit = &image->edits[i];
+        new_offsets[i] = pos;
+        pos += edit->prefix_length + (edit->code ? edit->code_length : edit->replaced ? edit->length : image->insns[i].length);
+    }
+
+    uint32_t new_code_end = pos;
+    while ((new_code_end & (image->data_align - 1)) != image->data_phase)
+        new_code_end++;
+
+    int64_t delta = (int64_t)new_code_end - image->code_end;
+    size_t new_length = data->length + delta;
+    uint8_t *buffer = pyperf_malloc(new_length);
+
+    /*
+     * emit code and re-point every relative operand
+     */
+    for (size_t i = 0; i < image->insnc; i++) {
+        struct pyasm_insn *insn = &image->insns[i];
+        struct pyasm_edit *edit = &image->edits[i];
+        uint8_t *dst = buffer + new_offsets[i];
+
+        memcpy(dst, edit->prefix, edit->prefix_length);
+        dst += edit->prefix_length;
+
+        if (edit->code) {
+            memcpy(dst, edit->code, edit->code_length);
+            continue;
+        }
+
+        int rel_at = insn->relative || insn->rip_relative ? insn->rel_at : -1;
+        int rel_size = insn->rel_size;
+        size_t length = insn->length;
+
+        if (edit->replaced) {
+            memcpy(dst, edit->bytes, edit->length);
+            rel_at = edit->rel_at;
+            rel_size = edit->rel_size;
+            length = edit->length;
+        }
+        else
+            memcpy(dst, data->buffer + insn->offset, insn->length);
+
+        if (rel_at < 0)
+            continue;
+
+        int64_t target = relocate(image, new_offsets, delta, insn->target);
+        int64_t rel = target - (int64_t)((dst - buffer) + length);
+
+        if (target < 0 || (rel_size == 1 && (rel < INT8_MIN || rel > INT8_MAX)) || rel < INT32_MIN || rel > INT32_MAX) {
+            free(buffer);
+            free(new_offsets);
+            return false;
+        }
+
+        if (rel_size == 1)
+            dst[rel_at] = (int8_t)rel;
+        else {
+            int32_t rel32 = rel;
+            memcpy(dst + rel_at, &rel32, sizeof(rel32));
+        }
+    }
+
+    memset(buffer + pos, 0xcc, new_code_end - pos);
+    memcpy(buffer + new_code_end, data->buffer + image->code_end, data->length - image->code_end);
+
+    /*
+     * move symbols, all of them must land on instruction boundaries
+     */
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next) {
+        if (relocate(image, new_offsets, delta, symbol->offset) < 0 && symbol->offset != image->code_end) {
+            free(buffer);
+            free(new_offsets);
+            return false;
+        }
+    }
+
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        symbol->offset = symbol->offset == image->code_end ? new_code_end : relocate(image, new_offsets, delta, symbol->offset);
+
+    free(data->buffer);
+    data->buffer = buffer;
+    data->length = new_length;
+    image->code_end = new_code_end;
+
+    free(new_offsets);
+    return true;
+}
\ No newline at end of file
@@ -1,16 +1,31 @@
 #include "pybuild.h"
 #include "lexer.h"
 #include "pyimpl.h"
+#include "pyasm.h"
+#include "pycodegen.h"
+#include "pynative.h"
+#include "pypool.h"
 
 #include <vscc.h>
 
 #include <util/list.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define BRANCH_IF 1
 #define BRANCH_WHILE 2
+#define BRANCH_FOR 3
+#define BRANCH_ELSE 4
+
+/* shortest if/elif chain lowered as a switch, and the largest run searched linearly */
+#define SWITCH_MIN_CASES 4
+#define SWITCH_LINEAR_CASES 3
+
+/* identifiers always fit, see LEXER_MAX_IDENTIFIER; other tokens are only cut short in messages */
+#define TEXT(token) lexer_token_text(ctx->tokens, (token), (char[LEXER_MAX_IDENTIFIER + 1]){ 0 }, LEXER_MAX_IDENTIFIER + 1)
 
 #define FAIL_IF(x, ...) \
     if (x) { \
@@ -27,15 +42,14 @@ static bool equals(void *a, void *b)
 static struct pybuild_branch *branch_push(struct pybuild_branch **root, struct pybuild_branch b)
 {
     struct pybuild_branch *br = vscc_list_alloc((void**)root, 0, sizeof(struct pybuild_branch));
-    br->type = b.type;
-    br->start_label = b.start_label;
-    br->end_label = b.end_label;
+    b.next = br->next;
+    *br = b;
     return br;
 }
 
 static struct pybuild_branch *branch_pop(struct pybuild_branch **root)
 {
-    struct pybuild_branch *res = calloc(1, sizeof(struct pybuild_branch));
+    struct pybuild_branch *res = pyperf_calloc(1, sizeof(struct pybuild_branch));
     struct pybuild_branch *br = *root;
     for (; br->next; br = br->next);
     memcpy(res, br, sizeof(struct pybuild_branch));
@@ -43,19 +57,77 @@ static struct pybuild_branch *branch_pop(struct pybuild_branch **root)
     return res;
 }
 
-static int branch_count(struct pybuild_branch **root)
+static struct lexer_token *next(struct lexer_token *c)
 {
-    int res = 0;
-    for (struct pybuild_branch *b = *root; b; b = b->next)
-        res++;
-    return res;
+    return c->type == TOKEN_EOF ? c : c + 1;
 }
 
-static struct lexer_token *next(struct lexer_token *c)
+static char *intern_text(struct pybuild_context *ctx, const char *str, size_t length)
+{
+    /* workers reuse whatever their parent interned, the parent is read only while they run */
+    if (ctx->parent) {
+        const char *res = pysym_lookup(&ctx->parent->strings, str, length);
+        if (res)
+            return (char*)res;
+    }
+    return (char*)pysym_intern(&ctx->strings, str, length);
+}
+
+static char *intern(struct pybuild_context *ctx, struct lexer_token *token)
+{
+    return intern_text(ctx, ctx->tokens->source + token->offset, token->length);
+}
+
+static char *intern_str(struct pybuild_context *ctx, char *str)
+{
+    return intern_text(ctx, str, strlen(str));
+}
+
+static struct vscc_function *get_function(struct pybuild_context *ctx, char *name)
+{
+    struct vscc_function *res = pysym_get(&ctx->functions, name);
+    return res || !ctx->parent ? res : pysym_get(&ctx->parent->functions, name);
+}
+
+/*
+ * what a register currently holds and what a function returns, keyed by 
+ * pointer: VALUE_INT, VALUE_STRING or, for a register still holding an 
+ * untyped parameter, that parameter. missing entries fall back to the parent
+ */
+#define VALUE_INT ((const void*)1)
+#define VALUE_STRING ((const void*)2)
+
+static void set_value(struct pybuild_context *ctx, const void *key, const void *value)
+{
+    pysym_put(&ctx->string_values, (const char*)key, (void*)value);
+}
+
+static const void *get_value(struct pybuild_context *ctx, const void *key)
+{
+    const void *res = pysym_get(&ctx->string_values, (const char*)key);
+    res = res || !ctx->parent ? res : pysym_get(&ctx->parent->string_values, (const char*)key);
+    return res ? res : VALUE_INT;
+}
+
+static void set_string(struct pybuild_context *ctx, const void *key, bool string)
 {
-    if (c->next->type == TOKEN_WHITESPACE)
-        return next(c->next);
-    return c->next;
+    set_value(ctx, key, string ? VALUE_STRING : VALUE_INT);
+}
+
+static bool is_string(struct pybuild_context *ctx, const void *key)
+{
+    return get_value(ctx, key) == VALUE_STRING;
+}
+
+static bool is_parameter_value(const void *value)
+{
+    return value != VALUE_INT && value != VALUE_STRING;
+}
+
+static int64_t literal_value(struct pybuild_context *ctx, struct lexer_token *token, bool negate)
+{
+    int64_t value = atoll(TEXT(token));
+    return negate ? -value : value;
 }
 
 static size_t parse_size(char *str)
@@ -67,7 +139,8 @@ static size_t parse_size(char *str)
         { .cmp = "byte", .size = sizeof(uint8_t) },
         { .cmp = "word", .size = sizeof(uint16_t) },
         { .cmp = "dword", .size = sizeof(uint32_t) },
-        { .cmp = "qword", .size = sizeof(uint64_t) }
+        { .cmp = "qword", .size = sizeof(uint64_t) },
+        { .cmp = "str", .size = sizeof(char*) }
     };
 
     for (int i = 0; i < sizeof(table) / sizeof(*table); i++)
@@ -80,30 +153,39 @@ static void parse_definition(struct pybuild_context *ctx, struct lexer_token *st
 {
     /* next token is [identifier] */
     struct lexer_token *token = next(start_token);
-    ctx->current_function = vscc_init_function(&ctx->vscc_ctx, token->contents, ctx->default_size);
+    char *name = intern(ctx, token);
+    ctx->current_function = vscc_init_function(&ctx->vscc_ctx, name, ctx->default_size);
+    pysym_put(&ctx->functions, name, ctx->current_function);
+    pysym_clear(&ctx->locals);
 
     /* next two tokens are [(, identifier]*/
+    struct vscc_register *reg;
     token = next(next(token));
-    while (token != end_token && token && token->type != TOKEN_CLOSE_PAREN) {
-        if (token->type == TOKEN_COMMA || token->type == TOKEN_WHITESPACE) {
-            token = token->next;
+    while (token != end_token && token->type != TOKEN_CLOSE_PAREN) {
+        if (token->type == TOKEN_COMMA) {
+            token = next(token);
             continue;
         }
         
+        name = intern(ctx, token);
         switch (next(token)->type) {
         case TOKEN_COMMA:
         case TOKEN_CLOSE_PAREN:
-            vscc_alloc(ctx->current_function, token->contents, ctx->default_size, true, true);
+            reg = vscc_alloc(ctx->current_function, name, ctx->default_size, true, true);
+            set_value(ctx, reg, reg);
+            pysym_put(&ctx->locals, name, reg);
             break;
         case TOKEN_COLON:
-            vscc_alloc(ctx->current_function, token->contents, parse_size(next(next(token))->contents), true, true);
+            reg = vscc_alloc(ctx->current_function, name, parse_size(TEXT(next(next(token)))), true, true);
+            set_string(ctx, reg, strcmp(TEXT(next(next(token))), "str") == 0);
+            pysym_put(&ctx->locals, name, reg);
             token = next(next(token));
             break;
         default:
             /* to-do: fail? */
             break;
         }
-        token = token->next;
+        token = next(token);
     }
 
     token = next(token);
@@ -112,10 +194,11 @@ static void parse_definition(struct pybuild_context *ctx, struct lexer_token *st
         return;
     case TOKEN_RARROW:
         token = next(token);
-        ctx->current_function->return_size = parse_size(token->contents);
+        ctx->current_function->return_size = parse_size(TEXT(token));
+        set_string(ctx, ctx->current_function, strcmp(TEXT(token), "str") == 0);
         break;
     default:
-        FAIL_IF(true, "err: unexpected token at end of def, '%s'\n", token->contents);
+        FAIL_IF(true, "err: unexpected token at end of def, '%s'\n", TEXT(token));
     }
 
     FAIL_IF(next(token)->type != TOKEN_COLON, "err: expected ':' at end of function '%s'\n", ctx->current_function->symbol_name);
@@ -123,95 +206,162 @@ static void parse_definition(struct pybuild_context *ctx, struct lexer_token *st
 
 static struct vscc_register *get_variable(struct pybuild_context *ctx, char *name)
 {
-    struct vscc_register *res = vscc_fetch_register_by_name(ctx->current_function, name);
-    res = res ? res : vscc_fetch_global_register_by_name(&ctx->vscc_ctx, name);
-    if (res == NULL)
-        return vscc_alloc(ctx->current_function, name, ctx->default_size, false, true);
+    /* name must be interned */
+    struct vscc_register *res = pysym_get(&ctx->locals, name);
+    res = res ? res : pysym_get(&ctx->globals, name);
+    res = res || !ctx->parent ? res : pysym_get(&ctx->parent->globals, name);
+    if (res == NULL) {
+        res = vscc_alloc(ctx->current_function, name, ctx->default_size, false, true);
+        pysym_put(&ctx->locals, name, res);
+    }
     return res;
 }
 
-static char *generate_name_for_local_global(struct vscc_function *current_function, char *name)
+static enum pyimpl_implementation_status get_builtin_status(struct pybuild_context *ctx, char *name)
 {
-    static char res[64];
-    static int counter = 0;
-    char temp[16];
-
-    strcpy(res, "__autogen_");
-    strcat(res, current_function->symbol_name);
-    strcat(res, "_");
-    if (name)
-        strcat(res, name);
-    else {
-        sprintf(temp, "%d", counter++);
-        strcat(res, temp);
+    /* statuses are cached off by one so that zero means not yet looked up */
+    uintptr_t status = (uintptr_t)pysym_get(&ctx->builtins, name);
+    if (status == 0) {
+        status = pyimpl_get_implementation_status(name) + 1;
+        pysym_put(&ctx->builtins, name, (void*)status);
     }
-    return res;
+    return status - 1;
+}
+
+static struct vscc_function *get_builtin(struct pybuild_context *ctx, char *name, enum pyimpl_implementation impl)
+{
+    const char *implname = pyimpl_get_name(name, impl);
+    return implname ? get_function(ctx, intern_str(ctx, (char*)implname)) : NULL;
+}
+
+static char *generate_name_for_local_global(struct pybuild_context *ctx)
+{
+    /*
+     * numbered per function, names do not depend on what other functions 
+     * contain. the hash of the whole function name keeps them apart from 
+     * functions sharing a long prefix and stays the same across rebuilds
+     */
+    snprintf(ctx->autogen_name, sizeof(ctx->autogen_name), "__autogen_%016" PRIx64 "_%d", pyprofile_hash(ctx->current_function->symbol_name), ctx->autogen++);
+    return ctx->autogen_name;
 }
 
-static void queue_memcpy(struct pybuild_context *ctx, char *name, void *data, size_t length)
+static void queue_memcpy(struct pybuild_context *ctx, char *name, void *data, size_t length, bool owned)
 {
-    struct pybuild_memcpy *res = vscc_list_alloc((void**)&ctx->memcpy_queue, 0, sizeof(struct pybuild_memcpy));
+    /* order does not matter, build() sorts the queue by offset */
+    struct pybuild_memcpy *res = pyperf_calloc(1, sizeof(struct pybuild_memcpy));
+    res->next = ctx->memcpy_queue;
+    ctx->memcpy_queue = res;
+
     res->dst = name;
     res->src = data;
     res->length = length;
+    res->owned = owned;
 }
 
 static struct vscc_register *create_string(struct pybuild_context *ctx, struct lexer_token *token, struct vscc_register *dst)
 {
-    struct vscc_register *raw = vscc_alloc_global(&ctx->vscc_ctx, generate_name_for_local_global(ctx->current_function, NULL), strlen(token->contents) - 1, true);
-    struct vscc_register *ptr = dst != NULL ? dst : vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx->current_function, NULL), sizeof(void*), false, true);
-    queue_memcpy(ctx, raw->symbol_name, &token->contents[1], strlen(token->contents) - 2);
+    /* strings without escapes are copied straight out of the source */
+    char *body = (char*)ctx->tokens->source + token->offset + 1;
+    size_t length = token->length - 2;
+    bool escaped = memchr(body, '\\', length) != NULL;
+    if (escaped) {
+        body = pyperf_malloc(length);
+        length = lexer_unescape(ctx->tokens, token, body);
+    }
+
+    /* the value points past the length, at a nul terminated body */
+    struct vscc_register *raw = vscc_alloc_global(&ctx->vscc_ctx, generate_name_for_local_global(ctx), PYIMPL_STRING_PREFIX + length + 1, true);
+    char *raw_name = intern_str(ctx, raw->symbol_name);
+    pysym_put(&ctx->globals, raw_name, raw);
+    struct vscc_register *ptr = dst != NULL ? dst : vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx), sizeof(void*), false, true);
+    queue_memcpy(ctx, raw_name, body, length, escaped);
+    set_string(ctx, ptr, true);
     vscc_push1(ctx->current_function, O_LEA, ptr, raw);
+    vscc_push0(ctx->current_function, O_ADD, ptr, PYIMPL_STRING_PREFIX);
     return ptr;
 }
 
+static void record_argument(struct pybuild_context *ctx, struct vscc_function *callee, size_t index, const void *value)
+{
+    struct pybuild_argument *arg = pyperf_malloc(sizeof(struct pybuild_argument));
+    *arg = (struct pybuild_argument){ .next = ctx->arguments, .callee = callee, .index = index, .value = value };
+    ctx->arguments = arg;
+}
+
+static void defer_builtin(struct pybuild_context *ctx, char *name, struct vscc_register *parameter)
+{
+    struct vscc_instruction *call = NULL;
+    for (struct vscc_instruction *insn = ctx->current_function->instruction_stream; insn; insn = insn->next)
+        if (insn->opcode == O_CALL)
+            call = insn;
+
+    struct pybuild_deferred *deferred = pyperf_malloc(sizeof(struct pybuild_deferred));
+    *deferred = (struct pybuild_deferred){ .next = ctx->deferred, .call = call, .name = name, .fn = ctx->current_function, .parameter = parameter };
+    ctx->deferred = deferred;
+}
+
 static void parse_call(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
 {
     /*
-     * check if implementation of function exists
+     * check if implementation of function exists, a builtin called on an 
+     * untyped parameter starts out as the integer variant
      */
     struct vscc_function *callee = NULL;
     struct lexer_token *token = next(next(start_token));
+    char *name = intern(ctx, start_token);
+    enum pyimpl_implementation_status builtin = get_builtin_status(ctx, name);
+    const void *first = token->type == TOKEN_STRING ? VALUE_STRING : 
+        token->type == TOKEN_IDENTIFIER ? get_value(ctx, get_variable(ctx, intern(ctx, token))) : VALUE_INT;
 
-    switch (pyimpl_get_implementation_status(start_token->contents)) {
+    switch (builtin) {
     case PYIMPL_NOT_IMPLEMENTED:
-        callee = vscc_fetch_function_by_name(&ctx->vscc_ctx, start_token->contents);
+        callee = get_function(ctx, name);
         break;
     case PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION:
-        callee = pyimpl_get(&ctx->vscc_ctx, start_token->contents, PYIMPL_SINGLE_IMPL);
+        callee = get_builtin(ctx, name, PYIMPL_SINGLE_IMPL);
         break;
     case PYIMPL_IMPLEMENTED_AND_MULTI_DEFINITION:
-        callee = pyimpl_get(&ctx->vscc_ctx, start_token->contents, token->type == TOKEN_LITERAL ? PYIMPL_FIRST_ARG_INT : PYIMPL_FIRST_ARG_STRING);
+        callee = get_builtin(ctx, name, first == VALUE_STRING ? PYIMPL_FIRST_ARG_STRING : PYIMPL_FIRST_ARG_INT);
         break;
     }
 
-    FAIL_IF(callee == NULL, "err: could not find function '%s'\n", start_token->contents);
-    while (token != end_token && token && token->type != TOKEN_CLOSE_PAREN) {
-        if (token->type == TOKEN_COMMA || token->type == TOKEN_WHITESPACE) {
-            token = token->next;
+    FAIL_IF(callee == NULL, "err: could not find function '%s'\n", name);
+    for (size_t index = 0; token != end_token && token->type != TOKEN_CLOSE_PAREN; token = next(token)) {
+        if (token->type == TOKEN_COMMA)
             continue;
-        }
         
+        struct vscc_register *reg;
         switch (token->type) {
         case TOKEN_IDENTIFIER:
-            vscc_push3(ctx->current_function, O_PSHARG, get_variable(ctx, token->contents));
+            reg = get_variable(ctx, intern(ctx, token));
+            vscc_push3(ctx->current_function, O_PSHARG, reg);
+            if (builtin == PYIMPL_NOT_IMPLEMENTED)
+                record_argument(ctx, callee, index, get_value(ctx, reg));
             break;
         case TOKEN_LITERAL:
-            vscc_push2(ctx->current_function, O_PSHARG, atoi(token->contents));
+            vscc_push2(ctx->current_function, O_PSHARG, literal_value(ctx, token, false));
+            if (builtin == PYIMPL_NOT_IMPLEMENTED)
+                record_argument(ctx, callee, index, VALUE_INT);
             break;
-        case TOKEN_STRING:;
+        case TOKEN_STRING:
             vscc_push3(ctx->current_function, O_PSHARG, create_string(ctx, token, NULL));
+            if (builtin == PYIMPL_NOT_IMPLEMENTED)
+                record_argument(ctx, callee, index, VALUE_STRING);
             break;
         default:
-            FAIL_IF(true, "err: expected parameter, got this instead: '%s'\n", token->contents);
+            FAIL_IF(true, "err: expected parameter, got this instead: '%s'\n", TEXT(token));
         }
-        token = token->next;
+        index++;
     }
 
-    if (ctx->return_reg)
+    if (ctx->return_reg) {
         ctx->return_reg->size = callee->return_size;
+        set_string(ctx, ctx->return_reg, is_string(ctx, callee));
+    }
 
-    _vscc_call(ctx->current_function, callee, ctx->return_reg ? ctx->return_reg : vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx->current_function, NULL), ctx->default_size, false, true));
+    _vscc_call(ctx->current_function, callee, ctx->return_reg ? ctx->return_reg : vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx), ctx->default_size, false, true));
+    if (builtin == PYIMPL_IMPLEMENTED_AND_MULTI_DEFINITION && is_parameter_value(first))
+        defer_builtin(ctx, name, (struct vscc_register*)first);
 }
 
 static enum vscc_opcode math_to_op(enum lexer_token_type type)
@@ -227,12 +377,14 @@ static enum vscc_opcode math_to_op(enum lexer_token_type type)
 
 static void parse_assignment(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
 {
-    struct vscc_register *dst = get_variable(ctx, start_token->contents);
+    struct vscc_register *dst = get_variable(ctx, intern(ctx, start_token));
 
     switch (next(start_token)->type) {
     case TOKEN_EQUAL:
-        if (next(next(start_token))->type == TOKEN_LITERAL)
-            vscc_push0(ctx->current_function, O_STORE, dst, atoi(next(next(start_token))->contents));
+        if (next(next(start_token))->type == TOKEN_LITERAL) {
+            vscc_push0(ctx->current_function, O_STORE, dst, literal_value(ctx, next(next(start_token)), false));
+            set_string(ctx, dst, false);
+        }
         else if (next(next(start_token))->type == TOKEN_STRING)
             create_string(ctx, next(next(start_token)), dst);
         else if (next(next(start_token))->type == TOKEN_IDENTIFIER) {
@@ -241,27 +393,31 @@ static void parse_assignment(struct pybuild_context *ctx, struct lexer_token *st
                 parse_call(ctx, next(next(start_token)), end_token, status);
                 ctx->return_reg = NULL;
             }
-            else
-                vscc_push1(ctx->current_function, O_STORE, dst, get_variable(ctx, start_token->contents));
+            else {
+                struct vscc_register *src = get_variable(ctx, intern(ctx, next(next(start_token))));
+                vscc_push1(ctx->current_function, O_STORE, dst, src);
+                set_value(ctx, dst, get_value(ctx, src));
+            }
         }
         break;
     case TOKEN_ADDEQ:
     case TOKEN_SUBEQ:
     case TOKEN_MULEQ:
     case TOKEN_DIVEQ:
+        set_string(ctx, dst, false);
         if (next(next(start_token))->type == TOKEN_LITERAL)
-            vscc_push0(ctx->current_function, math_to_op(next(start_token)->type), dst, atoi(next(next(start_token))->contents));
+            vscc_push0(ctx->current_function, math_to_op(next(start_token)->type), dst, literal_value(ctx, next(next(start_token)), false));
         else if (next(next(start_token))->type == TOKEN_STRING)
             assert(false && "unsupported operation");
         else if (next(next(start_token))->type == TOKEN_IDENTIFIER) {
             if (next(next(next(start_token)))->type == TOKEN_OPEN_PAREN) {
-                ctx->return_reg = vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx->current_function, NULL), ctx->default_size, false, true);
+                ctx->return_reg = vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx), ctx->default_size, false, true);
                 parse_call(ctx, next(next(start_token)), end_token, status);
                 vscc_push1(ctx->current_function, math_to_op(next(start_token)->type), dst, ctx->return_reg);
                 ctx->return_reg = NULL;
             }
             else
-                vscc_push1(ctx->current_function, math_to_op(next(start_token)->type), dst, get_variable(ctx, start_token->contents));
+                vscc_push1(ctx->current_function, math_to_op(next(start_token)->type), dst, get_variable(ctx, intern(ctx, next(next(start_token)))));
         }
         break;
     default:
@@ -283,7 +439,7 @@ static void parse_identifier(struct pybuild_context *ctx, struct lexer_token *st
         parse_assignment(ctx, start_token, end_token, status);
         break;
     default:
-        FAIL_IF(true, "err: unexcepted identifier '%s'\n", start_token->contents);
+        FAIL_IF(true, "err: unexcepted identifier '%s'\n", TEXT(start_token));
     }
 }
 
@@ -293,37 +449,31 @@ static void parse_return(struct pybuild_context *ctx, struct lexer_token *start_
 
     switch (token->type) {
     case TOKEN_LITERAL:
-        vscc_push2(ctx->current_function, O_RET, atoi(token->contents));
+        vscc_push2(ctx->current_function, O_RET, literal_value(ctx, token, false));
         break;
     case TOKEN_IDENTIFIER:
         /* to-do: support returning functions/expressions */
-        vscc_push3(ctx->current_function, O_RET, get_variable(ctx, token->contents));
+        vscc_push3(ctx->current_function, O_RET, get_variable(ctx, intern(ctx, token)));
         break;
     default:
-        FAIL_IF(true, "err: unexcepted identifier following return, '%s'\n", start_token->contents);
+        FAIL_IF(true, "err: unexcepted identifier following return, '%s'\n", TEXT(start_token));
     }
 }
 
-static void parse_conditional(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
+/*
+ * jump to 'label' when 'dst op src' evaluates to 'when'
+ */
+static void emit_condition(struct pybuild_context *ctx, struct lexer_token *dst_token, struct lexer_token *operation_token, 
+    struct lexer_token *src_token, int label, bool when)
 {
-    struct lexer_token *dst_token = next(start_token);
-    struct lexer_token *operation_token = next(dst_token);
-    struct lexer_token *src_token = next(operation_token);
-
-    struct vscc_register *dest = get_variable(ctx, dst_token->contents);
-
-    struct pybuild_branch *branch = branch_push(&ctx->branch_queue, (struct pybuild_branch){
-        .type = start_token->type == TOKEN_IF ? BRANCH_IF : BRANCH_WHILE,
-        .start_label = ctx->current_label++,
-        .end_label = ctx->current_label++,
-    });
-
-    if (start_token->type == TOKEN_WHILE)
-        vscc_push2(ctx->current_function, O_DECLABEL, branch->start_label);
+    struct vscc_register *dest = get_variable(ctx, intern(ctx, dst_token));
 
     switch (src_token->type) {
     case TOKEN_LITERAL:
-        vscc_push0(ctx->current_function, O_CMP, dest, atoi(src_token->contents));
+        vscc_push0(ctx->current_function, O_CMP, dest, literal_value(ctx, src_token, false));
+        break;
+    case TOKEN_IDENTIFIER:
+        vscc_push1(ctx->current_function, O_CMP, dest, get_variable(ctx, intern(ctx, src_token)));
         break;
     default:
         /* to-do: fail? */
@@ -332,47 +482,535 @@ static void parse_conditional(struct pybuild_context *ctx, struct lexer_token *s
 
     switch (operation_token->type) {
     case TOKEN_EQUALS:
-        vscc_push2(ctx->current_function, O_JNE, branch->end_label);
+        vscc_push2(ctx->current_function, when ? O_JE : O_JNE, label);
         break;
     case TOKEN_NEQUALS:
-        vscc_push2(ctx->current_function, O_JE, branch->end_label);
+        vscc_push2(ctx->current_function, when ? O_JNE : O_JE, label);
         break;
     case TOKEN_GREATERTHAN:
-        vscc_push2(ctx->current_function, O_JG, branch->end_label);
+        if (when)
+            vscc_push2(ctx->current_function, O_JG, label);
+        else {
+            vscc_push2(ctx->current_function, O_JL, label);
+            vscc_push2(ctx->current_function, O_JE, label);
+        }
         break;
     case TOKEN_LESSTHAN:
-        vscc_push2(ctx->current_function, O_JL, branch->end_label);
+        if (when)
+            vscc_push2(ctx->current_function, O_JL, label);
+        else {
+            vscc_push2(ctx->current_function, O_JG, label);
+            vscc_push2(ctx->current_function, O_JE, label);
+        }
         break;
     default:
         /* to-do: fail? */
         break;
     }
+}
+
+static struct vscc_instruction *last_instruction(struct vscc_function *fn)
+{
+    struct vscc_instruction *insn = fn->instruction_stream;
+    while (insn && insn->next)
+        insn = insn->next;
+    return insn;
+}
+
+/*
+ * instrumented builds bump one global per site, see pyprofile.h
+ */
+static void emit_counter(struct pybuild_context *ctx, size_t site)
+{
+    char name[64];
+    pyprofile_counter_name(name, sizeof(name), ctx->current_function->symbol_name, site);
+    vscc_push0(ctx->current_function, O_ADD, vscc_alloc_global(&ctx->vscc_ctx, name, sizeof(uint64_t), true), 1);
+}
+
+/*
+ * cut the body of a cold arm out of the function, it runs behind the 
+ * function from 'start_label' and jumps back to 'resume'
+ */
+static void move_cold(struct pybuild_context *ctx, struct pybuild_branch *branch, int resume)
+{
+    struct vscc_function block = { 0 };
+    vscc_push2(&block, O_DECLABEL, branch->start_label);
+    block.instruction_stream->next = branch->cold_after->next;
+    branch->cold_after->next = NULL;
+    vscc_push2(&block, O_JMP, resume);
+
+    struct vscc_instruction **tail = &ctx->cold;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = block.instruction_stream;
+    ctx->cold_arms++;
+}
+
+/*
+ * cold arms go behind everything else, falling off the end skips them
+ */
+static void place_cold(struct pybuild_context *ctx)
+{
+    if (!ctx->cold)
+        return;
+
+    struct vscc_instruction *tail = last_instruction(ctx->current_function);
+    int resume = ctx->current_label++;
+    bool falls_through = !tail || tail->opcode != O_RET;
+
+    if (falls_through)
+        vscc_push2(ctx->current_function, O_JMP, resume);
+
+    tail = last_instruction(ctx->current_function);
+    if (tail)
+        tail->next = ctx->cold;
+    else
+        ctx->current_function->instruction_stream = ctx->cold;
+    ctx->cold = NULL;
+
+    if (falls_through)
+        vscc_push2(ctx->current_function, O_DECLABEL, resume);
+}
+
+struct switch_case {
+    int64_t value;
+    int label;
+};
+
+static struct lexer_token *end_of_line(struct lexer_token *token)
+{
+    while (token->type != TOKEN_EOF && token->type != TOKEN_NEWLINE)
+        token++;
+    return token;
+}
+
+/*
+ * 'name == literal :' starting at 'token'
+ */
+static bool is_case_test(struct pybuild_context *ctx, struct lexer_token *token, char *name)
+{
+    return token->type == TOKEN_IDENTIFIER && intern(ctx, token) == name && next(token)->type == TOKEN_EQUALS && 
+        next(next(token))->type == TOKEN_LITERAL && next(next(next(token)))->type == TOKEN_COLON;
+}
+
+static int compare_case(const void *a, const void *b)
+{
+    const struct switch_case *x = a;
+    const struct switch_case *y = b;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/*
+ * look ahead from an 'if name == literal:' line for elif arms testing the same 
+ * name against other literals, returns the number of arms or 0 if the chain 
+ * is not a switch
+ */
+static size_t collect_cases(struct pybuild_context *ctx, struct lexer_token *if_token, struct switch_case **cases, bool *has_else)
+{
+    char *name = intern(ctx, next(if_token));
+    size_t count = 0;
+    size_t capacity = 16;
+
+    int tabs = 0;
+    for (struct lexer_token *token = if_token; token != ctx->tokens->tokens && (token - 1)->type == TOKEN_TAB; token--)
+        tabs++;
+
+    *has_else = false;
+    *cases = pyperf_malloc(capacity * sizeof(struct switch_case));
+    (*cases)[count++] = (struct switch_case){ .value = literal_value(ctx, next(next(next(if_token))), false) };
+
+    for (struct lexer_token *line = end_of_line(if_token); line->type != TOKEN_EOF; line = end_of_line(line)) {
+        line++;
+
+        int line_tabs = 0;
+        struct lexer_token *first = line;
+        for (; first->type == TOKEN_TAB; first++)
+            line_tabs++;
+
+        /* blank lines, comments and the bodies of the arms */
+        if (first->type == TOKEN_NEWLINE || first->type == TOKEN_COMMENT || line_tabs > tabs)
+            continue;
+        if (line_tabs < tabs || first->type != TOKEN_ELIF) {
+            *has_else = line_tabs == tabs && first->type == TOKEN_ELSE;
+            break;
+        }
+
+        if (!is_case_test(ctx, next(first), name)) {
+            count = 0;
+            break;
+        }
+
+        /* python takes the first of two equal arms, leave those to the plain chain */
+        int64_t value = literal_value(ctx, next(next(next(first))), false);
+        bool duplicate = false;
+        for (size_t i = 0; i < count; i++)
+            duplicate |= (*cases)[i].value == value;
+        if (duplicate) {
+            count = 0;
+            break;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            *cases = pyperf_realloc(*cases, capacity * sizeof(struct switch_case));
+        }
+        (*cases)[count++] = (struct switch_case){ .value = value };
+    }
+
+    if (count < SWITCH_MIN_CASES) {
+        free(*cases);
+        *cases = NULL;
+        return 0;
+    }
+    return count;
+}
+
+/*
+ * binary search over sorted cases, 'lo' and 'hi' bound the values 'reg' can
+ * still hold on this path
+ */
+static void emit_dispatch(struct pybuild_context *ctx, struct vscc_register *reg, struct switch_case *cases, size_t count, 
+    int64_t lo, int64_t hi, int default_label)
+{
+    if (count <= SWITCH_LINEAR_CASES) {
+        /* every value left is a case, the last one needs no compare */
+        bool complete = lo != INT64_MIN && hi != INT64_MAX && count == (uint64_t)hi - (uint64_t)lo + 1;
+
+        for (size_t i = 0; i < count; i++) {
+            if (complete && i + 1 == count) {
+                vscc_push2(ctx->current_function, O_JMP, cases[i].label);
+                return;
+            }
+            vscc_push0(ctx->current_function, O_CMP, reg, cases[i].value);
+            vscc_push2(ctx->current_function, O_JE, cases[i].label);
+        }
+        vscc_push2(ctx->current_function, O_JMP, default_label);
+        return;
+    }
+
+    size_t mid = count / 2;
+    int right_label = ctx->current_label++;
+
+    vscc_push0(ctx->current_function, O_CMP, reg, cases[mid].value);
+    vscc_push2(ctx->current_function, O_JE, cases[mid].label);
+    vscc_push2(ctx->current_function, O_JG, right_label);
+    emit_dispatch(ctx, reg, cases, mid, lo, cases[mid].value - 1, default_label);
+
+    vscc_push2(ctx->current_function, O_DECLABEL, right_label);
+    emit_dispatch(ctx, reg, cases + mid + 1, count - mid - 1, cases[mid].value + 1, hi, default_label);
+}
+
+/*
+ * lower a whole if/elif chain on one register up front, dense value sets are
+ * range checked first so fully covered runs skip their final compare
+ */
+static struct pybuild_switch *parse_switch(struct pybuild_context *ctx, struct lexer_token *if_token, int exit_label)
+{
+    struct switch_case *cases;
+    bool has_else;
+    size_t count = collect_cases(ctx, if_token, &cases, &has_else);
+    if (count == 0)
+        return NULL;
+
+    struct pybuild_switch *sw = pyperf_calloc(1, sizeof(struct pybuild_switch));
+    sw->labels = pyperf_malloc(count * sizeof(int));
+    sw->count = count;
+    sw->default_label = has_else ? ctx->current_label++ : exit_label;
+
+    for (size_t i = 0; i < count; i++)
+        cases[i].label = sw->labels[i] = ctx->current_label++;
+    qsort(cases, count, sizeof(struct switch_case), compare_case);
+
+    struct vscc_register *reg = get_variable(ctx, intern(ctx, next(if_token)));
+    int64_t min = cases[0].value;
+    int64_t max = cases[count - 1].value;
+
+    if ((uint64_t)max - (uint64_t)min < 2 * count) {
+        vscc_push0(ctx->current_function, O_CMP, reg, min);
+        vscc_push2(ctx->current_function, O_JL, sw->default_label);
+        vscc_push0(ctx->current_function, O_CMP, reg, max);
+        vscc_push2(ctx->current_function, O_JG, sw->default_label);
+        emit_dispatch(ctx, reg, cases, count, min, max, sw->default_label);
+    }
+    else
+        emit_dispatch(ctx, reg, cases, count, INT64_MIN, INT64_MAX, sw->default_label);
+
+    vscc_push2(ctx->current_function, O_DECLABEL, sw->labels[0]);
+    free(cases);
+    return sw;
+}
+
+static void parse_conditional(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
+{
+    struct lexer_token *dst_token = next(start_token);
+    struct lexer_token *operation_token = next(dst_token);
+    struct lexer_token *src_token = next(operation_token);
+
+    struct pybuild_branch branch = {
+        .type = start_token->type == TOKEN_WHILE ? BRANCH_WHILE : BRANCH_IF,
+        .start_label = ctx->current_label++,
+        .end_label = ctx->current_label++,
+        .exit_label = -1,
+        .cases = NULL,
+        .condition = dst_token
+    };
+
+    /* sites are numbered the same whether counted or read back */
+    size_t site = ctx->profile_site++;
+
+    /*
+     * elif continues the chain the previous arm was closed into
+     */
+    if (start_token->type == TOKEN_ELIF) {
+        FAIL_IF(ctx->chain == NULL, "err: elif without if\n");
+        branch.exit_label = ctx->chain->exit_label;
+        branch.cases = ctx->chain->cases;
+        free(ctx->chain);
+        ctx->chain = NULL;
+    }
+    else if (start_token->type == TOKEN_IF && is_case_test(ctx, dst_token, intern(ctx, dst_token))) {
+        branch.exit_label = ctx->current_label++;
+        branch.cases = parse_switch(ctx, start_token, branch.exit_label);
+    }
+
+    /*
+     * arms taken rarely are entered by jumping away, loops running their 
+     * body at least once per entry test at the bottom
+     */
+    if (ctx->profile_function && !branch.cases) {
+        uint64_t reached = pyprofile_count(ctx->profile_function, PROFILE_REACHED(site));
+        uint64_t taken = pyprofile_count(ctx->profile_function, PROFILE_TAKEN(site));
+
+        if (branch.type == BRANCH_WHILE)
+            branch.rotated = reached && taken * 2 >= reached;
+        else
+            branch.cold = reached && taken * PROFILE_COLD_RATIO < reached;
+    }
+
+    if (branch.rotated) {
+        branch.test_label = ctx->current_label++;
+        vscc_push2(ctx->current_function, O_JMP, branch.test_label);
+        vscc_push2(ctx->current_function, O_DECLABEL, branch.start_label);
+        ctx->rotated_loops++;
+    }
+    else if (start_token->type == TOKEN_WHILE)
+        vscc_push2(ctx->current_function, O_DECLABEL, branch.start_label);
+
+    if (ctx->instrument && !branch.cases)
+        emit_counter(ctx, PROFILE_REACHED(site));
+
+    if (branch.cases && start_token->type == TOKEN_ELIF)
+        vscc_push2(ctx->current_function, O_DECLABEL, branch.cases->labels[++branch.cases->current]);
+    else if (branch.cold) {
+        emit_condition(ctx, dst_token, operation_token, src_token, branch.start_label, true);
+        branch.cold_after = last_instruction(ctx->current_function);
+    }
+    else if (!branch.cases && !branch.rotated)
+        emit_condition(ctx, dst_token, operation_token, src_token, branch.end_label, false);
+
+    if (ctx->instrument)
+        emit_counter(ctx, PROFILE_TAKEN(site));
+
+    branch_push(&ctx->branch_queue, branch);
+    ctx->labelc++;
+}
+
+static void parse_else(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
+{
+    FAIL_IF(ctx->chain == NULL, "err: else without if\n");
+
+    struct pybuild_switch *sw = ctx->chain->cases;
+    if (sw) {
+        vscc_push2(ctx->current_function, O_DECLABEL, sw->default_label);
+        free(sw->labels);
+        free(sw);
+    }
+
+    branch_push(&ctx->branch_queue, (struct pybuild_branch){
+        .type = BRANCH_ELSE,
+        .end_label = ctx->chain->exit_label,
+        .exit_label = -1
+    });
+
+    free(ctx->chain);
+    ctx->chain = NULL;
+    ctx->labelc++;
+}
+
+/*
+ * for name in range([start,] stop[, step]), lowered to a rotated loop so each
+ * iteration runs a single compare and back-edge. the loop runs on a hidden 
+ * counter copied into 'name' at the top of every iteration, so the body may 
+ * assign 'name' and the loop leaves it at the last value (untouched when the 
+ * range is empty), as in python
+ */
+static void parse_for(struct pybuild_context *ctx, struct lexer_token *start_token, struct lexer_token *end_token, bool *status)
+{
+    struct lexer_token *counter_token = next(start_token);
+    struct lexer_token *in_token = next(counter_token);
+    struct lexer_token *range_token = next(in_token);
+
+    FAIL_IF(counter_token->type != TOKEN_IDENTIFIER || strcmp(TEXT(in_token), "in") != 0 || strcmp(TEXT(range_token), "range") != 0 || 
+        next(range_token)->type != TOKEN_OPEN_PAREN, "err: expected 'for <name> in range(...)'\n");
+
+    /*
+     * operands are names or (optionally negated) literals
+     */
+    struct lexer_token *operands[3];
+    bool negated[3];
+    int operandc = 0;
+
+    for (struct lexer_token *token = next(next(range_token)); token != end_token && token->type != TOKEN_CLOSE_PAREN; token = next(token)) {
+        if (token->type == TOKEN_COMMA)
+            continue;
+
+        bool negate = token->type == TOKEN_NONE && strcmp(TEXT(token), "-") == 0;
+        if (negate)
+            token = next(token);
+
+        FAIL_IF(operandc == 3 || !(token->type == TOKEN_LITERAL || (token->type == TOKEN_IDENTIFIER && !negate)), 
+            "err: unexpected range operand '%s'\n", TEXT(token));
+        negated[operandc] = negate;
+        operands[operandc++] = token;
+    }
+
+    FAIL_IF(operandc == 0, "err: range expects at least one operand\n");
+    FAIL_IF(operandc == 3 && operands[2]->type != TOKEN_LITERAL, "err: range step must be a literal\n");
+
+    struct lexer_token *first = operandc > 1 ? operands[0] : NULL;
+    struct lexer_token *stop = operands[operandc > 1];
+    int64_t step = operandc == 3 ? literal_value(ctx, operands[2], negated[2]) : 1;
+    FAIL_IF(step == 0, "err: range step must not be zero\n");
+
+    struct pybuild_branch branch = {
+        .type = BRANCH_FOR,
+        .start_label = ctx->current_label++,
+        .end_label = ctx->current_label++,
+        .counter = vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx), ctx->default_size, false, true),
+        .bound = NULL,
+        .bound_value = 0,
+        .step = step
+    };
+
+    /*
+     * bounds are evaluated once, a named stop is copied so the body may reassign it
+     */
+    if (stop->type == TOKEN_IDENTIFIER) {
+        branch.bound = vscc_alloc(ctx->current_function, generate_name_for_local_global(ctx), ctx->default_size, false, true);
+        vscc_push1(ctx->current_function, O_STORE, branch.bound, get_variable(ctx, intern(ctx, stop)));
+    }
+    else
+        branch.bound_value = literal_value(ctx, stop, negated[operandc > 1]);
+
+    if (first && first->type == TOKEN_IDENTIFIER)
+        vscc_push1(ctx->current_function, O_STORE, branch.counter, get_variable(ctx, intern(ctx, first)));
+    else
+        vscc_push0(ctx->current_function, O_STORE, branch.counter, first ? literal_value(ctx, first, negated[0]) : 0);
+
+    struct vscc_register *name = get_variable(ctx, intern(ctx, counter_token));
+    set_string(ctx, name, false);
+
+    branch_push(&ctx->branch_queue, branch);
+    vscc_push2(ctx->current_function, O_JMP, branch.end_label);
+    vscc_push2(ctx->current_function, O_DECLABEL, branch.start_label);
+    vscc_push1(ctx->current_function, O_STORE, name, branch.counter);
 
     ctx->labelc++;
 }
 
-bool parse(struct pybuild_context *ctx, struct lexer_token *lex_tokens)
+/*
+ * close the innermost block, 'continued' when an elif or else arm follows it
+ */
+static void close_branch(struct pybuild_context *ctx, bool continued)
+{
+    struct pybuild_branch *branch = branch_pop(&ctx->branch_queue);
+    ctx->labelc--;
+
+    switch (branch->type) {
+    case BRANCH_IF:
+        if (continued) {
+            if (branch->exit_label < 0)
+                branch->exit_label = ctx->current_label++;
+            if (branch->cold)
+                move_cold(ctx, branch, branch->exit_label);
+            else
+                vscc_push2(ctx->current_function, O_JMP, branch->exit_label);
+            if (!branch->cases)
+                vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
+
+            ctx->chain = branch;
+            return;
+        }
+
+        if (branch->cold)
+            move_cold(ctx, branch, branch->end_label);
+
+        if (branch->cases) {
+            if (branch->cases->default_label != branch->exit_label)
+                vscc_push2(ctx->current_function, O_DECLABEL, branch->cases->default_label);
+            free(branch->cases->labels);
+            free(branch->cases);
+        }
+        else
+            vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
+
+        if (branch->exit_label >= 0)
+            vscc_push2(ctx->current_function, O_DECLABEL, branch->exit_label);
+        break;
+    case BRANCH_WHILE:
+        if (branch->rotated) {
+            vscc_push2(ctx->current_function, O_DECLABEL, branch->test_label);
+            emit_condition(ctx, branch->condition, next(branch->condition), next(next(branch->condition)), branch->start_label, true);
+        }
+        else
+            vscc_push2(ctx->current_function, O_JMP, branch->start_label);
+        vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
+        break;
+    case BRANCH_FOR:
+        if (branch->step > 0)
+            vscc_push0(ctx->current_function, O_ADD, branch->counter, branch->step);
+        else
+            vscc_push0(ctx->current_function, O_SUB, branch->counter, -branch->step);
+
+        vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
+        if (branch->bound)
+            vscc_push1(ctx->current_function, O_CMP, branch->counter, branch->bound);
+        else
+            vscc_push0(ctx->current_function, O_CMP, branch->counter, branch->bound_value);
+        vscc_push2(ctx->current_function, branch->step > 0 ? O_JL : O_JG, branch->start_label);
+        break;
+    default:
+        vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
+        break;
+    }
+
+    free(branch);
+}
+
+/*
+ * parse every line in [first, last), 'def' is set while inside a function body
+ */
+static bool parse_lines(struct pybuild_context *ctx, struct lexer_token *first, struct lexer_token *last, bool def)
 {
-    int expected_tabs = 0;
     bool status = true;
-    bool def = false;
-    
+
     struct lexer_token *stop_token;
-    for (struct lexer_token *token = lex_tokens; token; token = stop_token->next) {
+    for (struct lexer_token *token = first; token < last && token->type != TOKEN_EOF; token = next(stop_token)) {
+        stop_token = token;
         if (token->type == TOKEN_NEWLINE)
             continue;
     
         /* 
          * loop thru line 
          */
-        for (stop_token = token; stop_token->next && stop_token->type != TOKEN_NEWLINE; stop_token = stop_token->next);
+        for (; stop_token->type != TOKEN_EOF && stop_token->type != TOKEN_NEWLINE; stop_token++);
 
         /*
          * find number of tabs
          */
         int tabs_found = 0;
         struct lexer_token *start_token;
-        for (start_token = token; start_token != stop_token; start_token = start_token->next) {
+        for (start_token = token; start_token != stop_token; start_token++) {
             if (start_token->type != TOKEN_TAB)
                 break;
             tabs_found++;
@@ -384,30 +1022,19 @@ bool parse(struct pybuild_context *ctx, struct lexer_token *lex_tokens)
         if (start_token->type == TOKEN_COMMENT)
             continue;
 
-        if (tabs_found == 0 && def)
-            def = false;
-
         /*
-         * figure out tab information
+         * figure out tab information, a dedent may close several blocks at once
          */
-        if (ctx->labelc + 1 != tabs_found && def) {
-            struct pybuild_branch *branch = branch_pop(&ctx->branch_queue);
-            if (branch->type == BRANCH_WHILE)
-                vscc_push2(ctx->current_function, O_JMP, branch->start_label);
-            vscc_push2(ctx->current_function, O_DECLABEL, branch->end_label);
-            ctx->labelc--;
-            free(branch);
-        }
+        while (def && ctx->labelc > 0 && ctx->labelc + 1 > tabs_found)
+            close_branch(ctx, ctx->labelc == tabs_found && (start_token->type == TOKEN_ELIF || start_token->type == TOKEN_ELSE));
+
+        if (tabs_found == 0 && def)
+            def = false;
 
         /*
-         * start parsing 
+         * start parsing, definitions were handled before any body
          */
         switch (start_token->type) {
-        case TOKEN_DEF:
-            def = true;
-            ctx->current_label = 0;
-            parse_definition(ctx, start_token, stop_token, &status);
-            break;
         case TOKEN_IDENTIFIER:
             parse_identifier(ctx, start_token, stop_token, &status);
             break;
@@ -416,42 +1043,491 @@ bool parse(struct pybuild_context *ctx, struct lexer_token *lex_tokens)
             break;
         case TOKEN_WHILE:
         case TOKEN_IF:
+        case TOKEN_ELIF:
             parse_conditional(ctx, start_token, stop_token, &status);
             break;
+        case TOKEN_ELSE:
+            parse_else(ctx, start_token, stop_token, &status);
+            break;
+        case TOKEN_FOR:
+            parse_for(ctx, start_token, stop_token, &status);
+            break;
         default:
             /* to-do: fail? */
             break;
         }
     }
 
-    /* if (ctx->labelc != 0) {
-        ctx->labelc--;
-        vscc_push2(ctx->current_function, O_DECLABEL, ctx->current_label++);
-    } */
+    /*
+     * close whatever the function left open
+     */
+    while (ctx->labelc > 0)
+        close_branch(ctx, false);
 
     return status;
 }
 
-static uintptr_t get_offset_from_symbol(struct vscc_symbol *symbols, char *symbol_name)
+/*
+ * a def line and the body following it, up to the next def line
+ */
+struct parse_chunk {
+    struct lexer_token *def;
+    struct lexer_token *stop;
+    struct lexer_token *body;
+    struct lexer_token *end;
+
+    struct vscc_function *fn;
+    struct pybuild_context *worker;
+    bool status;
+};
+
+struct parse_job {
+    struct pybuild_context *ctx;
+    struct parse_chunk *chunks;
+};
+
+static bool parse_body(struct pybuild_context *ctx, struct parse_chunk *chunk)
 {
-    for (struct vscc_symbol *symbol = symbols; symbol; symbol = symbol->next) {
-        if (strstr(symbol->symbol_name, symbol_name) != NULL)
-            return symbol->offset;
+    ctx->current_function = chunk->fn;
+    ctx->current_label = 0;
+    ctx->autogen = 0;
+    ctx->profile_site = 0;
+    ctx->profile_function = ctx->profile ? pyprofile_function(ctx->profile, chunk->fn->symbol_name) : NULL;
+
+    pysym_clear(&ctx->locals);
+    for (struct vscc_register *reg = chunk->fn->register_stream; reg; reg = reg->next)
+        if (reg->is_parameter)
+            pysym_put(&ctx->locals, intern_str(ctx, reg->symbol_name), reg);
+
+    if (ctx->instrument)
+        emit_counter(ctx, PROFILE_ENTRY);
+
+    bool status = parse_lines(ctx, chunk->body, chunk->end, true);
+    place_cold(ctx);
+    return status;
+}
+
+/*
+ * bodies only touch their own function, everything else a worker creates 
+ * (strings, globals, queued writes) stays with it until the merge
+ */
+static void parse_worker(void *arg, size_t index)
+{
+    struct parse_job *job = arg;
+    struct parse_chunk *chunk = &job->chunks[index];
+
+    struct pybuild_context *worker = pyperf_calloc(1, sizeof(struct pybuild_context));
+    worker->parent = job->ctx;
+    worker->tokens = job->ctx->tokens;
+    worker->default_size = job->ctx->default_size;
+    worker->instrument = job->ctx->instrument;
+    worker->profile = job->ctx->profile;
+
+    chunk->worker = worker;
+    chunk->status = parse_body(worker, chunk);
+}
+
+static void merge_worker(struct pybuild_context *ctx, struct pybuild_context *worker, struct vscc_register ***global_tail)
+{
+    /* globals keep the order a single pass would have created them in */
+    if (worker->vscc_ctx.global_stream) {
+        **global_tail = worker->vscc_ctx.global_stream;
+        for (struct vscc_register *reg = worker->vscc_ctx.global_stream; reg; reg = reg->next) {
+            pysym_put(&ctx->globals, intern_str(ctx, reg->symbol_name), reg);
+            *global_tail = &reg->next;
+        }
+    }
+
+    /* build() finds write targets by pointer, so they are interned again here */
+    while (worker->memcpy_queue) {
+        struct pybuild_memcpy *blk = worker->memcpy_queue;
+        worker->memcpy_queue = blk->next;
+
+        blk->dst = intern_str(ctx, blk->dst);
+        blk->next = ctx->memcpy_queue;
+        ctx->memcpy_queue = blk;
+    }
+
+    while (worker->arguments) {
+        struct pybuild_argument *arg = worker->arguments;
+        worker->arguments = arg->next;
+        arg->next = ctx->arguments;
+        ctx->arguments = arg;
+    }
+
+    while (worker->deferred) {
+        struct pybuild_deferred *deferred = worker->deferred;
+        worker->deferred = deferred->next;
+        deferred->name = intern_str(ctx, deferred->name);
+        deferred->next = ctx->deferred;
+        ctx->deferred = deferred;
+    }
+
+    ctx->cold_arms += worker->cold_arms;
+    ctx->rotated_loops += worker->rotated_loops;
+
+    pysym_free(&worker->locals, false);
+    pysym_free(&worker->globals, false);
+    pysym_free(&worker->functions, false);
+    pysym_free(&worker->builtins, false);
+    pysym_free(&worker->string_values, false);
+    pysym_free(&worker->strings, true);
+    free(worker);
+}
+
+static struct vscc_register *nth_parameter(struct vscc_function *fn, size_t index)
+{
+    for (struct vscc_register *reg = fn->register_stream; reg; reg = reg->next)
+        if (reg->is_parameter && index-- == 0)
+            return reg;
+    return NULL;
+}
+
+static void free_inference(struct pybuild_context *ctx)
+{
+    while (ctx->arguments) {
+        struct pybuild_argument *next = ctx->arguments->next;
+        free(ctx->arguments);
+        ctx->arguments = next;
+    }
+
+    while (ctx->deferred) {
+        struct pybuild_deferred *next = ctx->deferred->next;
+        free(ctx->deferred);
+        ctx->deferred = next;
+    }
+}
+
+/*
+ * an untyped parameter holds a string when its callers only ever pass it 
+ * strings, directly or through their own untyped parameters. deferred 
+ * builtins switch to their string variant then, callers disagreeing fail
+ */
+#define PASSED_INT 1
+#define PASSED_STRING 2
+
+static bool infer_parameters(struct pybuild_context *ctx)
+{
+    bool status = true;
+    struct pysym_table passed = { 0 };
+
+    for (bool changed = ctx->deferred != NULL; changed;) {
+        changed = false;
+        for (struct pybuild_argument *arg = ctx->arguments; arg; arg = arg->next) {
+            struct vscc_register *param = nth_parameter(arg->callee, arg->index);
+            if (param == NULL)
+                continue;
+
+            uintptr_t kinds = (uintptr_t)pysym_get(&passed, (const char*)param);
+            uintptr_t value = arg->value == VALUE_STRING ? PASSED_STRING : arg->value == VALUE_INT ? PASSED_INT : 
+                (uintptr_t)pysym_get(&passed, (const char*)arg->value);
+
+            if ((kinds | value) != kinds) {
+                pysym_put(&passed, (const char*)param, (void*)(kinds | value));
+                changed = true;
+            }
+        }
+    }
+
+    for (struct pybuild_deferred *deferred = ctx->deferred; deferred; deferred = deferred->next) {
+        uintptr_t kinds = (uintptr_t)pysym_get(&passed, (const char*)deferred->parameter);
+        if (kinds == (PASSED_INT | PASSED_STRING)) {
+            printf("err: parameter '%s' of '%s' is passed both strings and integers, give it a type to use it with '%s'\n", 
+                deferred->parameter->symbol_name, deferred->fn->symbol_name, deferred->name);
+            status = false;
+        }
+        else if (kinds == PASSED_STRING) {
+            deferred->call->imm1 = (uintptr_t)get_builtin(ctx, deferred->name, PYIMPL_FIRST_ARG_STRING);
+        }
+        ctx->inferred++;
+    }
+
+    pysym_free(&passed, false);
+    free_inference(ctx);
+    return status;
+}
+
+bool parse(struct pybuild_context *ctx, struct lexer_stream *stream)
+{
+    bool status = true;
+
+    ctx->tokens = stream;
+
+    /*
+     * index everything which already exists (python implementations and environmental variables)
+     */
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn; fn = fn->next)
+        pysym_put(&ctx->functions, intern_str(ctx, fn->symbol_name), fn);
+    for (struct vscc_register *reg = ctx->vscc_ctx.global_stream; reg; reg = reg->next)
+        pysym_put(&ctx->globals, intern_str(ctx, reg->symbol_name), reg);
+
+    /*
+     * split at every def line
+     */
+    struct parse_chunk *chunks = NULL;
+    size_t chunkc = 0;
+    size_t capacity = 0;
+
+    for (struct lexer_token *line = stream->tokens; line->type != TOKEN_EOF;) {
+        struct lexer_token *token = line;
+        while (token->type == TOKEN_TAB)
+            token++;
+
+        struct lexer_token *stop_token = token;
+        for (; stop_token->type != TOKEN_EOF && stop_token->type != TOKEN_NEWLINE; stop_token++);
+
+        if (token->type == TOKEN_DEF) {
+            if (chunkc == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                chunks = pyperf_realloc(chunks, capacity * sizeof(struct parse_chunk));
+            }
+            if (chunkc)
+                chunks[chunkc - 1].end = line;
+            chunks[chunkc++] = (struct parse_chunk){ .def = token, .stop = stop_token, .body = next(stop_token), .status = true };
+        }
+        line = next(stop_token);
+    }
+
+    /*
+     * anything before the first definition, then every signature so calls
+     * resolve no matter where their callee is defined
+     */
+    status = parse_lines(ctx, stream->tokens, chunkc ? chunks[0].def : stream->tokens + stream->count, false);
+
+    for (size_t i = 0; i < chunkc; i++) {
+        if (i + 1 == chunkc)
+            chunks[i].end = stream->tokens + stream->count;
+
+        ctx->current_label = 0;
+        parse_definition(ctx, chunks[i].def, chunks[i].stop, &status);
+        chunks[i].fn = ctx->current_function;
+    }
+
+    if (!status) {
+        free(chunks);
+        return false;
+    }
+
+    /*
+     * bodies, on the pool when there is more than one thread
+     */
+    if (ctx->threads == 1 || chunkc < 2) {
+        for (size_t i = 0; i < chunkc; i++)
+            status = parse_body(ctx, &chunks[i]) && status;
+    }
+    else {
+        struct parse_job job = { .ctx = ctx, .chunks = chunks };
+        pypool_run(ctx->threads, chunkc, parse_worker, &job);
+
+        struct vscc_register **global_tail = &ctx->vscc_ctx.global_stream;
+        while (*global_tail)
+            global_tail = &(*global_tail)->next;
+
+        for (size_t i = 0; i < chunkc; i++) {
+            status = chunks[i].status && status;
+            merge_worker(ctx, chunks[i].worker, &global_tail);
+        }
+    }
+
+    free(chunks);
+    return status && infer_parameters(ctx);
+}
+
+static uintptr_t get_offset_from_symbol(struct pybuild_context *ctx, char *symbol_name)
+{
+    /* symbol_name must be interned */
+    struct vscc_symbol *symbol = pysym_get(&ctx->symbols, symbol_name);
+    return symbol ? symbol->offset : -1;
+}
+
+static uintptr_t get_entry_offset(struct pybuild_context *ctx)
+{
+    if (ctx->entry_name == NULL)
+        return 0;
+
+    uintptr_t offset = get_offset_from_symbol(ctx, intern_str(ctx, ctx->entry_name));
+    if (offset != -1)
+        return offset;
+
+    /* no exact match, fall back to the first function containing the entry name */
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn; fn = fn->next) {
+        if (strstr(fn->symbol_name, ctx->entry_name) != NULL)
+            return get_offset_from_symbol(ctx, intern_str(ctx, fn->symbol_name));
     }
     return -1;
 }
 
+static int compare_memcpy(const void *a, const void *b)
+{
+    const struct pybuild_memcpy *x = *(const struct pybuild_memcpy**)a;
+    const struct pybuild_memcpy *y = *(const struct pybuild_memcpy**)b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
 uintptr_t build(struct pybuild_context *ctx)
 {
     struct vscc_codegen_interface interface = { 0 };
     vscc_codegen_implement_x64(&interface, ABI_SYSV);
 
-    vscc_codegen(&ctx->vscc_ctx, &interface, &ctx->compiled_data, true);
+    /*
+     * large programs are generated one function per job, anything the link 
+     * step can not handle is generated again in one piece
+     */
+    pyperf_begin(ctx->perf, "codegen");
+    if (ctx->threads == 1 || !pycodegen_parallel(&ctx->vscc_ctx, &ctx->compiled_data, ctx->threads))
+        vscc_codegen(&ctx->vscc_ctx, &interface, &ctx->compiled_data, true);
+    pyperf_end(ctx->perf);
+
+    /*
+     * keep stack slots in registers, then clean up what codegen and allocation 
+     * left behind. an image that can not be decoded is left untouched
+     */
+    if (ctx->optimize) {
+        struct pyasm_image image;
+        size_t length = ctx->compiled_data.length;
+        pyperf_begin(ctx->perf, "passes");
+
+        if (pyasm_image_init(&image, &ctx->compiled_data, &ctx->vscc_ctx)) {
+            pyreg_allocate(&image, &ctx->regalloc);
+            if (!pyasm_relink(&image))
+                memset(&ctx->regalloc, 0, sizeof(ctx->regalloc));
+        }
+        pyasm_image_free(&image);
+
+        if (pyasm_image_init(&image, &ctx->compiled_data, &ctx->vscc_ctx)) {
+            pypeep_optimize(&image, &ctx->peephole);
+            if (!pyasm_relink(&image))
+                memset(&ctx->peephole, 0, sizeof(ctx->peephole));
+        }
+        pyasm_image_free(&image);
+
+        ctx->bytes_saved = (int64_t)length - (int64_t)ctx->compiled_data.length;
+        pyperf_end(ctx->perf);
+    }
+
+    pyperf_begin(ctx->perf, "link");
+    uintptr_t entry_offset = build_linked(ctx);
+    pyperf_end(ctx->perf);
+    return entry_offset;
+}
 
+bool build_requires_natives(const struct vscc_function *fn)
+{
+    /* the builtins themselves are always there, only their callers count */
+    if (pyimpl_requires_native(fn->symbol_name))
+        return false;
+
+    for (const struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next)
+        if (insn->opcode == O_CALL && pyimpl_requires_native(((struct vscc_function*)insn->imm1)->symbol_name))
+            return true;
+    return false;
+}
+
+uintptr_t build_linked(struct pybuild_context *ctx)
+{
+    /*
+     * runtime routines become machine code first, that moves everything after them
+     */
+    ctx->natives = pynative_apply(&ctx->compiled_data, &ctx->vscc_ctx);
+    pyimpl_link(&ctx->compiled_data);
+
+    /* a heap without its machine code would silently do nothing */
+    bool requires = ctx->requires_natives;
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn && !requires; fn = fn->next)
+        requires = build_requires_natives(fn);
+
+    ctx->natives_missing = requires && ctx->natives == 0;
+    if (ctx->natives_missing) {
+        printf("err: alloc, free and store need machine code, which could not be added to this image\n");
+        return -1;
+    }
+
+    /*
+     * index symbols once, every lookup after this is exact
+     */
+    pysym_clear(&ctx->symbols);
+    for (struct vscc_symbol *symbol = ctx->compiled_data.symbols; symbol; symbol = symbol->next)
+        pysym_put(&ctx->symbols, intern_str(ctx, symbol->symbol_name), symbol);
+
+    /*
+     * resolve every queued write, then apply them in a single pass ordered by offset
+     */
+    size_t count = 0;
+    for (struct pybuild_memcpy *blk = ctx->memcpy_queue; blk; blk = blk->next)
+        count++;
+
+    struct pybuild_memcpy **writes = pyperf_malloc(count * sizeof(struct pybuild_memcpy*));
+    count = 0;
     for (struct pybuild_memcpy *blk = ctx->memcpy_queue; blk; blk = blk->next) {
-        uintptr_t offset = get_offset_from_symbol(ctx->compiled_data.symbols, blk->dst);
-        memcpy(ctx->compiled_data.buffer + offset, blk->src, blk->length);
+        blk->offset = get_offset_from_symbol(ctx, blk->dst);
+        if (blk->offset != -1)
+            writes[count++] = blk;
+    }
+
+    qsort(writes, count, sizeof(struct pybuild_memcpy*), compare_memcpy);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t length = writes[i]->length;
+        memcpy(ctx->compiled_data.buffer + writes[i]->offset, &length, PYIMPL_STRING_PREFIX);
+        memcpy(ctx->compiled_data.buffer + writes[i]->offset + PYIMPL_STRING_PREFIX, writes[i]->src, writes[i]->length);
+    }
+    free(writes);
+
+    return get_entry_offset(ctx);
+}
+
+void build_free(struct pybuild_context *ctx)
+{
+    while (ctx->memcpy_queue) {
+        struct pybuild_memcpy *next = ctx->memcpy_queue->next;
+        if (ctx->memcpy_queue->owned)
+            free(ctx->memcpy_queue->src);
+        free(ctx->memcpy_queue);
+        ctx->memcpy_queue = next;
     }
 
-    return get_offset_from_symbol(ctx->compiled_data.symbols, ctx->entry_name);
+    while (ctx->branch_queue) {
+        struct pybuild_branch *next = ctx->branch_queue->next;
+        free(ctx->branch_queue);
+        ctx->branch_queue = next;
+    }
+
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream, *next_fn; fn; fn = next_fn) {
+        next_fn = fn->next;
+        for (struct vscc_instruction *insn = fn->instruction_stream, *next_insn; insn; insn = next_insn) {
+            next_insn = insn->next;
+            free(insn);
+        }
+        for (struct vscc_register *reg = fn->register_stream, *next_reg; reg; reg = next_reg) {
+            next_reg = reg->next;
+            free(reg);
+        }
+        free(fn);
+    }
+
+    for (struct vscc_register *reg = ctx->vscc_ctx.global_stream, *next; reg; reg = next) {
+        next = reg->next;
+        free(reg);
+    }
+
+    for (struct vscc_symbol *symbol = ctx->compiled_data.symbols, *next; symbol; symbol = next) {
+        next = symbol->next;
+        free(symbol);
+    }
+
+    free(ctx->compiled_data.buffer);
+    free(ctx->chain);
+
+    ctx->vscc_ctx = (struct vscc_context){ 0 };
+    ctx->compiled_data = (struct vscc_codegen_data){ 0 };
+    ctx->chain = NULL;
+
+    pysym_free(&ctx->locals, false);
+    pysym_free(&ctx->globals, false);
+    pysym_free(&ctx->functions, false);
+    pysym_free(&ctx->builtins, false);
+    pysym_free(&ctx->symbols, false);
+    pysym_free(&ctx->string_values, false);
+    free_inference(ctx);
+    ctx->inferred = 0;
+    pysym_free(&ctx->strings, true);
 }
\ No newline at end of file
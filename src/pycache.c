@@ -0,0 +1,196 @@
+#include "pycache.h"
+#include "pyperf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct cache_header {
+    char magic[4];
+    uint32_t format;
+    uint64_t key;
+    uint64_t entry_offset;
+    uint64_t code_end;
+    uint64_t length;
+    uint64_t symbolc;
+    int64_t compile_us;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/*
+ * the executable is hashed a word at a time, once per process. without 
+ * /proc only the version and format tell compilers apart
+ */
+static uint64_t compiler_hash(void)
+{
+    static uint64_t hash;
+    if (hash)
+        return hash;
+
+    uint64_t result = fnv1a(0xcbf29ce484222325ull, PYVSCC_VERSION, sizeof(PYVSCC_VERSION));
+    result = (result ^ PYCACHE_FORMAT) * 0x100000001b3ull;
+
+    struct stat st;
+    int fd = open("/proc/self/exe", O_RDONLY);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        const uint8_t *exe = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (exe != MAP_FAILED) {
+            size_t words = st.st_size / sizeof(uint64_t);
+            for (size_t i = 0; i < words; i++) {
+                uint64_t word;
+                memcpy(&word, exe + i * sizeof(uint64_t), sizeof(word));
+                result = (result ^ word) * 0x100000001b3ull;
+            }
+            result = fnv1a(result, exe + words * sizeof(uint64_t), st.st_size % sizeof(uint64_t));
+            munmap((void*)exe, st.st_size);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+
+    return hash = result;
+}
+
+uint64_t pycache_key(const char *source, size_t length, const char *flags)
+{
+    uint64_t hash = compiler_hash();
+
+    /* the terminators keep "ab" + "c" apart from "a" + "bc" */
+    hash = fnv1a(hash, flags, strlen(flags) + 1);
+    return fnv1a(hash, source, length);
+}
+
+static void cache_path(char *path, size_t size, const char *dir, uint64_t key)
+{
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+}
+
+bool pycache_load(const char *dir, uint64_t key, struct vscc_codegen_data *data, uintptr_t *entry_offset, size_t *code_end, int64_t *compile_us)
+{
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0)
+        size = ftell(f);
+    rewind(f);
+
+    /* 
+     * the code and every symbol (at least its offset and name length) have 
+     * to fit in the file, a truncated or corrupt entry is a miss
+     */
+    struct cache_header header;
+    if (size < (long)sizeof(header) || fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, PYCACHE_MAGIC, 4) != 0 || 
+        header.format != PYCACHE_FORMAT || header.key != key || header.entry_offset >= header.length || header.code_end > header.length ||
+        header.length > (uint64_t)size - sizeof(header) || 
+        header.symbolc > ((uint64_t)size - sizeof(header) - header.length) / (sizeof(uint64_t) + sizeof(uint16_t))) {
+        fclose(f);
+        return false;
+    }
+
+    /*
+     * symbols are stored as offset, name length and name
+     */
+    struct vscc_symbol *symbols = NULL;
+    struct vscc_symbol **tail = &symbols;
+    bool valid = true;
+
+    for (uint64_t i = 0; i < header.symbolc && valid; i++) {
+        uint64_t offset;
+        uint16_t name_length;
+        struct vscc_symbol *symbol = pyperf_calloc(1, sizeof(struct vscc_symbol));
+
+        valid = fread(&offset, sizeof(offset), 1, f) == 1 && fread(&name_length, sizeof(name_length), 1, f) == 1 &&
+            name_length < sizeof(symbol->symbol_name) && fread(symbol->symbol_name, 1, name_length, f) == name_length;
+
+        symbol->offset = offset;
+        *tail = symbol;
+        tail = &symbol->next;
+    }
+
+    uint8_t *buffer = pyperf_malloc(header.length);
+    valid = valid && buffer != NULL && fread(buffer, 1, header.length, f) == header.length;
+    fclose(f);
+
+    if (!valid) {
+        for (struct vscc_symbol *symbol = symbols, *next; symbol; symbol = next) {
+            next = symbol->next;
+            free(symbol);
+        }
+        free(buffer);
+        return false;
+    }
+
+    data->buffer = buffer;
+    data->length = header.length;
+    data->symbols = symbols;
+    *entry_offset = header.entry_offset;
+    *code_end = header.code_end;
+    *compile_us = header.compile_us;
+    return true;
+}
+
+bool pycache_store(const char *dir, uint64_t key, const struct vscc_codegen_data *data, uintptr_t entry_offset, size_t code_end, int64_t compile_us)
+{
+    char path[4096];
+    char temp[4096 + 32];
+
+    mkdir(dir, 0755);
+    cache_path(path, sizeof(path), dir, key);
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *f = fopen(temp, "wb");
+    if (f == NULL)
+        return false;
+
+    struct cache_header header = {
+        .magic = PYCACHE_MAGIC,
+        .format = PYCACHE_FORMAT,
+        .key = key,
+        .entry_offset = entry_offset,
+        .code_end = code_end,
+        .length = data->length,
+        .symbolc = 0,
+        .compile_us = compile_us
+    };
+
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        header.symbolc++;
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (struct vscc_symbol *symbol = data->symbols; symbol && written; symbol = symbol->next) {
+        uint64_t offset = symbol->offset;
+        uint16_t name_length = strlen(symbol->symbol_name);
+        written = fwrite(&offset, sizeof(offset), 1, f) == 1 && fwrite(&name_length, sizeof(name_length), 1, f) == 1 &&
+            fwrite(symbol->symbol_name, 1, name_length, f) == name_length;
+    }
+    written = written && fwrite(data->buffer, 1, data->length, f) == data->length;
+    written = fclose(f) == 0 && written;
+
+    /*
+     * readers only ever see complete files
+     */
+    if (!written || rename(temp, path) != 0) {
+        unlink(temp);
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
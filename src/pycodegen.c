@@ -0,0 +1,465 @@
+#include "pycodegen.h"
+#include "pyasm.h"
+#include "pypool.h"
+#include "pysym.h"
+#include "pyperf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * one function compiled in isolation: a shallow copy of it, one stub per 
+ * distinct callee and a copy of every global it touches. the stubs keep
+ * call sites pointing somewhere vscc can resolve and carry copies of the 
+ * callee's parameters, so calls are set up exactly as in a whole program 
+ * build. linking retargets them to the real functions
+ */
+struct isolated {
+    struct vscc_function clone;
+    struct vscc_instruction *insns;
+    struct vscc_context ctx;
+    struct vscc_codegen_data data;
+};
+
+struct outside_symbol {
+    uintptr_t offset;
+    uint32_t name;
+};
+
+struct link_piece {
+    struct pycodegen_piece *piece;
+    uintptr_t offset;
+    int64_t *targets;
+    bool ok;
+};
+
+struct link {
+    struct link_piece *pieces;
+    uint8_t *buffer;
+};
+
+struct parallel {
+    struct vscc_codegen_interface interface;
+    struct vscc_function **functions;
+    struct pycodegen_piece *pieces;
+    bool *ok;
+};
+
+static void *clone_of(struct pysym_table *clones, void *original, void **list, size_t size)
+{
+    void *res = pysym_get(clones, original);
+    if (res)
+        return res;
+
+    /* vscc_function and vscc_register both start with their 'next' pointer */
+    res = pyperf_malloc(size);
+    memcpy(res, original, size);
+    *(void**)res = *list;
+    *list = res;
+
+    pysym_put(clones, original, res);
+    return res;
+}
+
+static struct vscc_register *clone_register(struct isolated *iso, struct pysym_table *clones, struct vscc_register *reg)
+{
+    if (reg == NULL || !reg->is_global)
+        return reg;
+    return clone_of(clones, reg, (void**)&iso->ctx.global_stream, sizeof(struct vscc_register));
+}
+
+static struct vscc_register *clone_parameters(struct vscc_register *reg)
+{
+    struct vscc_register *res = NULL;
+    struct vscc_register **tail = &res;
+
+    for (; reg; reg = reg->next) {
+        if (!reg->is_parameter)
+            continue;
+
+        *tail = pyperf_malloc(sizeof(struct vscc_register));
+        **tail = *reg;
+        (*tail)->next = NULL;
+        tail = &(*tail)->next;
+    }
+    return res;
+}
+
+static void isolate(struct isolated *iso, struct vscc_function *fn)
+{
+    struct pysym_table clones = { 0 };
+    size_t count = 0;
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next)
+        count++;
+
+    iso->clone = *fn;
+    iso->clone.next = NULL;
+    iso->clone.instruction_stream = NULL;
+    iso->insns = pyperf_malloc((count ? count : 1) * sizeof(struct vscc_instruction));
+
+    struct vscc_instruction **tail = &iso->clone.instruction_stream;
+    size_t i = 0;
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next, i++) {
+        struct vscc_instruction *copy = &iso->insns[i];
+        *copy = *insn;
+        copy->next = NULL;
+
+        copy->dest = clone_register(iso, &clones, insn->dest);
+        copy->src = clone_register(iso, &clones, insn->src);
+
+        if (insn->opcode == O_SYSCALL) {
+            for (int k = 0; k < insn->syscall.count; k++)
+                if (insn->syscall.type[k] == M_REG)
+                    copy->syscall.values[k] = (uintptr_t)clone_register(iso, &clones, (struct vscc_register*)insn->syscall.values[k]);
+        }
+
+        /* recursive calls stay on the function itself */
+        if (insn->opcode == O_CALL && (struct vscc_function*)insn->imm1 != fn) {
+            struct vscc_function *callee = (struct vscc_function*)insn->imm1;
+            struct vscc_function *stub = pysym_get(&clones, (const char*)callee);
+            if (stub == NULL) {
+                stub = clone_of(&clones, callee, (void**)&iso->clone.next, sizeof(struct vscc_function));
+                stub->register_stream = clone_parameters(callee->register_stream);
+                stub->instruction_stream = NULL;
+            }
+            copy->imm1 = (uintptr_t)stub;
+        }
+        else if (insn->opcode == O_CALL)
+            copy->imm1 = (uintptr_t)&iso->clone;
+
+        *tail = copy;
+        tail = &copy->next;
+    }
+
+    iso->ctx.function_stream = &iso->clone;
+    pysym_free(&clones, false);
+}
+
+static void free_symbols(struct vscc_symbol *symbol)
+{
+    while (symbol) {
+        struct vscc_symbol *next = symbol->next;
+        free(symbol);
+        symbol = next;
+    }
+}
+
+static void free_isolated(struct isolated *iso)
+{
+    for (struct vscc_function *stub = iso->clone.next, *next; stub; stub = next) {
+        next = stub->next;
+        for (struct vscc_register *reg = stub->register_stream, *after; reg; reg = after) {
+            after = reg->next;
+            free(reg);
+        }
+        free(stub);
+    }
+
+    for (struct vscc_register *reg = iso->ctx.global_stream, *next; reg; reg = next) {
+        next = reg->next;
+        free(reg);
+    }
+
+    free(iso->insns);
+    free(iso->data.buffer);
+    free_symbols(iso->data.symbols);
+}
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const struct outside_symbol *x = a;
+    const struct outside_symbol *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/*
+ * nearest symbol at or below 'offset', references may point into a global
+ */
+static struct outside_symbol *symbol_at(struct outside_symbol *symbols, size_t count, int64_t offset)
+{
+    struct outside_symbol *res = NULL;
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((int64_t)symbols[mid].offset <= offset) {
+            res = &symbols[mid];
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return res;
+}
+
+/*
+ * references leaving the function become relocations, everything inside 
+ * it is position independent
+ */
+static bool collect_relocs(struct pycodegen_piece *piece, const uint8_t *code, uintptr_t start, uintptr_t end, struct outside_symbol *symbols, size_t count)
+{
+    size_t capacity = 0;
+    struct pyasm_insn insn;
+
+    for (uintptr_t at = start; at < end; at += insn.length) {
+        if (!pyasm_decode(code, end, at, &insn))
+            return false;
+
+        if ((!insn.relative && !insn.rip_relative) || (insn.target >= (int64_t)start && insn.target < (int64_t)end))
+            continue;
+
+        struct outside_symbol *symbol = symbol_at(symbols, count, insn.target);
+        if (symbol == NULL || insn.rel_size != 4)
+            return false;
+
+        if (piece->relocc == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            piece->relocs = pyperf_realloc(piece->relocs, capacity * sizeof(struct pycodegen_reloc));
+        }
+
+        piece->relocs[piece->relocc++] = (struct pycodegen_reloc){
+            .at = at - start + insn.rel_at,
+            .next = at - start + insn.length,
+            .name = symbol->name,
+            .addend = insn.target - (int64_t)symbol->offset
+        };
+    }
+    return true;
+}
+
+/* fails instead of cutting a name short, two cut names could resolve to one symbol */
+static bool copy_name(char *dst, size_t size, const char *src)
+{
+    size_t length = strnlen(src, size);
+    if (length == size)
+        return false;
+
+    memcpy(dst, src, length + 1);
+    return true;
+}
+
+bool pycodegen_function(struct vscc_function *fn, struct vscc_codegen_interface *interface, struct pycodegen_piece *piece)
+{
+    struct isolated iso = { 0 };
+    memset(piece, 0, sizeof(*piece));
+    if (!copy_name(piece->symbol_name, sizeof(piece->symbol_name), fn->symbol_name))
+        return false;
+
+    isolate(&iso, fn);
+    vscc_codegen(&iso.ctx, interface, &iso.data, true);
+
+    /* the function runs up to whatever the stubs or globals start with */
+    struct vscc_symbol *own = NULL;
+    size_t count = 0;
+    for (struct vscc_symbol *symbol = iso.data.symbols; symbol; symbol = symbol->next, count++)
+        if (own == NULL && strcmp(symbol->symbol_name, fn->symbol_name) == 0)
+            own = symbol;
+
+    if (own == NULL) {
+        free_isolated(&iso);
+        return false;
+    }
+
+    uintptr_t start = own->offset;
+    uintptr_t end = iso.data.length;
+    struct outside_symbol *symbols = pyperf_malloc(count * sizeof(struct outside_symbol));
+    piece->names = pyperf_malloc(count * sizeof(*piece->names));
+
+    bool ok = true;
+    for (struct vscc_symbol *symbol = iso.data.symbols; symbol; symbol = symbol->next) {
+        if (symbol == own)
+            continue;
+        if (symbol->offset > start && symbol->offset < end)
+            end = symbol->offset;
+
+        ok = ok && copy_name(piece->names[piece->namec], sizeof(*piece->names), symbol->symbol_name);
+        symbols[piece->namec] = (struct outside_symbol){ .offset = symbol->offset, .name = piece->namec };
+        piece->namec++;
+    }
+
+    qsort(symbols, piece->namec, sizeof(struct outside_symbol), compare_symbols);
+    ok = ok && collect_relocs(piece, iso.data.buffer, start, end, symbols, piece->namec);
+
+    if (ok) {
+        piece->length = end - start;
+        piece->code = pyperf_malloc(piece->length ? piece->length : 1);
+        memcpy(piece->code, iso.data.buffer + start, piece->length);
+    }
+
+    free(symbols);
+    free_isolated(&iso);
+    return ok;
+}
+
+void pycodegen_piece_free(struct pycodegen_piece *piece)
+{
+    free(piece->code);
+    free(piece->relocs);
+    free(piece->names);
+    memset(piece, 0, sizeof(*piece));
+}
+
+static void relocate(void *arg, size_t index)
+{
+    struct link *link = arg;
+    struct link_piece *lp = &link->pieces[index];
+    struct pycodegen_piece *piece = lp->piece;
+    uint8_t *dst = link->buffer + lp->offset;
+
+    memcpy(dst, piece->code, piece->length);
+
+    for (size_t i = 0; i < piece->relocc; i++) {
+        struct pycodegen_reloc *reloc = &piece->relocs[i];
+        int64_t rel = lp->targets[reloc->name] + reloc->addend - (int64_t)(lp->offset + reloc->next);
+        if (rel < INT32_MIN || rel > INT32_MAX) {
+            lp->ok = false;
+            return;
+        }
+
+        int32_t rel32 = (int32_t)rel;
+        memcpy(dst + reloc->at, &rel32, sizeof(rel32));
+    }
+}
+
+static struct vscc_symbol *append_symbol(struct vscc_symbol **tail, const char *name, uintptr_t offset)
+{
+    struct vscc_symbol *symbol = pyperf_calloc(1, sizeof(struct vscc_symbol));
+    snprintf(symbol->symbol_name, sizeof(symbol->symbol_name), "%s", name);
+    symbol->offset = offset;
+    *tail = symbol;
+    return symbol;
+}
+
+bool pycodegen_link(struct pycodegen_piece **pieces, size_t count, struct vscc_register *globals, struct vscc_codegen_interface *interface, 
+    struct vscc_codegen_data *data, size_t threads)
+{
+    struct link link = { .pieces = pyperf_calloc(count ? count : 1, sizeof(struct link_piece)), .buffer = NULL };
+
+    /*
+     * globals are laid out by vscc exactly as they would follow the code
+     */
+    struct vscc_context global_ctx = { .function_stream = NULL, .global_stream = globals };
+    struct vscc_codegen_data global_data = { 0 };
+    vscc_codegen(&global_ctx, interface, &global_data, true);
+
+    /*
+     * pieces keep their order, then every outside reference is resolved by name
+     */
+    struct pysym_table strings = { 0 };
+    struct pysym_table offsets = { 0 };
+    uintptr_t code_end = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < count; i++) {
+        link.pieces[i] = (struct link_piece){ .piece = pieces[i], .offset = code_end, .ok = true };
+        code_end += pieces[i]->length;
+
+        pysym_put(&offsets, pysym_intern(&strings, pieces[i]->symbol_name, strlen(pieces[i]->symbol_name)), (void*)(link.pieces[i].offset + 1));
+    }
+
+    for (struct vscc_symbol *symbol = global_data.symbols; symbol; symbol = symbol->next)
+        pysym_put(&offsets, pysym_intern(&strings, symbol->symbol_name, strlen(symbol->symbol_name)), (void*)(code_end + symbol->offset + 1));
+
+    for (size_t i = 0; i < count && ok; i++) {
+        struct pycodegen_piece *piece = pieces[i];
+        link.pieces[i].targets = pyperf_malloc((piece->namec ? piece->namec : 1) * sizeof(int64_t));
+
+        for (size_t j = 0; j < piece->namec; j++) {
+            uintptr_t offset = (uintptr_t)pysym_get(&offsets, pysym_intern(&strings, piece->names[j], strlen(piece->names[j])));
+            link.pieces[i].targets[j] = offset ? (int64_t)offset - 1 : -1;
+        }
+
+        /* unreferenced names (stubs and globals vscc emitted anyway) may be missing */
+        for (size_t j = 0; j < piece->relocc && ok; j++)
+            ok = link.pieces[i].targets[piece->relocs[j].name] != -1;
+    }
+
+    pysym_free(&offsets, false);
+    pysym_free(&strings, true);
+
+    if (ok) {
+        link.buffer = pyperf_malloc(code_end + global_data.length);
+        memcpy(link.buffer + code_end, global_data.buffer, global_data.length);
+        pypool_run(threads, count, relocate, &link);
+
+        for (size_t i = 0; i < count; i++)
+            ok = ok && link.pieces[i].ok;
+    }
+
+    /*
+     * symbols are ordered like vscc orders them, functions first
+     */
+    if (ok) {
+        struct vscc_symbol *symbols = NULL;
+        struct vscc_symbol **tail = &symbols;
+
+        for (size_t i = 0; i < count; i++)
+            tail = &append_symbol(tail, pieces[i]->symbol_name, link.pieces[i].offset)->next;
+        for (struct vscc_symbol *symbol = global_data.symbols; symbol; symbol = symbol->next)
+            tail = &append_symbol(tail, symbol->symbol_name, code_end + symbol->offset)->next;
+
+        data->buffer = link.buffer;
+        data->length = code_end + global_data.length;
+        data->symbols = symbols;
+    }
+    else {
+        free(link.buffer);
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(link.pieces[i].targets);
+    free(link.pieces);
+    free(global_data.buffer);
+    free_symbols(global_data.symbols);
+    return ok;
+}
+
+static void generate(void *arg, size_t index)
+{
+    struct parallel *parallel = arg;
+    parallel->ok[index] = pycodegen_function(parallel->functions[index], &parallel->interface, &parallel->pieces[index]);
+}
+
+bool pycodegen_parallel(struct vscc_context *ctx, struct vscc_codegen_data *data, size_t threads)
+{
+    size_t count = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        count++;
+
+    if (count < CODEGEN_MIN_FUNCTIONS)
+        return false;
+
+    struct parallel parallel = {
+        .functions = pyperf_malloc(count * sizeof(struct vscc_function*)),
+        .pieces = pyperf_calloc(count, sizeof(struct pycodegen_piece)),
+        .ok = pyperf_calloc(count, sizeof(bool))
+    };
+    vscc_codegen_implement_x64(&parallel.interface, ABI_SYSV);
+
+    size_t i = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        parallel.functions[i++] = fn;
+
+    pypool_run(threads, count, generate, &parallel);
+
+    bool ok = true;
+    struct pycodegen_piece **pieces = pyperf_malloc(count * sizeof(struct pycodegen_piece*));
+    for (i = 0; i < count; i++) {
+        ok = ok && parallel.ok[i];
+        pieces[i] = &parallel.pieces[i];
+    }
+
+    ok = ok && pycodegen_link(pieces, count, ctx->global_stream, &parallel.interface, data, threads);
+
+    for (i = 0; i < count; i++)
+        pycodegen_piece_free(&parallel.pieces[i]);
+    free(pieces);
+    free(parallel.functions);
+    free(parallel.pieces);
+    free(parallel.ok);
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "pyelf.h"
+#include "pyasm.h"
+#include "pyimpl.h"
+#include "pyperf.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * _start: call entry; mov rbx, rax; call pyimpl_flush; mov rdi, rbx; mov eax, 60 (exit); syscall
+ */
+static const uint8_t start_stub[] = { 
+    0xe8, 0x00, 0x00, 0x00, 0x00, 
+    0x48, 0x89, 0xc3, 
+    0xe8, 0x00, 0x00, 0x00, 0x00, 
+    0x48, 0x89, 0xdf, 
+    0xb8, 0x3c, 0x00, 0x00, 0x00, 
+    0x0f, 0x05 
+};
+
+#define STUB_OFFSET (sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr))
+#define STUB_FLUSH 8
+
+/* takes the place of the flush call in images without a runtime */
+static const uint8_t nop5[] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+static Elf64_Phdr segment(size_t offset, size_t length, uint32_t flags)
+{
+    return (Elf64_Phdr){
+        .p_type = PT_LOAD,
+        .p_flags = flags,
+        .p_offset = offset,
+        .p_vaddr = ELF_BASE + offset,
+        .p_paddr = ELF_BASE + offset,
+        .p_filesz = length,
+        .p_memsz = length,
+        .p_align = ELF_PAGE
+    };
+}
+
+bool pyelf_write(const char *path, struct vscc_codegen_data *data, struct vscc_context *ctx, uintptr_t entry_offset, bool *split)
+{
+    struct pyasm_image image;
+    size_t code_offset = STUB_OFFSET + sizeof(start_stub);
+    size_t code_end = data->length;
+
+    /*
+     * code is loaded right after the stub, keep the data 16 byte aligned in 
+     * the file and move it onto its own page
+     */
+    *split = pyasm_image_init(&image, data, ctx);
+    if (*split) {
+        while ((code_offset + image.code_end) & 15)
+            code_offset++;
+
+        struct vscc_symbol *entry = NULL;
+        for (struct vscc_symbol *symbol = data->symbols; symbol && !entry; symbol = symbol->next)
+            if (symbol->offset == entry_offset)
+                entry = symbol;
+
+        image.data_align = ELF_PAGE;
+        image.data_phase = (ELF_PAGE - code_offset % ELF_PAGE) % ELF_PAGE;
+        *split = entry && pyasm_relink(&image);
+        if (*split) {
+            entry_offset = entry->offset;
+            code_end = image.code_end;
+        }
+    }
+    pyasm_image_free(&image);
+
+    if (!*split)
+        code_offset = (code_offset + 15) & ~(size_t)15;
+
+    /*
+     * headers, one read/execute segment for the code and a read/write one for
+     * the data (print buffers its output there). without a split everything 
+     * shares one segment
+     */
+    size_t data_length = data->length - code_end;
+    int phnum = *split && data_length ? 2 : 1;
+
+    Elf64_Ehdr header = {
+        .e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV },
+        .e_type = ET_EXEC,
+        .e_machine = EM_X86_64,
+        .e_version = EV_CURRENT,
+        .e_entry = ELF_BASE + STUB_OFFSET,
+        .e_phoff = sizeof(Elf64_Ehdr),
+        .e_ehsize = sizeof(Elf64_Ehdr),
+        .e_phentsize = sizeof(Elf64_Phdr),
+        .e_phnum = phnum
+    };
+
+    Elf64_Phdr segments[2] = {
+        segment(0, code_offset + code_end, PF_R | PF_X | (*split ? 0 : PF_W)),
+        segment(code_offset + code_end, data_length, PF_R | PF_W)
+    };
+
+    size_t length = code_offset + data->length;
+    uint8_t *file = pyperf_calloc(1, length);
+
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), segments, phnum * sizeof(Elf64_Phdr));
+    memcpy(file + STUB_OFFSET, start_stub, sizeof(start_stub));
+    memset(file + STUB_OFFSET + sizeof(start_stub), 0xcc, code_offset - STUB_OFFSET - sizeof(start_stub));
+    memcpy(file + code_offset, data->buffer, data->length);
+
+    int32_t rel = (int32_t)(code_offset + entry_offset - (STUB_OFFSET + 5));
+    memcpy(file + STUB_OFFSET + 1, &rel, sizeof(rel));
+
+    /* print output still buffered when the entry returns is written before exiting */
+    uintptr_t flush_offset = pyimpl_find_symbol(data, PYIMPL_FLUSH);
+    if (flush_offset != -1) {
+        rel = (int32_t)(code_offset + flush_offset - (STUB_OFFSET + STUB_FLUSH + 5));
+        memcpy(file + STUB_OFFSET + STUB_FLUSH + 1, &rel, sizeof(rel));
+    }
+    else
+        memcpy(file + STUB_OFFSET + STUB_FLUSH, nop5, sizeof(nop5));
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    bool written = fd >= 0 && write(fd, file, length) == (ssize_t)length;
+    if (fd >= 0)
+        written = close(fd) == 0 && written;
+
+    free(file);
+    return written;
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "pyimpl.h"
 #include "ir/intermediate.h"
+#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
 
 static inline void add_pyimpl_strlen(struct vscc_context *ctx)
 {
@@ -8,50 +10,421 @@ static inline void add_pyimpl_strlen(struct vscc_context *ctx)
 
     struct vscc_register *strlen_string = vscc_alloc(strlen, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
     struct vscc_register *strlen_len = vscc_alloc(strlen, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
-    struct vscc_register *strlen_deref = vscc_alloc(strlen, "deref_char", SIZEOF_I8, NOT_PARAMETER, NOT_VOLATILE);
-
-    vscc_push0(strlen, O_STORE, strlen_len, 0);
-    vscc_push2(strlen, O_DECLABEL, 0);
-    vscc_push1(strlen, O_LOAD, strlen_deref, strlen_string);
-    vscc_push0(strlen, O_CMP, strlen_deref, 0);
-    vscc_push2(strlen, O_JE, 1);
-    vscc_push0(strlen, O_ADD, strlen_string, 1);
-    vscc_push0(strlen, O_ADD, strlen_len, 1);
-    vscc_push2(strlen, O_JMP, 0);
-    vscc_push2(strlen, O_DECLABEL, 1);
+
+    vscc_push0(strlen, O_SUB, strlen_string, PYIMPL_STRING_PREFIX);
+    vscc_push1(strlen, O_LOAD, strlen_len, strlen_string);
     vscc_push3(strlen, O_RET, strlen_len);
 }
 
-static inline void add_pyimpl_print_str(struct vscc_context *ctx)
+/*
+ * ir bodies of the native routines write straight through, they only run 
+ * when the image could not be rewritten and never buffer anything
+ */
+static inline void add_pyimpl_native_stdout_write(struct vscc_context *ctx)
 {
-    struct vscc_function *print = vscc_init_function(ctx, "pyimpl_print_str", SIZEOF_I64);
+    struct vscc_function *write = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "stdout_write", SIZEOF_I64);
 
-    struct vscc_register *print_string = vscc_alloc(print, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
-    struct vscc_register *print_len = vscc_alloc(print, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    vscc_alloc(write, "out", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *write_string = vscc_alloc(write, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *write_len = vscc_alloc(write, "length", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
 
     struct vscc_syscall_args syscall_write = {
         .syscall_id = 1,
         .count = 3,
 
-        .values = { 1, (uintptr_t)print_string, (size_t)print_len },
+        .values = { 1, (uintptr_t)write_string, (size_t)write_len },
         .type = { M_IMM, M_REG, M_REG }
     };
 
+    vscc_pushs(write, &syscall_write);
+    vscc_push3(write, O_RET, write_len);
+}
+
+static inline void add_pyimpl_native_stdout_flush(struct vscc_context *ctx)
+{
+    struct vscc_function *flush = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "stdout_flush", SIZEOF_I64);
+
+    vscc_alloc(flush, "out", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_push2(flush, O_RET, 0);
+}
+
+static inline void add_pyimpl_native_print_int(struct vscc_context *ctx)
+{
+    struct vscc_function *print = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "print_int", SIZEOF_I64);
+    struct vscc_function *write = vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "stdout_write");
+
+    struct vscc_register *print_out = vscc_alloc(print, "out", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_value = vscc_alloc(print, "value", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_digits = vscc_alloc(print, "digits", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_power = vscc_alloc(print, "power", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_digit = vscc_alloc(print, "digit", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_str = vscc_alloc(print, "str", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_len = vscc_alloc(print, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_count = vscc_alloc(print, "count", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push0(print, O_STORE, print_count, 0);
+    vscc_push0(print, O_STORE, print_power, 1);
+    vscc_push0(print, O_STORE, print_len, 1);
+
+    /* a sign first, then the value is positive */
+    vscc_push0(print, O_CMP, print_value, 0);
+    vscc_push2(print, O_JG, 0);
+    vscc_push2(print, O_JE, 0);
+    vscc_push1(print, O_STORE, print_str, print_digits);
+    vscc_push0(print, O_ADD, print_str, offsetof(struct pyimpl_digits, sign));
+    vscc_push3(print, O_PSHARG, print_out);
+    vscc_push3(print, O_PSHARG, print_str);
+    vscc_push3(print, O_PSHARG, print_len);
+    vscc_push0(print, O_CALL, print_count, (uintptr_t)write);
+    vscc_push0(print, O_MUL, print_value, -1);
+
+    /* power of ten of the leading digit */
+    vscc_push2(print, O_DECLABEL, 0);
+    vscc_push1(print, O_STORE, print_digit, print_value);
+    vscc_push1(print, O_DIV, print_digit, print_power);
+    vscc_push0(print, O_CMP, print_digit, 10);
+    vscc_push2(print, O_JL, 1);
+    vscc_push0(print, O_MUL, print_power, 10);
+    vscc_push2(print, O_JMP, 0);
+
+    /* one write per digit, the second character of its pair */
+    vscc_push2(print, O_DECLABEL, 1);
+    vscc_push1(print, O_STORE, print_digit, print_value);
+    vscc_push1(print, O_DIV, print_digit, print_power);
+    vscc_push1(print, O_STORE, print_str, print_digit);
+    vscc_push0(print, O_MUL, print_str, 2);
+    vscc_push1(print, O_ADD, print_str, print_digits);
+    vscc_push0(print, O_ADD, print_str, 1);
+    vscc_push3(print, O_PSHARG, print_out);
+    vscc_push3(print, O_PSHARG, print_str);
+    vscc_push3(print, O_PSHARG, print_len);
+    vscc_push0(print, O_CALL, print_len, (uintptr_t)write);
+    vscc_push1(print, O_ADD, print_count, print_len);
+    vscc_push1(print, O_MUL, print_digit, print_power);
+    vscc_push1(print, O_SUB, print_value, print_digit);
+    vscc_push0(print, O_DIV, print_power, 10);
+    vscc_push0(print, O_CMP, print_power, 0);
+    vscc_push2(print, O_JG, 1);
+    vscc_push3(print, O_RET, print_count);
+}
+
+static inline void add_pyimpl_native_cpu_init(struct vscc_context *ctx)
+{
+    struct vscc_function *init = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "cpu_init", SIZEOF_I64);
+
+    vscc_alloc(init, "cpu", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_push2(init, O_RET, PYIMPL_CPU_SSE2);
+}
+
+static inline void add_pyimpl_native_find_byte(struct vscc_context *ctx)
+{
+    struct vscc_function *find = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "find_byte", SIZEOF_I64);
+
+    vscc_alloc(find, "level", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_string = vscc_alloc(find, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_byte = vscc_alloc(find, "c", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_len = vscc_alloc(find, "length", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_index = vscc_alloc(find, "index", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_at = vscc_alloc(find, "at", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_char = vscc_alloc(find, "char", SIZEOF_I8, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push0(find, O_STORE, find_index, 0);
+    vscc_push2(find, O_DECLABEL, 0);
+    vscc_push1(find, O_CMP, find_index, find_len);
+    vscc_push2(find, O_JE, 1);
+    vscc_push1(find, O_STORE, find_at, find_string);
+    vscc_push1(find, O_ADD, find_at, find_index);
+    vscc_push1(find, O_LOAD, find_char, find_at);
+    vscc_push1(find, O_CMP, find_char, find_byte);
+    vscc_push2(find, O_JE, 2);
+    vscc_push0(find, O_ADD, find_index, 1);
+    vscc_push2(find, O_JMP, 0);
+    vscc_push2(find, O_DECLABEL, 1);
+    vscc_push0(find, O_STORE, find_index, -1);
+    vscc_push2(find, O_DECLABEL, 2);
+    vscc_push3(find, O_RET, find_index);
+}
+
+static inline void add_pyimpl_native_compare(struct vscc_context *ctx)
+{
+    struct vscc_function *compare = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "compare", SIZEOF_I64);
+
+    vscc_alloc(compare, "level", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_a = vscc_alloc(compare, "a", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_b = vscc_alloc(compare, "b", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_len = vscc_alloc(compare, "length", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_x = vscc_alloc(compare, "x", SIZEOF_I8, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_y = vscc_alloc(compare, "y", SIZEOF_I8, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *compare_diff = vscc_alloc(compare, "diff", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push0(compare, O_STORE, compare_diff, 0);
+    vscc_push2(compare, O_DECLABEL, 0);
+    vscc_push0(compare, O_CMP, compare_len, 0);
+    vscc_push2(compare, O_JE, 1);
+    vscc_push1(compare, O_LOAD, compare_x, compare_a);
+    vscc_push1(compare, O_LOAD, compare_y, compare_b);
+    vscc_push1(compare, O_STORE, compare_diff, compare_x);
+    vscc_push1(compare, O_SUB, compare_diff, compare_y);
+    vscc_push0(compare, O_CMP, compare_diff, 0);
+    vscc_push2(compare, O_JNE, 1);
+    vscc_push0(compare, O_ADD, compare_a, 1);
+    vscc_push0(compare, O_ADD, compare_b, 1);
+    vscc_push0(compare, O_SUB, compare_len, 1);
+    vscc_push2(compare, O_JMP, 0);
+    vscc_push2(compare, O_DECLABEL, 1);
+    vscc_push3(compare, O_RET, compare_diff);
+}
+
+static inline void add_pyimpl_native_alloc(struct vscc_context *ctx)
+{
+    struct vscc_function *alloc = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "alloc", SIZEOF_PTR);
+
+    vscc_alloc(alloc, "heap", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_alloc(alloc, "size", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    vscc_push2(alloc, O_RET, 0);
+}
+
+static inline void add_pyimpl_native_free(struct vscc_context *ctx)
+{
+    struct vscc_function *free = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "free", SIZEOF_I64);
+
+    vscc_alloc(free, "heap", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_alloc(free, "ptr", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_push2(free, O_RET, 0);
+}
+
+static inline void add_pyimpl_native_store(struct vscc_context *ctx)
+{
+    struct vscc_function *store = vscc_init_function(ctx, PYIMPL_NATIVE_PREFIX "store", SIZEOF_I64);
+
+    vscc_alloc(store, "ptr", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    vscc_alloc(store, "index", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *store_value = vscc_alloc(store, "value", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    vscc_push3(store, O_RET, store_value);
+}
+
+/*
+ * level of the string routines, label 0 of 'fn' is taken
+ */
+static struct vscc_register *push_cpu_level(struct vscc_context *ctx, struct vscc_function *fn)
+{
+    struct vscc_register *cpu = vscc_alloc(fn, "cpu", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *level = vscc_alloc(fn, "level", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(fn, O_LEA, cpu, vscc_fetch_global_register_by_name(ctx, PYIMPL_CPU));
+    vscc_push1(fn, O_LOAD, level, cpu);
+    vscc_push0(fn, O_CMP, level, PYIMPL_CPU_UNKNOWN);
+    vscc_push2(fn, O_JNE, 0);
+    vscc_push3(fn, O_PSHARG, cpu);
+    vscc_push0(fn, O_CALL, level, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "cpu_init"));
+    vscc_push2(fn, O_DECLABEL, 0);
+    return level;
+}
+
+static inline void add_pyimpl_find(struct vscc_context *ctx)
+{
+    struct vscc_function *find = vscc_init_function(ctx, "pyimpl_find", SIZEOF_I64);
+
+    struct vscc_register *find_string = vscc_alloc(find, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_byte = vscc_alloc(find, "c", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_len = vscc_alloc(find, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *find_level = push_cpu_level(ctx, find);
+
+    vscc_push1(find, O_STORE, find_len, find_string);
+    vscc_push0(find, O_SUB, find_len, PYIMPL_STRING_PREFIX);
+    vscc_push1(find, O_LOAD, find_len, find_len);
+    vscc_push3(find, O_PSHARG, find_level);
+    vscc_push3(find, O_PSHARG, find_string);
+    vscc_push3(find, O_PSHARG, find_byte);
+    vscc_push3(find, O_PSHARG, find_len);
+    vscc_push0(find, O_CALL, find_len, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "find_byte"));
+    vscc_push3(find, O_RET, find_len);
+}
+
+/*
+ * bytes up to the shorter length decide, then the lengths do
+ */
+static inline void add_pyimpl_strcmp(struct vscc_context *ctx)
+{
+    struct vscc_function *strcmp = vscc_init_function(ctx, "pyimpl_strcmp", SIZEOF_I64);
+
+    struct vscc_register *strcmp_a = vscc_alloc(strcmp, "a", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_b = vscc_alloc(strcmp, "b", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_alen = vscc_alloc(strcmp, "a_length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_blen = vscc_alloc(strcmp, "b_length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_len = vscc_alloc(strcmp, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_diff = vscc_alloc(strcmp, "diff", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *strcmp_level = push_cpu_level(ctx, strcmp);
+
+    vscc_push1(strcmp, O_STORE, strcmp_alen, strcmp_a);
+    vscc_push0(strcmp, O_SUB, strcmp_alen, PYIMPL_STRING_PREFIX);
+    vscc_push1(strcmp, O_LOAD, strcmp_alen, strcmp_alen);
+    vscc_push1(strcmp, O_STORE, strcmp_blen, strcmp_b);
+    vscc_push0(strcmp, O_SUB, strcmp_blen, PYIMPL_STRING_PREFIX);
+    vscc_push1(strcmp, O_LOAD, strcmp_blen, strcmp_blen);
+
+    vscc_push1(strcmp, O_STORE, strcmp_len, strcmp_alen);
+    vscc_push1(strcmp, O_CMP, strcmp_len, strcmp_blen);
+    vscc_push2(strcmp, O_JL, 1);
+    vscc_push1(strcmp, O_STORE, strcmp_len, strcmp_blen);
+    vscc_push2(strcmp, O_DECLABEL, 1);
+
+    vscc_push3(strcmp, O_PSHARG, strcmp_level);
+    vscc_push3(strcmp, O_PSHARG, strcmp_a);
+    vscc_push3(strcmp, O_PSHARG, strcmp_b);
+    vscc_push3(strcmp, O_PSHARG, strcmp_len);
+    vscc_push0(strcmp, O_CALL, strcmp_diff, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "compare"));
+    vscc_push0(strcmp, O_CMP, strcmp_diff, 0);
+    vscc_push2(strcmp, O_JNE, 2);
+    vscc_push1(strcmp, O_STORE, strcmp_diff, strcmp_alen);
+    vscc_push1(strcmp, O_SUB, strcmp_diff, strcmp_blen);
+    vscc_push2(strcmp, O_DECLABEL, 2);
+    vscc_push3(strcmp, O_RET, strcmp_diff);
+}
+
+static inline void add_pyimpl_print_str(struct vscc_context *ctx)
+{
+    struct vscc_function *print = vscc_init_function(ctx, "pyimpl_print_str", SIZEOF_I64);
+
+    struct vscc_register *print_string = vscc_alloc(print, "str", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_len = vscc_alloc(print, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_out = vscc_alloc(print, "out", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(print, O_STORE, print_len, print_string);
+    vscc_push0(print, O_SUB, print_len, PYIMPL_STRING_PREFIX);
+    vscc_push1(print, O_LOAD, print_len, print_len);
+    vscc_push1(print, O_LEA, print_out, vscc_fetch_global_register_by_name(ctx, PYIMPL_STDOUT));
+    vscc_push3(print, O_PSHARG, print_out);
     vscc_push3(print, O_PSHARG, print_string);
-    vscc_push0(print, O_CALL, print_len, (uintptr_t)vscc_fetch_function_by_name(ctx, "pyimpl_strlen"));
-    vscc_pushs(print, &syscall_write);
+    vscc_push3(print, O_PSHARG, print_len);
+    vscc_push0(print, O_CALL, print_len, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "stdout_write"));
     vscc_push3(print, O_RET, print_len);
 }
 
+static inline void add_pyimpl_print_int(struct vscc_context *ctx)
+{
+    struct vscc_function *print = vscc_init_function(ctx, "pyimpl_print_int", SIZEOF_I64);
+
+    struct vscc_register *print_value = vscc_alloc(print, "value", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_out = vscc_alloc(print, "out", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_digits = vscc_alloc(print, "digits", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *print_len = vscc_alloc(print, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(print, O_LEA, print_out, vscc_fetch_global_register_by_name(ctx, PYIMPL_STDOUT));
+    vscc_push1(print, O_LEA, print_digits, vscc_fetch_global_register_by_name(ctx, PYIMPL_DIGITS));
+    vscc_push3(print, O_PSHARG, print_out);
+    vscc_push3(print, O_PSHARG, print_value);
+    vscc_push3(print, O_PSHARG, print_digits);
+    vscc_push0(print, O_CALL, print_len, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "print_int"));
+    vscc_push3(print, O_RET, print_len);
+}
+
+/*
+ * alloc(size) and free(ptr) pass the heap to the machine code, load and 
+ * store take 8 byte words by index
+ */
+static inline void add_pyimpl_alloc(struct vscc_context *ctx)
+{
+    struct vscc_function *alloc = vscc_init_function(ctx, "pyimpl_alloc", SIZEOF_PTR);
+
+    struct vscc_register *alloc_size = vscc_alloc(alloc, "size", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *alloc_heap = vscc_alloc(alloc, "heap", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *alloc_ptr = vscc_alloc(alloc, "ptr", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(alloc, O_LEA, alloc_heap, vscc_fetch_global_register_by_name(ctx, PYIMPL_HEAP));
+    vscc_push3(alloc, O_PSHARG, alloc_heap);
+    vscc_push3(alloc, O_PSHARG, alloc_size);
+    vscc_push0(alloc, O_CALL, alloc_ptr, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "alloc"));
+    vscc_push3(alloc, O_RET, alloc_ptr);
+}
+
+static inline void add_pyimpl_free(struct vscc_context *ctx)
+{
+    struct vscc_function *free = vscc_init_function(ctx, "pyimpl_free", SIZEOF_I64);
+
+    struct vscc_register *free_ptr = vscc_alloc(free, "ptr", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *free_heap = vscc_alloc(free, "heap", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *free_res = vscc_alloc(free, "res", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(free, O_LEA, free_heap, vscc_fetch_global_register_by_name(ctx, PYIMPL_HEAP));
+    vscc_push3(free, O_PSHARG, free_heap);
+    vscc_push3(free, O_PSHARG, free_ptr);
+    vscc_push0(free, O_CALL, free_res, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "free"));
+    vscc_push3(free, O_RET, free_res);
+}
+
+static inline void add_pyimpl_load(struct vscc_context *ctx)
+{
+    struct vscc_function *load = vscc_init_function(ctx, "pyimpl_load", SIZEOF_I64);
+
+    struct vscc_register *load_ptr = vscc_alloc(load, "ptr", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *load_index = vscc_alloc(load, "index", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *load_value = vscc_alloc(load, "value", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push0(load, O_MUL, load_index, sizeof(uint64_t));
+    vscc_push1(load, O_ADD, load_ptr, load_index);
+    vscc_push1(load, O_LOAD, load_value, load_ptr);
+    vscc_push3(load, O_RET, load_value);
+}
+
+static inline void add_pyimpl_store(struct vscc_context *ctx)
+{
+    struct vscc_function *store = vscc_init_function(ctx, "pyimpl_store", SIZEOF_I64);
+
+    struct vscc_register *store_ptr = vscc_alloc(store, "ptr", SIZEOF_PTR, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *store_index = vscc_alloc(store, "index", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *store_value = vscc_alloc(store, "value", SIZEOF_I64, IS_PARAMETER, NOT_VOLATILE);
+
+    vscc_push3(store, O_PSHARG, store_ptr);
+    vscc_push3(store, O_PSHARG, store_index);
+    vscc_push3(store, O_PSHARG, store_value);
+    vscc_push0(store, O_CALL, store_value, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "store"));
+    vscc_push3(store, O_RET, store_value);
+}
+
+static inline void add_pyimpl_flush(struct vscc_context *ctx)
+{
+    struct vscc_function *flush = vscc_init_function(ctx, PYIMPL_FLUSH, SIZEOF_I64);
+
+    struct vscc_register *flush_out = vscc_alloc(flush, "out", SIZEOF_PTR, NOT_PARAMETER, NOT_VOLATILE);
+    struct vscc_register *flush_len = vscc_alloc(flush, "length", SIZEOF_I64, NOT_PARAMETER, NOT_VOLATILE);
+
+    vscc_push1(flush, O_LEA, flush_out, vscc_fetch_global_register_by_name(ctx, PYIMPL_STDOUT));
+    vscc_push3(flush, O_PSHARG, flush_out);
+    vscc_push0(flush, O_CALL, flush_len, (uintptr_t)vscc_fetch_function_by_name(ctx, PYIMPL_NATIVE_PREFIX "stdout_flush"));
+    vscc_push3(flush, O_RET, flush_len);
+}
+
 void pyimpl_append_to_context(struct vscc_context *ctx)
 {
     vscc_alloc_global(ctx, "__name__", 16, false);
+    vscc_alloc_global(ctx, PYIMPL_STDOUT, sizeof(struct pyimpl_stdout), true);
+    vscc_alloc_global(ctx, PYIMPL_DIGITS, sizeof(struct pyimpl_digits), true);
+    vscc_alloc_global(ctx, PYIMPL_CPU, sizeof(uint64_t), true);
+    vscc_alloc_global(ctx, PYIMPL_HEAP, sizeof(struct pyimpl_heap), true);
 
     add_pyimpl_strlen(ctx);
+    add_pyimpl_native_stdout_write(ctx);
+    add_pyimpl_native_stdout_flush(ctx);
+    add_pyimpl_native_print_int(ctx);
+    add_pyimpl_native_cpu_init(ctx);
+    add_pyimpl_native_find_byte(ctx);
+    add_pyimpl_native_compare(ctx);
+    add_pyimpl_native_alloc(ctx);
+    add_pyimpl_native_free(ctx);
+    add_pyimpl_native_store(ctx);
     add_pyimpl_print_str(ctx);
+    add_pyimpl_print_int(ctx);
+    add_pyimpl_find(ctx);
+    add_pyimpl_strcmp(ctx);
+    add_pyimpl_alloc(ctx);
+    add_pyimpl_free(ctx);
+    add_pyimpl_load(ctx);
+    add_pyimpl_store(ctx);
+    add_pyimpl_flush(ctx);
 }
 
-struct vscc_function *pyimpl_get(struct vscc_context *ctx, char *fn, enum pyimpl_implementation impl)
+const char *pyimpl_get_name(char *fn, enum pyimpl_implementation impl)
 {
     static struct {
         char pyname[20];
@@ -60,12 +433,18 @@ struct vscc_function *pyimpl_get(struct vscc_context *ctx, char *fn, enum pyimpl
     } table[] = {
         { "print", "pyimpl_print_str", PYIMPL_FIRST_ARG_STRING },
         { "print", "pyimpl_print_int", PYIMPL_FIRST_ARG_INT },
-        { "strlen", "pyimpl_strlen", PYIMPL_SINGLE_IMPL }
+        { "strlen", "pyimpl_strlen", PYIMPL_SINGLE_IMPL },
+        { "find", "pyimpl_find", PYIMPL_SINGLE_IMPL },
+        { "strcmp", "pyimpl_strcmp", PYIMPL_SINGLE_IMPL },
+        { "alloc", "pyimpl_alloc", PYIMPL_SINGLE_IMPL },
+        { "free", "pyimpl_free", PYIMPL_SINGLE_IMPL },
+        { "load", "pyimpl_load", PYIMPL_SINGLE_IMPL },
+        { "store", "pyimpl_store", PYIMPL_SINGLE_IMPL }
     };
 
     for (int i = 0; i < sizeof(table) / sizeof(*table); i++)
-        if (strcmp(table[i].pyname, fn) == 0)
-            return vscc_fetch_function_by_name(ctx, table[i].implname);
+        if (table[i].impl == impl && strcmp(table[i].pyname, fn) == 0)
+            return table[i].implname;
     return NULL;
 }
 
@@ -76,11 +455,111 @@ enum pyimpl_implementation_status pyimpl_get_implementation_status(char *fn)
         enum pyimpl_implementation_status status;
     } table[] = {
         { "print", PYIMPL_IMPLEMENTED_AND_MULTI_DEFINITION },
-        { "strlen", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION }
+        { "strlen", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "find", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "strcmp", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "alloc", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "free", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "load", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION },
+        { "store", PYIMPL_IMPLEMENTED_AND_SINGLE_DEFINITION }
     };
 
     for (int i = 0; i < sizeof(table) / sizeof(*table); i++)
         if (strcmp(table[i].name, fn) == 0)
             return table[i].status;
     return PYIMPL_NOT_IMPLEMENTED;
+}
+
+uintptr_t pyimpl_find_symbol(const struct vscc_codegen_data *data, const char *name)
+{
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        if (strcmp(symbol->symbol_name, name) == 0)
+            return symbol->offset;
+    return -1;
+}
+
+bool pyimpl_requires_native(const char *symbol)
+{
+    /* there is no ir for a store through a pointer, the heap needs machine code. inlining leaves the native calls */
+    static const char *table[] = {
+        "pyimpl_alloc", "pyimpl_free", "pyimpl_store",
+        PYIMPL_NATIVE_PREFIX "alloc", PYIMPL_NATIVE_PREFIX "free", PYIMPL_NATIVE_PREFIX "store"
+    };
+
+    for (int i = 0; i < sizeof(table) / sizeof(*table); i++)
+        if (strcmp(table[i], symbol) == 0)
+            return true;
+    return false;
+}
+
+bool pyimpl_link(struct vscc_codegen_data *data)
+{
+    uintptr_t offset = pyimpl_find_symbol(data, PYIMPL_DIGITS);
+    if (offset == -1 || offset + sizeof(struct pyimpl_digits) > data->length)
+        return false;
+
+    struct pyimpl_digits digits = { .sign = '-' };
+    for (int i = 0; i < 100; i++) {
+        digits.pairs[i * 2] = '0' + i / 10;
+        digits.pairs[i * 2 + 1] = '0' + i % 10;
+    }
+
+    uint64_t power = 1;
+    for (int i = 1; i < 20; i++)
+        digits.powers[i] = power *= 10;
+
+    memcpy(data->buffer + offset, &digits, sizeof(digits));
+    return true;
+}
+
+bool pyimpl_request_line_buffering(struct vscc_codegen_data *data)
+{
+    uintptr_t offset = pyimpl_find_symbol(data, PYIMPL_STDOUT);
+    if (offset == -1 || offset + sizeof(struct pyimpl_stdout) > data->length)
+        return false;
+
+    uint64_t line = PYIMPL_LINE_REQUESTED;
+    memcpy(data->buffer + offset + offsetof(struct pyimpl_stdout, line), &line, sizeof(line));
+    return true;
+}
+
+bool pyimpl_set_heap_capacity(struct vscc_codegen_data *data, uint64_t capacity)
+{
+    uintptr_t offset = pyimpl_find_symbol(data, PYIMPL_HEAP);
+    if (offset == -1 || offset + sizeof(struct pyimpl_heap) > data->length)
+        return false;
+
+    /* every block size needs a class */
+    if (capacity > PYIMPL_HEAP_MAX)
+        capacity = PYIMPL_HEAP_MAX;
+    memcpy(data->buffer + offset + offsetof(struct pyimpl_heap, capacity), &capacity, sizeof(capacity));
+    return true;
+}
+
+bool pyimpl_heap_stats(const struct vscc_codegen_data *data, const void *base, struct pyimpl_heap *heap)
+{
+    uintptr_t offset = pyimpl_find_symbol(data, PYIMPL_HEAP);
+    if (offset == -1 || offset + sizeof(struct pyimpl_heap) > data->length)
+        return false;
+
+    memcpy(heap, (const uint8_t*)base + offset, sizeof(*heap));
+    return true;
+}
+
+void pyimpl_heap_release(const struct vscc_codegen_data *data, void *base)
+{
+    struct pyimpl_heap heap;
+    if (pyimpl_heap_stats(data, base, &heap) && heap.base)
+        munmap((void*)(uintptr_t)heap.base, heap.capacity);
+}
+
+bool pyimpl_stdout_stats(const struct vscc_codegen_data *data, const void *base, uint64_t *writes, uint64_t *written)
+{
+    uintptr_t offset = pyimpl_find_symbol(data, PYIMPL_STDOUT);
+    if (offset == -1 || offset + sizeof(struct pyimpl_stdout) > data->length)
+        return false;
+
+    memcpy(writes, (const uint8_t*)base + offset + offsetof(struct pyimpl_stdout, writes), sizeof(*writes));
+    memcpy(written, (const uint8_t*)base + offset + offsetof(struct pyimpl_stdout, written), sizeof(*written));
+    return true;
 }
\ No newline at end of file
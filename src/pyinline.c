@@ -0,0 +1,262 @@
+#include "pyinline.h"
+#include "pyimpl.h"
+#include "pysym.h"
+
+#include "ir/intermediate.h"
+#include <util/list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct inline_site {
+    struct vscc_function *caller;
+    struct vscc_function *callee;
+
+    struct pysym_table registers;
+    uintptr_t label_base;
+    uintptr_t end_label;
+};
+
+static bool is_label_operand(enum vscc_opcode opcode)
+{
+    switch (opcode) {
+    case O_DECLABEL: case O_JMP: case O_JE: case O_JNE: case O_JG: case O_JL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static size_t count_params(struct vscc_function *fn)
+{
+    size_t params = 0;
+    for (struct vscc_register *reg = fn->register_stream; reg; reg = reg->next)
+        params += reg->is_parameter;
+    return params;
+}
+
+static uintptr_t max_label(struct vscc_function *fn)
+{
+    uintptr_t max = 0;
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next)
+        if (is_label_operand(insn->opcode) && insn->imm1 > max)
+            max = insn->imm1;
+    return max;
+}
+
+static size_t cost_of(struct vscc_function *fn)
+{
+    size_t cost = 0;
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next)
+        cost += insn->opcode != O_DECLABEL;
+    return cost;
+}
+
+/*
+ * small leaf functions built only from instructions this pass knows how to copy
+ */
+static bool is_inlinable(struct vscc_function *fn, size_t max_cost)
+{
+    if (!fn->instruction_stream || cost_of(fn) > max_cost)
+        return false;
+
+    /* the body of a native routine is a stand in for its machine code */
+    if (strncmp(fn->symbol_name, PYIMPL_NATIVE_PREFIX, strlen(PYIMPL_NATIVE_PREFIX)) == 0)
+        return false;
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        switch (insn->opcode) {
+        case O_STORE: case O_LOAD: case O_LEA:
+        case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_CMP:
+        case O_JMP: case O_JE: case O_JNE: case O_JG: case O_JL: case O_DECLABEL:
+        case O_RET:
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * callee registers get a fresh copy in the caller, globals are shared
+ */
+static struct vscc_register *map_register(struct inline_site *site, struct vscc_register *reg)
+{
+    struct vscc_register *mapped = reg ? pysym_get(&site->registers, (const char*)reg) : NULL;
+    return mapped ? mapped : reg;
+}
+
+static void clone_registers(struct inline_site *site, size_t id)
+{
+    char name[64];
+
+    for (struct vscc_register *reg = site->callee->register_stream; reg; reg = reg->next) {
+        snprintf(name, sizeof(name), "__inline_%zu_%.40s", id, reg->symbol_name);
+        pysym_put(&site->registers, (const char*)reg, vscc_alloc(site->caller, name, reg->size, false, reg->is_volatile));
+    }
+}
+
+/*
+ * body of the callee with arguments stored into its parameters and every 
+ * return turned into a store to 'result' and a jump past the end
+ */
+static struct vscc_instruction *build_body(struct inline_site *site, struct vscc_instruction *args, struct vscc_register *result)
+{
+    struct vscc_function scratch = { 0 };
+
+    struct vscc_register *param = site->callee->register_stream;
+    for (struct vscc_instruction *arg = args; arg->opcode == O_PSHARG; arg = arg->next) {
+        while (!param->is_parameter)
+            param = param->next;
+
+        if (arg->dest)
+            vscc_push1(&scratch, O_STORE, map_register(site, param), arg->dest);
+        else
+            vscc_push0(&scratch, O_STORE, map_register(site, param), arg->imm1);
+        param = param->next;
+    }
+
+    for (struct vscc_instruction *insn = site->callee->instruction_stream; insn; insn = insn->next) {
+        if (insn->opcode == O_RET) {
+            if (result && insn->dest)
+                vscc_push1(&scratch, O_STORE, result, map_register(site, insn->dest));
+            else if (result)
+                vscc_push0(&scratch, O_STORE, result, insn->imm1);
+            if (insn->next)
+                vscc_push2(&scratch, O_JMP, site->end_label);
+            continue;
+        }
+
+        struct vscc_instruction *copy = vscc_list_alloc((void**)&scratch.instruction_stream, 0, sizeof(struct vscc_instruction));
+        struct vscc_instruction *next = copy->next;
+        memcpy(copy, insn, sizeof(struct vscc_instruction));
+        copy->next = next;
+
+        copy->dest = map_register(site, insn->dest);
+        copy->src = map_register(site, insn->src);
+        if (is_label_operand(insn->opcode))
+            copy->imm1 += site->label_base;
+    }
+
+    vscc_push2(&scratch, O_DECLABEL, site->end_label);
+    return scratch.instruction_stream;
+}
+
+/*
+ * inline every eligible call in 'caller', returns the number of call sites replaced
+ */
+static size_t inline_calls(struct vscc_function *caller, size_t *id, const struct pyprofile *profile)
+{
+    size_t inlined = 0;
+    size_t cost = cost_of(caller);
+    uintptr_t labels = max_label(caller) + 1;
+
+    /* 'before' is the instruction preceding the run of arguments of the next call */
+    struct vscc_instruction *before = NULL;
+    struct vscc_instruction *prev = NULL;
+    size_t argc = 0;
+
+    for (struct vscc_instruction *insn = caller->instruction_stream; insn; prev = insn, insn = insn->next) {
+        if (insn->opcode == O_PSHARG) {
+            if (argc++ == 0)
+                before = prev;
+            continue;
+        }
+
+        size_t args = argc;
+        argc = 0;
+
+        if (insn->opcode != O_CALL || cost >= INLINE_MAX_CALLER)
+            continue;
+
+        struct vscc_function *callee = (struct vscc_function*)insn->imm1;
+        size_t max_cost = profile && pyprofile_is_hot(profile, pyprofile_function(profile, callee->symbol_name)) ? INLINE_MAX_HOT_COST : INLINE_MAX_COST;
+        if (callee == caller || !is_inlinable(callee, max_cost) || count_params(callee) != args)
+            continue;
+
+        struct inline_site site = {
+            .caller = caller,
+            .callee = callee,
+            .registers = { 0 },
+            .label_base = labels,
+            .end_label = labels + max_label(callee) + 1
+        };
+        labels = site.end_label + 1;
+
+        clone_registers(&site, (*id)++);
+
+        struct vscc_instruction *first_arg = args ? (before ? before->next : caller->instruction_stream) : insn;
+        struct vscc_instruction *body = build_body(&site, first_arg, insn->dest);
+        pysym_free(&site.registers, false);
+
+        /*
+         * splice the body in place of the arguments and the call
+         */
+        struct vscc_instruction *tail = body;
+        while (tail->next)
+            tail = tail->next;
+        tail->next = insn->next;
+
+        struct vscc_instruction *link = args ? before : prev;
+        if (link)
+            link->next = body;
+        else
+            caller->instruction_stream = body;
+
+        for (struct vscc_instruction *dead = first_arg, *next; dead != insn; dead = next) {
+            next = dead->next;
+            free(dead);
+        }
+        free(insn);
+
+        cost += cost_of(callee) + args;
+        inlined++;
+        insn = tail;
+    }
+
+    return inlined;
+}
+
+/* code the profile saw but never ran is not worth growing */
+static bool never_ran(const struct pyprofile *profile, struct vscc_function *fn)
+{
+    const struct pyprofile_function *counts = profile ? pyprofile_function(profile, fn->symbol_name) : NULL;
+    return counts && !pyprofile_count(counts, PROFILE_ENTRY);
+}
+
+/*
+ * post order over the call graph, every callee is finished before the callers
+ * that call it so a caller that became a leaf is inlined with its final body;
+ * a call back into a function still on the walk is a cycle and left as is
+ */
+static size_t inline_bottom_up(struct vscc_function *fn, struct pysym_table *visited, size_t *id, const struct pyprofile *profile)
+{
+    size_t inlined = 0;
+    pysym_put(visited, (const char*)fn, fn);
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        struct vscc_function *callee = (struct vscc_function*)insn->imm1;
+        if (insn->opcode == O_CALL && !pysym_get(visited, (const char*)callee))
+            inlined += inline_bottom_up(callee, visited, id, profile);
+    }
+
+    if (!never_ran(profile, fn))
+        inlined += inline_calls(fn, id, profile);
+    return inlined;
+}
+
+size_t pyinline_functions(struct vscc_context *ctx, const struct pyprofile *profile)
+{
+    struct pysym_table visited = { 0 };
+    size_t inlined = 0;
+    size_t id = 0;
+
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        if (!pysym_get(&visited, (const char*)fn))
+            inlined += inline_bottom_up(fn, &visited, &id, profile);
+
+    pysym_free(&visited, false);
+    return inlined;
+}
\ No newline at end of file
@@ -0,0 +1,526 @@
+#include "pynative.h"
+#include "pyasm.h"
+#include "pyimpl.h"
+
+#include <string.h>
+
+/*
+ * stdout_write(out, str, length): appends to the buffer of a struct 
+ * pyimpl_stdout, writing the buffer first when the string does not fit and
+ * strings at least as large as the buffer straight through. copies and
+ * looks for newlines 16 bytes at a time with sse2, which every x86-64 cpu
+ * has. resolves a requested line mode with TCGETS on its first call, 
+ * returns 'length'
+ */
+static const uint8_t stdout_write[] = {
+    0x49, 0x89, 0xf8,                           /* mov r8, rdi */
+    0x49, 0x89, 0xf1,                           /* mov r9, rsi */
+    0x49, 0x89, 0xd2,                           /* mov r10, rdx */
+    0x49, 0x83, 0x78, 0x08, 0x01,               /* cmp qword [r8+8], PYIMPL_LINE_REQUESTED */
+    0x75, 0x28,                                 /* jne .buffer */
+    0xb8, 0x10, 0x00, 0x00, 0x00,               /* mov eax, 16 (ioctl) */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xbe, 0x01, 0x54, 0x00, 0x00,               /* mov esi, TCGETS */
+    0x48, 0x8d, 0x54, 0x24, 0xc0,               /* lea rdx, [rsp-64] (red zone) */
+    0x0f, 0x05,                                 /* syscall */
+    0x31, 0xd2,                                 /* xor edx, edx */
+    0xb9, 0x02, 0x00, 0x00, 0x00,               /* mov ecx, PYIMPL_LINE_ON */
+    0x48, 0x85, 0xc0,                           /* test rax, rax */
+    0x48, 0x0f, 0x45, 0xca,                     /* cmovne rcx, rdx */
+    0x49, 0x89, 0x48, 0x08,                     /* mov [r8+8], rcx */
+                                                /* .buffer: */
+    0x49, 0x8b, 0x00,                           /* mov rax, [r8] */
+    0x4a, 0x8d, 0x0c, 0x10,                     /* lea rcx, [rax+r10] */
+    0x48, 0x81, 0xf9, 0x00, 0x10, 0x00, 0x00,   /* cmp rcx, PYIMPL_STDOUT_SIZE */
+    0x76, 0x4e,                                 /* jbe .copy */
+    0x48, 0x85, 0xc0,                           /* test rax, rax */
+    0x74, 0x22,                                 /* je .large */
+    0x48, 0x89, 0xc2,                           /* mov rdx, rax */
+    0x49, 0x8d, 0x70, 0x20,                     /* lea rsi, [r8+32] */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 (write) */
+    0x0f, 0x05,                                 /* syscall */
+    0x49, 0xff, 0x40, 0x10,                     /* inc qword [r8+16] */
+    0x49, 0x01, 0x50, 0x18,                     /* add [r8+24], rdx */
+    0x49, 0xc7, 0x00, 0x00, 0x00, 0x00, 0x00,   /* mov qword [r8], 0 */
+                                                /* .large: */
+    0x49, 0x81, 0xfa, 0x00, 0x10, 0x00, 0x00,   /* cmp r10, PYIMPL_STDOUT_SIZE */
+    0x72, 0x1e,                                 /* jb .copy */
+    0x4c, 0x89, 0xd2,                           /* mov rdx, r10 */
+    0x4c, 0x89, 0xce,                           /* mov rsi, r9 */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 (write) */
+    0x0f, 0x05,                                 /* syscall */
+    0x49, 0xff, 0x40, 0x10,                     /* inc qword [r8+16] */
+    0x4d, 0x01, 0x50, 0x18,                     /* add [r8+24], r10 */
+    0x4c, 0x89, 0xd0,                           /* mov rax, r10 */
+    0xc3,                                       /* ret */
+                                                /* .copy: */
+    0x49, 0x8b, 0x00,                           /* mov rax, [r8] */
+    0x49, 0x8d, 0x7c, 0x00, 0x20,               /* lea rdi, [r8+rax+32] */
+    0x31, 0xc9,                                 /* xor ecx, ecx */
+    0x49, 0x83, 0xfa, 0x10,                     /* cmp r10, 16 */
+    0x72, 0x28,                                 /* jb .copy8 */
+                                                /* .copy16: */
+    0xf3, 0x41, 0x0f, 0x6f, 0x04, 0x09,         /* movdqu xmm0, [r9+rcx] */
+    0xf3, 0x0f, 0x7f, 0x04, 0x0f,               /* movdqu [rdi+rcx], xmm0 */
+    0x48, 0x83, 0xc1, 0x10,                     /* add rcx, 16 */
+    0x48, 0x8d, 0x51, 0x10,                     /* lea rdx, [rcx+16] */
+    0x4c, 0x39, 0xd2,                           /* cmp rdx, r10 */
+    0x76, 0xe8,                                 /* jbe .copy16 */
+    0xf3, 0x43, 0x0f, 0x6f, 0x44, 0x11, 0xf0,   /* movdqu xmm0, [r9+r10-16] (overlaps the last block) */
+    0xf3, 0x42, 0x0f, 0x7f, 0x44, 0x17, 0xf0,   /* movdqu [rdi+r10-16], xmm0 */
+    0xeb, 0x40,                                 /* jmp .copied */
+                                                /* .copy8: */
+    0x49, 0x83, 0xfa, 0x08,                     /* cmp r10, 8 */
+    0x72, 0x12,                                 /* jb .copy4 */
+    0x49, 0x8b, 0x11,                           /* mov rdx, [r9] */
+    0x4b, 0x8b, 0x44, 0x11, 0xf8,               /* mov rax, [r9+r10-8] (overlaps the first) */
+    0x48, 0x89, 0x17,                           /* mov [rdi], rdx */
+    0x4a, 0x89, 0x44, 0x17, 0xf8,               /* mov [rdi+r10-8], rax */
+    0xeb, 0x28,                                 /* jmp .copied */
+                                                /* .copy4: */
+    0x49, 0x83, 0xfa, 0x04,                     /* cmp r10, 4 */
+    0x72, 0x11,                                 /* jb .copy1 */
+    0x41, 0x8b, 0x11,                           /* mov edx, [r9] */
+    0x43, 0x8b, 0x44, 0x11, 0xfc,               /* mov eax, [r9+r10-4] (overlaps the first) */
+    0x89, 0x17,                                 /* mov [rdi], edx */
+    0x42, 0x89, 0x44, 0x17, 0xfc,               /* mov [rdi+r10-4], eax */
+    0xeb, 0x11,                                 /* jmp .copied */
+                                                /* .copy1: */
+    0x4c, 0x39, 0xd1,                           /* cmp rcx, r10 */
+    0x73, 0x0c,                                 /* jae .copied */
+    0x41, 0x8a, 0x14, 0x09,                     /* mov dl, [r9+rcx] */
+    0x88, 0x14, 0x0f,                           /* mov [rdi+rcx], dl */
+    0x48, 0xff, 0xc1,                           /* inc rcx */
+    0xeb, 0xef,                                 /* jmp .copy1 */
+                                                /* .copied: */
+    0x4d, 0x01, 0x10,                           /* add [r8], r10 */
+    0x49, 0x83, 0x78, 0x08, 0x02,               /* cmp qword [r8+8], PYIMPL_LINE_ON */
+    0x75, 0x63,                                 /* jne .done */
+    0xb8, 0x0a, 0x0a, 0x0a, 0x0a,               /* mov eax, 0x0a0a0a0a */
+    0x66, 0x0f, 0x6e, 0xc8,                     /* movd xmm1, eax */
+    0x66, 0x0f, 0x70, 0xc9, 0x00,               /* pshufd xmm1, xmm1, 0 ('\n' in every byte) */
+    0x31, 0xc9,                                 /* xor ecx, ecx */
+                                                /* .scan16: */
+    0x48, 0x8d, 0x51, 0x10,                     /* lea rdx, [rcx+16] */
+    0x4c, 0x39, 0xd2,                           /* cmp rdx, r10 */
+    0x77, 0x17,                                 /* ja .scan1 */
+    0xf3, 0x41, 0x0f, 0x6f, 0x04, 0x09,         /* movdqu xmm0, [r9+rcx] */
+    0x66, 0x0f, 0x74, 0xc1,                     /* pcmpeqb xmm0, xmm1 */
+    0x66, 0x0f, 0xd7, 0xc0,                     /* pmovmskb eax, xmm0 */
+    0x85, 0xc0,                                 /* test eax, eax */
+    0x75, 0x16,                                 /* jne .flush */
+    0x48, 0x89, 0xd1,                           /* mov rcx, rdx */
+    0xeb, 0xe0,                                 /* jmp .scan16 */
+                                                /* .scan1: */
+    0x4c, 0x39, 0xd1,                           /* cmp rcx, r10 */
+    0x73, 0x2e,                                 /* jae .done */
+    0x41, 0x80, 0x3c, 0x09, 0x0a,               /* cmp byte [r9+rcx], '\n' */
+    0x74, 0x05,                                 /* je .flush */
+    0x48, 0xff, 0xc1,                           /* inc rcx */
+    0xeb, 0xef,                                 /* jmp .scan1 */
+                                                /* .flush: */
+    0x49, 0x8b, 0x10,                           /* mov rdx, [r8] */
+    0x49, 0x8d, 0x70, 0x20,                     /* lea rsi, [r8+32] */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 (write) */
+    0x0f, 0x05,                                 /* syscall */
+    0x49, 0xff, 0x40, 0x10,                     /* inc qword [r8+16] */
+    0x49, 0x01, 0x50, 0x18,                     /* add [r8+24], rdx */
+    0x49, 0xc7, 0x00, 0x00, 0x00, 0x00, 0x00,   /* mov qword [r8], 0 */
+                                                /* .done: */
+    0x4c, 0x89, 0xd0,                           /* mov rax, r10 */
+    0xc3                                        /* ret */
+};
+
+/*
+ * stdout_flush(out): writes whatever is buffered, returns how much that was
+ */
+static const uint8_t stdout_flush[] = {
+    0x49, 0x89, 0xf8,                           /* mov r8, rdi */
+    0x49, 0x8b, 0x10,                           /* mov rdx, [r8] */
+    0x31, 0xc0,                                 /* xor eax, eax */
+    0x48, 0x85, 0xd2,                           /* test rdx, rdx */
+    0x74, 0x22,                                 /* je .done */
+    0x49, 0x8d, 0x70, 0x20,                     /* lea rsi, [r8+32] */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 (write) */
+    0x0f, 0x05,                                 /* syscall */
+    0x49, 0xff, 0x40, 0x10,                     /* inc qword [r8+16] */
+    0x49, 0x8b, 0x00,                           /* mov rax, [r8] */
+    0x49, 0x01, 0x40, 0x18,                     /* add [r8+24], rax */
+    0x49, 0xc7, 0x00, 0x00, 0x00, 0x00, 0x00,   /* mov qword [r8], 0 */
+                                                /* .done: */
+    0xc3                                        /* ret */
+};
+
+/*
+ * print_int(out, value, digits): formats a signed value straight into the 
+ * buffer of a struct pyimpl_stdout, writing the buffer first when fewer than
+ * PYIMPL_INT_LENGTH bytes are left. 'digits' is a struct pyimpl_digits, the 
+ * digit count comes from bsr and one table compare, then digits are stored
+ * two at a time from the end. returns the number of characters
+ */
+static const uint8_t print_int[] = {
+    0x49, 0x89, 0xf8,                           /* mov r8, rdi */
+    0x49, 0x89, 0xd1,                           /* mov r9, rdx */
+    0x49, 0x89, 0xf2,                           /* mov r10, rsi */
+    0x49, 0x8b, 0x00,                           /* mov rax, [r8] */
+    0x48, 0x3d, 0xeb, 0x0f, 0x00, 0x00,         /* cmp rax, PYIMPL_STDOUT_SIZE - PYIMPL_INT_LENGTH */
+    0x76, 0x22,                                 /* jbe .format */
+    0x48, 0x89, 0xc2,                           /* mov rdx, rax */
+    0x49, 0x8d, 0x70, 0x20,                     /* lea rsi, [r8+32] */
+    0xbf, 0x01, 0x00, 0x00, 0x00,               /* mov edi, 1 */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 (write) */
+    0x0f, 0x05,                                 /* syscall */
+    0x49, 0xff, 0x40, 0x10,                     /* inc qword [r8+16] */
+    0x49, 0x01, 0x50, 0x18,                     /* add [r8+24], rdx */
+    0x49, 0xc7, 0x00, 0x00, 0x00, 0x00, 0x00,   /* mov qword [r8], 0 */
+                                                /* .format: */
+    0x49, 0x8b, 0x38,                           /* mov rdi, [r8] */
+    0x49, 0x8d, 0x7c, 0x38, 0x20,               /* lea rdi, [r8+rdi+32] */
+    0x45, 0x31, 0xdb,                           /* xor r11d, r11d */
+    0x4c, 0x89, 0xd0,                           /* mov rax, r10 */
+    0x48, 0x85, 0xc0,                           /* test rax, rax */
+    0x79, 0x0c,                                 /* jns .count */
+    0xc6, 0x07, 0x2d,                           /* mov byte [rdi], '-' */
+    0x48, 0xff, 0xc7,                           /* inc rdi */
+    0x49, 0xff, 0xc3,                           /* inc r11 */
+    0x48, 0xf7, 0xd8,                           /* neg rax (INT64_MIN stays correct as unsigned) */
+                                                /* .count: */
+    0x48, 0x89, 0xc1,                           /* mov rcx, rax */
+    0x48, 0x83, 0xc9, 0x01,                     /* or rcx, 1 */
+    0x48, 0x0f, 0xbd, 0xc9,                     /* bsr rcx, rcx */
+    0xff, 0xc1,                                 /* inc ecx */
+    0x69, 0xc9, 0xd1, 0x04, 0x00, 0x00,         /* imul ecx, ecx, 1233 */
+    0xc1, 0xe9, 0x0c,                           /* shr ecx, 12 (about log10 of 2^bits) */
+    0x49, 0x3b, 0x84, 0xc9, 0xd0, 0x00, 0x00, 0x00, /* cmp rax, [r9+rcx*8+208] (powers) */
+    0x48, 0x83, 0xd9, 0xff,                     /* sbb rcx, -1 */
+    0x48, 0x8d, 0x34, 0x0f,                     /* lea rsi, [rdi+rcx] */
+    0x49, 0x01, 0xcb,                           /* add r11, rcx */
+                                                /* .pairs: */
+    0x48, 0x83, 0xf8, 0x64,                     /* cmp rax, 100 */
+    0x72, 0x30,                                 /* jb .last */
+    0x49, 0x89, 0xc2,                           /* mov r10, rax */
+    0x48, 0xc1, 0xe8, 0x02,                     /* shr rax, 2 */
+    0x48, 0xba, 0xc3, 0xf5, 0x28, 0x5c, 0x8f, 0xc2, 0xf5, 0x28, /* mov rdx, 0x28f5c28f5c28f5c3 */
+    0x48, 0xf7, 0xe2,                           /* mul rdx */
+    0x48, 0xc1, 0xea, 0x02,                     /* shr rdx, 2 (value / 100) */
+    0x48, 0x6b, 0xc2, 0x64,                     /* imul rax, rdx, 100 */
+    0x49, 0x29, 0xc2,                           /* sub r10, rax */
+    0x43, 0x0f, 0xb7, 0x04, 0x51,               /* movzx eax, word [r9+r10*2] */
+    0x48, 0x83, 0xee, 0x02,                     /* sub rsi, 2 */
+    0x66, 0x89, 0x06,                           /* mov [rsi], ax */
+    0x48, 0x89, 0xd0,                           /* mov rax, rdx */
+    0xeb, 0xca,                                 /* jmp .pairs */
+                                                /* .last: */
+    0x48, 0x83, 0xf8, 0x0a,                     /* cmp rax, 10 */
+    0x72, 0x0b,                                 /* jb .single */
+    0x41, 0x0f, 0xb7, 0x04, 0x41,               /* movzx eax, word [r9+rax*2] */
+    0x66, 0x89, 0x46, 0xfe,                     /* mov [rsi-2], ax */
+    0xeb, 0x05,                                 /* jmp .done */
+                                                /* .single: */
+    0x04, 0x30,                                 /* add al, '0' */
+    0x88, 0x46, 0xff,                           /* mov [rsi-1], al */
+                                                /* .done: */
+    0x4d, 0x01, 0x18,                           /* add [r8], r11 */
+    0x4c, 0x89, 0xd8,                           /* mov rax, r11 */
+    0xc3                                        /* ret */
+};
+
+/*
+ * cpu_init(cpu): stores the level of the string routines, PYIMPL_CPU_AVX2 
+ * when the cpu has avx2 and the os saves ymm registers, PYIMPL_CPU_SSE2 
+ * otherwise. returns the level
+ */
+static const uint8_t cpu_init[] = {
+    0x49, 0x89, 0xd8,                           /* mov r8, rbx (cpuid writes it) */
+    0xb8, 0x01, 0x00, 0x00, 0x00,               /* mov eax, 1 */
+    0x0f, 0xa2,                                 /* cpuid */
+    0x41, 0xb9, 0x01, 0x00, 0x00, 0x00,         /* mov r9d, PYIMPL_CPU_SSE2 */
+    0x81, 0xe1, 0x00, 0x00, 0x00, 0x18,         /* and ecx, osxsave | avx */
+    0x81, 0xf9, 0x00, 0x00, 0x00, 0x18,         /* cmp ecx, osxsave | avx */
+    0x75, 0x24,                                 /* jne .store */
+    0x31, 0xc9,                                 /* xor ecx, ecx */
+    0x0f, 0x01, 0xd0,                           /* xgetbv */
+    0x83, 0xe0, 0x06,                           /* and eax, 6 */
+    0x83, 0xf8, 0x06,                           /* cmp eax, 6 (the os saves xmm and ymm state) */
+    0x75, 0x17,                                 /* jne .store */
+    0xb8, 0x07, 0x00, 0x00, 0x00,               /* mov eax, 7 */
+    0x31, 0xc9,                                 /* xor ecx, ecx */
+    0x0f, 0xa2,                                 /* cpuid */
+    0xf7, 0xc3, 0x20, 0x00, 0x00, 0x00,         /* test ebx, avx2 */
+    0x74, 0x06,                                 /* je .store */
+    0x41, 0xb9, 0x02, 0x00, 0x00, 0x00,         /* mov r9d, PYIMPL_CPU_AVX2 */
+                                                /* .store: */
+    0x4c, 0x89, 0xc3,                           /* mov rbx, r8 */
+    0x4c, 0x89, 0x0f,                           /* mov [rdi], r9 */
+    0x4c, 0x89, 0xc8,                           /* mov rax, r9 */
+    0xc3                                        /* ret */
+};
+
+/*
+ * find_byte(level, str, c, length): index of the first byte 'c' in 'str', -1 
+ * if there is none. 32 bytes per step on avx2, then 16 per step, the last 
+ * few bytes one at a time so nothing past 'length' is read
+ */
+static const uint8_t find_byte[] = {
+    0x0f, 0xb6, 0xc2,                           /* movzx eax, dl */
+    0x69, 0xc0, 0x01, 0x01, 0x01, 0x01,         /* imul eax, eax, 0x01010101 */
+    0x66, 0x0f, 0x6e, 0xc8,                     /* movd xmm1, eax */
+    0x66, 0x0f, 0x70, 0xc9, 0x00,               /* pshufd xmm1, xmm1, 0 (the byte in every lane) */
+    0x45, 0x31, 0xc0,                           /* xor r8d, r8d */
+    0x48, 0x83, 0xff, 0x02,                     /* cmp rdi, PYIMPL_CPU_AVX2 */
+    0x75, 0x24,                                 /* jne .sse2 */
+    0xc4, 0xe2, 0x7d, 0x78, 0xc9,               /* vpbroadcastb ymm1, xmm1 */
+                                                /* .avx2: */
+    0x4d, 0x8d, 0x48, 0x20,                     /* lea r9, [r8+32] */
+    0x49, 0x39, 0xc9,                           /* cmp r9, rcx */
+    0x77, 0x13,                                 /* ja .sse2_upper */
+    0xc4, 0xa1, 0x75, 0x74, 0x04, 0x06,         /* vpcmpeqb ymm0, ymm1, [rsi+r8] */
+    0xc5, 0xfd, 0xd7, 0xc0,                     /* vpmovmskb eax, ymm0 */
+    0x85, 0xc0,                                 /* test eax, eax */
+    0x75, 0x38,                                 /* jne .found_upper */
+    0x4d, 0x89, 0xc8,                           /* mov r8, r9 */
+    0xeb, 0xe4,                                 /* jmp .avx2 */
+                                                /* .sse2_upper: */
+    0xc5, 0xf8, 0x77,                           /* vzeroupper */
+                                                /* .sse2: */
+    0x4d, 0x8d, 0x48, 0x10,                     /* lea r9, [r8+16] */
+    0x49, 0x39, 0xc9,                           /* cmp r9, rcx */
+    0x77, 0x17,                                 /* ja .byte */
+    0xf3, 0x42, 0x0f, 0x6f, 0x04, 0x06,         /* movdqu xmm0, [rsi+r8] */
+    0x66, 0x0f, 0x74, 0xc1,                     /* pcmpeqb xmm0, xmm1 */
+    0x66, 0x0f, 0xd7, 0xc0,                     /* pmovmskb eax, xmm0 */
+    0x85, 0xc0,                                 /* test eax, eax */
+    0x75, 0x18,                                 /* jne .found */
+    0x4d, 0x89, 0xc8,                           /* mov r8, r9 */
+    0xeb, 0xe0,                                 /* jmp .sse2 */
+                                                /* .byte: */
+    0x49, 0x39, 0xc8,                           /* cmp r8, rcx */
+    0x73, 0x19,                                 /* jae .missing */
+    0x42, 0x38, 0x14, 0x06,                     /* cmp byte [rsi+r8], dl */
+    0x74, 0x0f,                                 /* je .found_byte */
+    0x49, 0xff, 0xc0,                           /* inc r8 */
+    0xeb, 0xf0,                                 /* jmp .byte */
+                                                /* .found_upper: */
+    0xc5, 0xf8, 0x77,                           /* vzeroupper */
+                                                /* .found: */
+    0x0f, 0xbc, 0xc0,                           /* bsf eax, eax */
+    0x4c, 0x01, 0xc0,                           /* add rax, r8 */
+    0xc3,                                       /* ret */
+                                                /* .found_byte: */
+    0x4c, 0x89, 0xc0,                           /* mov rax, r8 */
+    0xc3,                                       /* ret */
+                                                /* .missing: */
+    0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff,   /* mov rax, -1 */
+    0xc3                                        /* ret */
+};
+
+/*
+ * compare(level, a, b, length): difference of the first differing bytes,
+ * zero when the blocks are equal. steps like find_byte
+ */
+static const uint8_t compare[] = {
+    0x45, 0x31, 0xc0,                           /* xor r8d, r8d */
+    0x48, 0x83, 0xff, 0x02,                     /* cmp rdi, PYIMPL_CPU_AVX2 */
+    0x75, 0x27,                                 /* jne .sse2 */
+                                                /* .avx2: */
+    0x4d, 0x8d, 0x48, 0x20,                     /* lea r9, [r8+32] */
+    0x49, 0x39, 0xc9,                           /* cmp r9, rcx */
+    0x77, 0x1b,                                 /* ja .sse2_upper */
+    0xc4, 0xa1, 0x7e, 0x6f, 0x04, 0x06,         /* vmovdqu ymm0, [rsi+r8] */
+    0xc4, 0xa1, 0x7d, 0x74, 0x04, 0x02,         /* vpcmpeqb ymm0, ymm0, [rdx+r8] */
+    0xc5, 0xfd, 0xd7, 0xc0,                     /* vpmovmskb eax, ymm0 */
+    0xf7, 0xd0,                                 /* not eax (set bits are differing bytes) */
+    0x85, 0xc0,                                 /* test eax, eax */
+    0x75, 0x4a,                                 /* jne .differ_upper */
+    0x4d, 0x89, 0xc8,                           /* mov r8, r9 */
+    0xeb, 0xdc,                                 /* jmp .avx2 */
+                                                /* .sse2_upper: */
+    0xc5, 0xf8, 0x77,                           /* vzeroupper */
+                                                /* .sse2: */
+    0x4d, 0x8d, 0x48, 0x10,                     /* lea r9, [r8+16] */
+    0x49, 0x39, 0xc9,                           /* cmp r9, rcx */
+    0x77, 0x20,                                 /* ja .byte */
+    0xf3, 0x42, 0x0f, 0x6f, 0x04, 0x06,         /* movdqu xmm0, [rsi+r8] */
+    0xf3, 0x42, 0x0f, 0x6f, 0x0c, 0x02,         /* movdqu xmm1, [rdx+r8] */
+    0x66, 0x0f, 0x74, 0xc1,                     /* pcmpeqb xmm0, xmm1 */
+    0x66, 0x0f, 0xd7, 0xc0,                     /* pmovmskb eax, xmm0 */
+    0x35, 0xff, 0xff, 0x00, 0x00,               /* xor eax, 0xffff */
+    0x75, 0x21,                                 /* jne .differ */
+    0x4d, 0x89, 0xc8,                           /* mov r8, r9 */
+    0xeb, 0xd7,                                 /* jmp .sse2 */
+                                                /* .byte: */
+    0x49, 0x39, 0xc8,                           /* cmp r8, rcx */
+    0x73, 0x2e,                                 /* jae .equal */
+    0x42, 0x0f, 0xb6, 0x04, 0x06,               /* movzx eax, byte [rsi+r8] */
+    0x46, 0x0f, 0xb6, 0x0c, 0x02,               /* movzx r9d, byte [rdx+r8] */
+    0x44, 0x29, 0xc8,                           /* sub eax, r9d */
+    0x75, 0x1b,                                 /* jne .result */
+    0x49, 0xff, 0xc0,                           /* inc r8 */
+    0xeb, 0xe7,                                 /* jmp .byte */
+                                                /* .differ_upper: */
+    0xc5, 0xf8, 0x77,                           /* vzeroupper */
+                                                /* .differ: */
+    0x0f, 0xbc, 0xc0,                           /* bsf eax, eax */
+    0x49, 0x01, 0xc0,                           /* add r8, rax */
+    0x42, 0x0f, 0xb6, 0x04, 0x06,               /* movzx eax, byte [rsi+r8] */
+    0x46, 0x0f, 0xb6, 0x0c, 0x02,               /* movzx r9d, byte [rdx+r8] */
+    0x44, 0x29, 0xc8,                           /* sub eax, r9d */
+                                                /* .result: */
+    0x48, 0x63, 0xc0,                           /* movsxd rax, eax */
+    0xc3,                                       /* ret */
+                                                /* .equal: */
+    0x31, 0xc0,                                 /* xor eax, eax */
+    0xc3                                        /* ret */
+};
+
+/*
+ * alloc(heap, size): a block of the smallest class that holds 'size' plus
+ * its header, off the free list of the class or cut from the top of the
+ * region. the first call maps the region, without syscalls after that. 
+ * returns 0 and counts a failure when nothing fits
+ */
+static const uint8_t alloc[] = {
+    0x48, 0x3b, 0x77, 0x08,                     /* cmp rsi, [rdi+8] (capacity) */
+    0x0f, 0x87, 0xa2, 0x00, 0x00, 0x00,         /* ja .fail */
+    0x48, 0x83, 0x3f, 0x00,                     /* cmp qword [rdi], 0 (base) */
+    0x75, 0x31,                                 /* jne .ready */
+    0x57,                                       /* push rdi */
+    0x56,                                       /* push rsi */
+    0x48, 0x8b, 0x77, 0x08,                     /* mov rsi, [rdi+8] */
+    0x31, 0xff,                                 /* xor edi, edi */
+    0xba, 0x03, 0x00, 0x00, 0x00,               /* mov edx, PROT_READ | PROT_WRITE */
+    0x41, 0xba, 0x22, 0x40, 0x00, 0x00,         /* mov r10d, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE */
+    0x49, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff,   /* mov r8, -1 */
+    0x45, 0x31, 0xc9,                           /* xor r9d, r9d */
+    0xb8, 0x09, 0x00, 0x00, 0x00,               /* mov eax, 9 (mmap) */
+    0x0f, 0x05,                                 /* syscall */
+    0x5e,                                       /* pop rsi */
+    0x5f,                                       /* pop rdi */
+    0x48, 0x3d, 0x00, 0xf0, 0xff, 0xff,         /* cmp rax, -4096 (errors) */
+    0x77, 0x6e,                                 /* ja .fail */
+    0x48, 0x89, 0x07,                           /* mov [rdi], rax */
+                                                /* .ready: */
+    0x48, 0x8d, 0x4e, 0x07,                     /* lea rcx, [rsi+7] (size with its header, less one) */
+    0x48, 0x83, 0xc9, 0x0f,                     /* or rcx, 15 */
+    0x48, 0x0f, 0xbd, 0xc9,                     /* bsr rcx, rcx */
+    0xff, 0xc1,                                 /* inc ecx (bits of the block size) */
+    0x41, 0xba, 0x01, 0x00, 0x00, 0x00,         /* mov r10d, 1 */
+    0x49, 0xd3, 0xe2,                           /* shl r10, cl */
+    0x83, 0xe9, 0x04,                           /* sub ecx, 4 (class) */
+    0x48, 0x8b, 0x44, 0xcf, 0x38,               /* mov rax, [rdi+rcx*8+56] (free list) */
+    0x48, 0x85, 0xc0,                           /* test rax, rax */
+    0x74, 0x0a,                                 /* je .bump */
+    0x48, 0x8b, 0x10,                           /* mov rdx, [rax] */
+    0x48, 0x89, 0x54, 0xcf, 0x38,               /* mov [rdi+rcx*8+56], rdx */
+    0xeb, 0x15,                                 /* jmp .header */
+                                                /* .bump: */
+    0x48, 0x8b, 0x47, 0x10,                     /* mov rax, [rdi+16] (top) */
+    0x4a, 0x8d, 0x14, 0x10,                     /* lea rdx, [rax+r10] */
+    0x48, 0x3b, 0x57, 0x08,                     /* cmp rdx, [rdi+8] */
+    0x77, 0x2f,                                 /* ja .fail */
+    0x48, 0x89, 0x57, 0x10,                     /* mov [rdi+16], rdx */
+    0x48, 0x03, 0x07,                           /* add rax, [rdi] */
+                                                /* .header: */
+    0x48, 0x89, 0xf2,                           /* mov rdx, rsi */
+    0x48, 0xc1, 0xe2, 0x08,                     /* shl rdx, 8 */
+    0x48, 0x09, 0xca,                           /* or rdx, rcx */
+    0x48, 0x89, 0x10,                           /* mov [rax], rdx */
+    0x4c, 0x01, 0x57, 0x18,                     /* add [rdi+24], r10 (used) */
+    0x48, 0x01, 0x77, 0x20,                     /* add [rdi+32], rsi (requested) */
+    0x48, 0x8b, 0x57, 0x18,                     /* mov rdx, [rdi+24] */
+    0x48, 0x3b, 0x57, 0x28,                     /* cmp rdx, [rdi+40] (peak) */
+    0x76, 0x04,                                 /* jbe .done */
+    0x48, 0x89, 0x57, 0x28,                     /* mov [rdi+40], rdx */
+                                                /* .done: */
+    0x48, 0x83, 0xc0, 0x08,                     /* add rax, 8 */
+    0xc3,                                       /* ret */
+                                                /* .fail: */
+    0x48, 0xff, 0x47, 0x30,                     /* inc qword [rdi+48] (failures) */
+    0x31, 0xc0,                                 /* xor eax, eax */
+    0xc3                                        /* ret */
+};
+
+/*
+ * free(heap, ptr): puts the block of 'ptr' on the free list of its class,
+ * ignores 0
+ */
+static const uint8_t free_block[] = {
+    0x48, 0x85, 0xf6,                           /* test rsi, rsi */
+    0x74, 0x2b,                                 /* je .done */
+    0x48, 0x8d, 0x46, 0xf8,                     /* lea rax, [rsi-8] */
+    0x48, 0x8b, 0x10,                           /* mov rdx, [rax] */
+    0x0f, 0xb6, 0xca,                           /* movzx ecx, dl (class) */
+    0x48, 0xc1, 0xea, 0x08,                     /* shr rdx, 8 (requested) */
+    0x48, 0x29, 0x57, 0x20,                     /* sub [rdi+32], rdx */
+    0xba, 0x10, 0x00, 0x00, 0x00,               /* mov edx, 16 */
+    0x48, 0xd3, 0xe2,                           /* shl rdx, cl */
+    0x48, 0x29, 0x57, 0x18,                     /* sub [rdi+24], rdx */
+    0x48, 0x8b, 0x54, 0xcf, 0x38,               /* mov rdx, [rdi+rcx*8+56] */
+    0x48, 0x89, 0x10,                           /* mov [rax], rdx (the header becomes the link) */
+    0x48, 0x89, 0x44, 0xcf, 0x38,               /* mov [rdi+rcx*8+56], rax */
+                                                /* .done: */
+    0x31, 0xc0,                                 /* xor eax, eax */
+    0xc3                                        /* ret */
+};
+
+/*
+ * store(ptr, index, value): writes the 'index'th word of 'ptr', returns 
+ * 'value'
+ */
+static const uint8_t store[] = {
+    0x48, 0x89, 0x14, 0xf7,                     /* mov [rdi+rsi*8], rdx */
+    0x48, 0x89, 0xd0,                           /* mov rax, rdx */
+    0xc3                                        /* ret */
+};
+
+static const struct {
+    const char *name;
+    const uint8_t *code;
+    size_t length;
+} routines[] = {
+    { PYIMPL_NATIVE_PREFIX "stdout_write", stdout_write, sizeof(stdout_write) },
+    { PYIMPL_NATIVE_PREFIX "stdout_flush", stdout_flush, sizeof(stdout_flush) },
+    { PYIMPL_NATIVE_PREFIX "print_int", print_int, sizeof(print_int) },
+    { PYIMPL_NATIVE_PREFIX "cpu_init", cpu_init, sizeof(cpu_init) },
+    { PYIMPL_NATIVE_PREFIX "find_byte", find_byte, sizeof(find_byte) },
+    { PYIMPL_NATIVE_PREFIX "compare", compare, sizeof(compare) },
+    { PYIMPL_NATIVE_PREFIX "alloc", alloc, sizeof(alloc) },
+    { PYIMPL_NATIVE_PREFIX "free", free_block, sizeof(free_block) },
+    { PYIMPL_NATIVE_PREFIX "store", store, sizeof(store) }
+};
+
+size_t pynative_apply(struct vscc_codegen_data *data, struct vscc_context *ctx)
+{
+    struct pyasm_image image;
+    size_t applied = 0;
+
+    /*
+     * the first instruction of a routine becomes its machine code, the rest 
+     * of the ir body is dropped
+     */
+    if (pyasm_image_init(&image, data, ctx)) {
+        for (size_t i = 0; i < image.functionc; i++) {
+            struct pyasm_function *fn = &image.functions[i];
+            for (size_t j = 0; j < sizeof(routines) / sizeof(*routines) && fn->count; j++) {
+                if (strcmp(fn->symbol->symbol_name, routines[j].name) != 0)
+                    continue;
+
+                image.edits[fn->first].code = routines[j].code;
+                image.edits[fn->first].code_length = routines[j].length;
+                for (size_t k = 1; k < fn->count; k++)
+                    image.edits[fn->first + k] = (struct pyasm_edit){ .replaced = true, .length = 0, .rel_at = -1 };
+                applied++;
+            }
+        }
+
+        if (applied && !pyasm_relink(&image))
+            applied = 0;
+    }
+
+    pyasm_image_free(&image);
+    return applied;
+}
\ No newline at end of file
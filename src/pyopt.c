@@ -0,0 +1,467 @@
+#include "pyopt.h"
+#include "pysym.h"
+#include "pyperf.h"
+
+#include "ir/intermediate.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FOLD_MAX_PASSES 8
+
+/*
+ * known value of every local register at some point in the function
+ */
+struct fold_state {
+    bool *known;
+    int64_t *value;
+};
+
+struct fold_label {
+    bool declared;
+    bool backward;
+    bool has_state;
+    struct fold_state state;
+};
+
+struct fold_context {
+    struct vscc_function *fn;
+    struct pysym_table index;
+
+    struct vscc_register **registers;
+    bool *pinned;
+    size_t count;
+
+    struct fold_label *labels;
+    size_t labelc;
+
+    struct fold_state state;
+};
+
+static bool is_conditional_jump(enum vscc_opcode opcode)
+{
+    return opcode == O_JE || opcode == O_JNE || opcode == O_JG || opcode == O_JL;
+}
+
+static bool is_math(enum vscc_opcode opcode)
+{
+    return opcode == O_ADD || opcode == O_SUB || opcode == O_MUL || opcode == O_DIV;
+}
+
+static bool is_supported(enum vscc_opcode opcode)
+{
+    switch (opcode) {
+    case O_STORE: case O_LOAD: case O_LEA:
+    case O_ADD: case O_SUB: case O_MUL: case O_DIV: case O_CMP:
+    case O_JMP: case O_JE: case O_JNE: case O_JG: case O_JL: case O_DECLABEL:
+    case O_RET: case O_PSHARG: case O_CALL: case O_SYSCALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int64_t sized(int64_t value, size_t size)
+{
+    /* registers hold sign-extended values of their own width */
+    if (size >= sizeof(int64_t) || size == 0)
+        return value;
+    int shift = 64 - size * 8;
+    return (int64_t)((uint64_t)value << shift) >> shift;
+}
+
+/*
+ * register index (slot + 1, so that zero means not a local)
+ */
+static size_t slot_of(struct fold_context *fc, struct vscc_register *reg)
+{
+    return reg ? (uintptr_t)pysym_get(&fc->index, (const char*)reg) : 0;
+}
+
+static bool get_known(struct fold_context *fc, struct vscc_register *reg, int64_t *value)
+{
+    size_t slot = slot_of(fc, reg);
+    if (slot == 0 || !fc->state.known[slot - 1])
+        return false;
+    *value = fc->state.value[slot - 1];
+    return true;
+}
+
+static void set_known(struct fold_context *fc, struct vscc_register *reg, int64_t value)
+{
+    size_t slot = slot_of(fc, reg);
+    if (slot == 0 || fc->pinned[slot - 1])
+        return;
+    fc->state.known[slot - 1] = true;
+    fc->state.value[slot - 1] = sized(value, reg->size);
+}
+
+static void set_unknown(struct fold_context *fc, struct vscc_register *reg)
+{
+    size_t slot = slot_of(fc, reg);
+    if (slot != 0)
+        fc->state.known[slot - 1] = false;
+}
+
+static void state_alloc(struct fold_context *fc, struct fold_state *state)
+{
+    state->known = pyperf_calloc(fc->count + 1, sizeof(bool));
+    state->value = pyperf_calloc(fc->count + 1, sizeof(int64_t));
+}
+
+static void state_free(struct fold_state *state)
+{
+    free(state->known);
+    free(state->value);
+}
+
+static void state_merge(struct fold_context *fc, struct fold_state *dst, struct fold_state *src)
+{
+    for (size_t i = 0; i < fc->count; i++)
+        dst->known[i] = dst->known[i] && src->known[i] && dst->value[i] == src->value[i];
+}
+
+static void state_copy(struct fold_context *fc, struct fold_state *dst, struct fold_state *src)
+{
+    memcpy(dst->known, src->known, fc->count * sizeof(bool));
+    memcpy(dst->value, src->value, fc->count * sizeof(int64_t));
+}
+
+/*
+ * record the current state as flowing into a label
+ */
+static void edge_to(struct fold_context *fc, uintptr_t label)
+{
+    struct fold_label *l = &fc->labels[label];
+    if (l->backward)
+        return;
+
+    if (!l->has_state) {
+        state_alloc(fc, &l->state);
+        state_copy(fc, &l->state, &fc->state);
+        l->has_state = true;
+    }
+    else
+        state_merge(fc, &l->state, &fc->state);
+}
+
+/*
+ * replace an instruction in place with one built by vscc itself, so the 
+ * operand encoding always matches what codegen expects
+ */
+static void rewrite_reg_imm(struct vscc_instruction *insn, enum vscc_opcode opcode, struct vscc_register *dest, uintptr_t imm)
+{
+    struct vscc_function scratch = { 0 };
+    struct vscc_instruction *next = insn->next;
+
+    vscc_push0(&scratch, opcode, dest, imm);
+    memcpy(insn, scratch.instruction_stream, sizeof(struct vscc_instruction));
+    insn->next = next;
+    free(scratch.instruction_stream);
+}
+
+static void rewrite_imm(struct vscc_instruction *insn, enum vscc_opcode opcode, uintptr_t imm)
+{
+    struct vscc_function scratch = { 0 };
+    struct vscc_instruction *next = insn->next;
+
+    vscc_push2(&scratch, opcode, imm);
+    memcpy(insn, scratch.instruction_stream, sizeof(struct vscc_instruction));
+    insn->next = next;
+    free(scratch.instruction_stream);
+}
+
+static void remove_after(struct vscc_function *fn, struct vscc_instruction *prev, struct vscc_instruction *insn)
+{
+    if (prev)
+        prev->next = insn->next;
+    else
+        fn->instruction_stream = insn->next;
+    free(insn);
+}
+
+static bool evaluate_jump(enum vscc_opcode opcode, int64_t a, int64_t b)
+{
+    switch (opcode) {
+    case O_JE: return a == b;
+    case O_JNE: return a != b;
+    case O_JG: return a > b;
+    case O_JL: return a < b;
+    default: return false;
+    }
+}
+
+static bool evaluate_math(enum vscc_opcode opcode, int64_t a, int64_t b, int64_t *res)
+{
+    switch (opcode) {
+    case O_ADD: *res = (int64_t)((uint64_t)a + (uint64_t)b); return true;
+    case O_SUB: *res = (int64_t)((uint64_t)a - (uint64_t)b); return true;
+    case O_MUL: *res = (int64_t)((uint64_t)a * (uint64_t)b); return true;
+    case O_DIV:
+        /* leave faulting divisions for runtime */
+        if (b == 0 || (a == INT64_MIN && b == -1))
+            return false;
+        *res = a / b;
+        return true;
+    default: 
+        return false;
+    }
+}
+
+static bool fold_init(struct fold_context *fc, struct vscc_function *fn)
+{
+    memset(fc, 0, sizeof(*fc));
+    fc->fn = fn;
+
+    for (struct vscc_register *reg = fn->register_stream; reg; reg = reg->next)
+        fc->count++;
+
+    fc->registers = pyperf_malloc((fc->count + 1) * sizeof(struct vscc_register*));
+    fc->pinned = pyperf_calloc(fc->count + 1, sizeof(bool));
+
+    size_t slot = 0;
+    for (struct vscc_register *reg = fn->register_stream; reg; reg = reg->next) {
+        fc->registers[slot] = reg;
+        pysym_put(&fc->index, (const char*)reg, (void*)(++slot));
+    }
+
+    /*
+     * find labels, which are only jumped to backwards, and registers whose address escapes
+     */
+    uintptr_t max_label = 0;
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        if (!is_supported(insn->opcode))
+            return false;
+        if ((insn->opcode == O_DECLABEL || insn->opcode == O_JMP || is_conditional_jump(insn->opcode)) && insn->imm1 > max_label)
+            max_label = insn->imm1;
+    }
+
+    fc->labelc = max_label + 1;
+    fc->labels = pyperf_calloc(fc->labelc, sizeof(struct fold_label));
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        if (insn->opcode == O_DECLABEL)
+            fc->labels[insn->imm1].declared = true;
+        else if ((insn->opcode == O_JMP || is_conditional_jump(insn->opcode)) && fc->labels[insn->imm1].declared)
+            fc->labels[insn->imm1].backward = true;
+        else if (insn->opcode == O_LEA && slot_of(fc, insn->src))
+            fc->pinned[slot_of(fc, insn->src) - 1] = true;
+    }
+
+    state_alloc(fc, &fc->state);
+    return true;
+}
+
+static void fold_free(struct fold_context *fc)
+{
+    for (size_t i = 0; i < fc->labelc; i++)
+        if (fc->labels[i].has_state)
+            state_free(&fc->labels[i].state);
+
+    state_free(&fc->state);
+    free(fc->labels);
+    free(fc->registers);
+    free(fc->pinned);
+    pysym_free(&fc->index, false);
+}
+
+static size_t fold_pass(struct fold_context *fc)
+{
+    struct vscc_function *fn = fc->fn;
+    size_t removed = 0;
+    bool reachable = true;
+
+    /* most recent compare with both operands known */
+    struct vscc_instruction *cmp = NULL;
+    struct vscc_instruction *cmp_prev = NULL;
+    int64_t cmp_a = 0;
+    int64_t cmp_b = 0;
+
+    struct vscc_instruction *prev = NULL;
+    for (struct vscc_instruction *insn = fn->instruction_stream, *next; insn; insn = next) {
+        next = insn->next;
+        int64_t a, res;
+
+        if (insn->opcode == O_DECLABEL) {
+            struct fold_label *l = &fc->labels[insn->imm1];
+            if (l->backward)
+                memset(fc->state.known, 0, fc->count * sizeof(bool));
+            else if (reachable && l->has_state)
+                state_merge(fc, &fc->state, &l->state);
+            else if (!reachable && l->has_state)
+                state_copy(fc, &fc->state, &l->state);
+            else if (!reachable)
+                memset(fc->state.known, 0, fc->count * sizeof(bool));
+
+            reachable = true;
+            cmp = NULL;
+            prev = insn;
+            continue;
+        }
+
+        /* nothing jumps between here and the next label */
+        if (!reachable) {
+            remove_after(fn, prev, insn);
+            removed++;
+            continue;
+        }
+
+        /*
+         * propagate known sources into immediates
+         */
+        if (insn->src && (insn->opcode == O_STORE || insn->opcode == O_CMP || is_math(insn->opcode)) && get_known(fc, insn->src, &a))
+            rewrite_reg_imm(insn, insn->opcode, insn->dest, a);
+        else if (insn->dest && (insn->opcode == O_RET || insn->opcode == O_PSHARG) && get_known(fc, insn->dest, &a))
+            rewrite_imm(insn, insn->opcode, a);
+
+        if (insn->opcode != O_CMP && !is_conditional_jump(insn->opcode))
+            cmp = NULL;
+
+        switch (insn->opcode) {
+        case O_STORE:
+            if (insn->src == NULL)
+                set_known(fc, insn->dest, insn->imm1);
+            else
+                set_unknown(fc, insn->dest);
+            break;
+        case O_ADD:
+        case O_SUB:
+        case O_MUL:
+        case O_DIV:
+            if (insn->src == NULL && get_known(fc, insn->dest, &a) && evaluate_math(insn->opcode, a, sized(insn->imm1, insn->dest->size), &res)) {
+                rewrite_reg_imm(insn, O_STORE, insn->dest, res);
+                set_known(fc, insn->dest, res);
+            }
+            else
+                set_unknown(fc, insn->dest);
+            break;
+        case O_CMP:
+            cmp = NULL;
+            if (insn->src == NULL && get_known(fc, insn->dest, &a)) {
+                cmp = insn;
+                cmp_prev = prev;
+                cmp_a = a;
+                cmp_b = sized(insn->imm1, insn->dest->size);
+            }
+            break;
+        case O_JE:
+        case O_JNE:
+        case O_JG:
+        case O_JL:
+            if (cmp == NULL) {
+                edge_to(fc, insn->imm1);
+                break;
+            }
+
+            /* the compare can go once no other jump reads its result */
+            if (cmp->next == insn && (next == NULL || !is_conditional_jump(next->opcode))) {
+                remove_after(fn, cmp_prev, cmp);
+                prev = cmp_prev;
+                cmp = NULL;
+                removed++;
+            }
+
+            if (evaluate_jump(insn->opcode, cmp_a, cmp_b)) {
+                rewrite_imm(insn, O_JMP, insn->imm1);
+                edge_to(fc, insn->imm1);
+                reachable = false;
+            }
+            else {
+                remove_after(fn, prev, insn);
+                removed++;
+                continue;
+            }
+            break;
+        case O_JMP:
+            /* jumping to the very next instruction */
+            if (next && next->opcode == O_DECLABEL && next->imm1 == insn->imm1) {
+                remove_after(fn, prev, insn);
+                removed++;
+                continue;
+            }
+
+            edge_to(fc, insn->imm1);
+            reachable = false;
+            break;
+        case O_RET:
+            reachable = false;
+            break;
+        case O_LOAD:
+        case O_LEA:
+        case O_CALL:
+            set_unknown(fc, insn->dest);
+            break;
+        default:
+            break;
+        }
+
+        prev = insn;
+    }
+
+    return removed;
+}
+
+/*
+ * drop writes to locals which are never read
+ */
+static size_t remove_unread_stores(struct fold_context *fc)
+{
+    struct vscc_function *fn = fc->fn;
+    bool *read = pyperf_calloc(fc->count + 1, sizeof(bool));
+    size_t removed = 0;
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        /* syscall operands are not visible here, keep everything */
+        if (insn->opcode == O_SYSCALL) {
+            free(read);
+            return 0;
+        }
+
+        size_t slot = slot_of(fc, insn->src);
+        if (slot)
+            read[slot - 1] = true;
+
+        slot = slot_of(fc, insn->dest);
+        if (slot && (insn->opcode == O_CMP || is_math(insn->opcode) || insn->opcode == O_RET || insn->opcode == O_PSHARG))
+            read[slot - 1] = true;
+    }
+
+    struct vscc_instruction *prev = NULL;
+    for (struct vscc_instruction *insn = fn->instruction_stream, *next; insn; insn = next) {
+        next = insn->next;
+        size_t slot = slot_of(fc, insn->dest);
+
+        bool is_write = insn->opcode == O_STORE || insn->opcode == O_LOAD || insn->opcode == O_LEA || is_math(insn->opcode);
+        if (is_write && slot && !read[slot - 1] && !fc->pinned[slot - 1]) {
+            remove_after(fn, prev, insn);
+            removed++;
+            continue;
+        }
+        prev = insn;
+    }
+
+    free(read);
+    return removed;
+}
+
+size_t pyopt_fold_constants(struct vscc_function *fn)
+{
+    struct fold_context fc;
+    size_t removed = 0;
+
+    for (int i = 0; i < FOLD_MAX_PASSES; i++) {
+        if (!fold_init(&fc, fn)) {
+            fold_free(&fc);
+            break;
+        }
+
+        size_t pass = fold_pass(&fc);
+        pass += remove_unread_stores(&fc);
+        fold_free(&fc);
+
+        removed += pass;
+        if (pass == 0)
+            break;
+    }
+
+    return removed;
+}
\ No newline at end of file
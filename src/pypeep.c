@@ -0,0 +1,160 @@
+#include "pypeep.h"
+#include "pyperf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *pattern_names[PEEP_PATTERN_COUNT] = {
+    [PEEP_STORE_BACK] = "store back",
+    [PEEP_SELF_MOVE] = "self move",
+    [PEEP_JUMP_NEXT] = "jump to next",
+    [PEEP_SHORT_IMM] = "short immediate"
+};
+
+const char *pypeep_pattern_name(enum pypeep_pattern pattern)
+{
+    return pattern_names[pattern];
+}
+
+static void record(struct pypeep_stats *stats, enum pypeep_pattern pattern, size_t bytes)
+{
+    stats->hits[pattern]++;
+    stats->bytes[pattern] += bytes;
+}
+
+static void delete(struct pyasm_image *image, size_t index)
+{
+    image->edits[index].replaced = true;
+    image->edits[index].length = 0;
+    image->edits[index].rel_at = -1;
+}
+
+static bool is_mov(struct pyasm_insn *insn, uint8_t opcode)
+{
+    return !insn->two_byte && insn->opcode == opcode && (insn->rex & 8) && !insn->opsize && !insn->rep;
+}
+
+/*
+ * true if the memory operand of 'insn' is addressed through 'reg'
+ */
+static bool addresses_with(struct pyasm_insn *insn, int reg)
+{
+    int mod = insn->modrm >> 6;
+    if (mod == 3 || insn->rip_relative)
+        return false;
+
+    if (!insn->has_sib)
+        return (((insn->rex & 1) << 3) | (insn->modrm & 7)) == reg;
+
+    int base = ((insn->rex & 1) << 3) | (insn->sib & 7);
+    int index = ((insn->rex & 2) << 2) | ((insn->sib >> 3) & 7);
+    return (base == reg && !(mod == 0 && (insn->sib & 7) == 5)) || (index == reg && index != GPR_RSP);
+}
+
+/*
+ * mov r, m followed by mov m, r with the same operands stores what was just loaded
+ */
+static bool is_store_back(struct pyasm_image *image, struct pyasm_insn *load, struct pyasm_insn *store)
+{
+    if (!is_mov(load, 0x8b) || !is_mov(store, 0x89) || load->rip_relative || load->length != store->length)
+        return false;
+
+    const uint8_t *a = image->data->buffer + load->offset;
+    const uint8_t *b = image->data->buffer + store->offset;
+    int reg = ((load->rex & 4) << 1) | ((load->modrm >> 3) & 7);
+
+    return load->rex == store->rex && !addresses_with(load, reg) &&
+        !memcmp(a + load->modrm_at, b + store->modrm_at, load->length - load->modrm_at);
+}
+
+static bool is_self_move(struct pyasm_insn *insn)
+{
+    if ((!is_mov(insn, 0x8b) && !is_mov(insn, 0x89)) || (insn->modrm >> 6) != 3)
+        return false;
+    return (((insn->rex & 4) << 1) | ((insn->modrm >> 3) & 7)) == (((insn->rex & 1) << 3) | (insn->modrm & 7));
+}
+
+static bool is_jump(struct pyasm_insn *insn)
+{
+    return !insn->two_byte && (insn->opcode == 0xe9 || insn->opcode == 0xeb);
+}
+
+/*
+ * mov r64, imm32/imm64 of a non-negative 32-bit value becomes mov r32, imm32
+ */
+static bool shorten_immediate(struct pyasm_image *image, size_t index)
+{
+    struct pyasm_insn *insn = &image->insns[index];
+    struct pyasm_edit *edit = &image->edits[index];
+    int reg;
+
+    if (is_mov(insn, 0xc7) && (insn->modrm >> 6) == 3 && ((insn->modrm >> 3) & 7) == 0)
+        reg = ((insn->rex & 1) << 3) | (insn->modrm & 7);
+    else if (!insn->two_byte && (insn->rex & 8) && insn->opcode >= 0xb8 && insn->opcode <= 0xbf)
+        reg = ((insn->rex & 1) << 3) | (insn->opcode & 7);
+    else
+        return false;
+
+    if (insn->imm < 0 || insn->imm > UINT32_MAX || insn->opsize || insn->rep || insn->opcode_at != 1)
+        return false;
+
+    uint32_t imm = insn->imm;
+    uint8_t *dst = edit->bytes;
+    if (reg >= GPR_R8)
+        *dst++ = 0x41;
+    *dst++ = 0xb8 | (reg & 7);
+    memcpy(dst, &imm, sizeof(imm));
+    dst += sizeof(imm);
+
+    edit->replaced = true;
+    edit->length = dst - edit->bytes;
+    edit->rel_at = -1;
+    return true;
+}
+
+void pypeep_optimize(struct pyasm_image *image, struct pypeep_stats *stats)
+{
+    /*
+     * instructions something jumps to can not be merged with their predecessor
+     */
+    bool *target = pyperf_calloc(image->insnc + 1, sizeof(bool));
+    for (size_t i = 0; i < image->insnc; i++) {
+        struct pyasm_insn *insn = &image->insns[i];
+        if (insn->relative && insn->target >= 0 && insn->target < image->code_end) {
+            size_t j = pyasm_find(image, insn->target);
+            if (j != (size_t)-1)
+                target[j] = true;
+        }
+    }
+    for (size_t i = 0; i < image->functionc; i++)
+        target[image->functions[i].first] = true;
+
+    for (size_t i = 0; i < image->insnc; i++) {
+        struct pyasm_insn *insn = &image->insns[i];
+
+        if (is_self_move(insn)) {
+            delete(image, i);
+            record(stats, PEEP_SELF_MOVE, insn->length);
+            continue;
+        }
+
+        if (i + 1 < image->insnc && !target[i + 1] && is_store_back(image, insn, &image->insns[i + 1])) {
+            delete(image, i + 1);
+            record(stats, PEEP_STORE_BACK, image->insns[i + 1].length);
+            i++;
+            continue;
+        }
+
+        if (shorten_immediate(image, i)) {
+            record(stats, PEEP_SHORT_IMM, insn->length - image->edits[i].length);
+            continue;
+        }
+
+        if (is_jump(insn) && insn->target == (int64_t)insn->offset + insn->length) {
+            delete(image, i);
+            record(stats, PEEP_JUMP_NEXT, insn->length);
+        }
+    }
+
+    free(target);
+}
\ No newline at end of file
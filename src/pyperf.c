@@ -0,0 +1,245 @@
+#include "pyperf.h"
+#include "pysym.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/resource.h>
+
+static _Atomic size_t allocations;
+static _Atomic size_t allocated_bytes;
+
+static atomic_bool counting;
+
+static void count_allocation(size_t size)
+{
+    if (atomic_load_explicit(&counting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&allocated_bytes, size, memory_order_relaxed);
+    }
+}
+
+void *pyperf_malloc(size_t size)
+{
+    count_allocation(size);
+    return malloc(size);
+}
+
+void *pyperf_calloc(size_t count, size_t size)
+{
+    count_allocation(count * size);
+    return calloc(count, size);
+}
+
+void *pyperf_realloc(void *ptr, size_t size)
+{
+    count_allocation(size);
+    return realloc(ptr, size);
+}
+
+void *pyperf_aligned_alloc(size_t alignment, size_t size)
+{
+    count_allocation(size);
+    return aligned_alloc(alignment, size);
+}
+
+int64_t pyperf_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + (int64_t)ts.tv_nsec / 1000;
+}
+
+size_t pyperf_peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+void pyperf_begin(struct pyperf *perf, const char *name)
+{
+    if (!perf || perf->phasec == PERF_MAX_PHASES)
+        return;
+
+    atomic_store_explicit(&counting, true, memory_order_relaxed);
+    perf->phases[perf->phasec].name = name;
+    perf->start_allocations = atomic_load_explicit(&allocations, memory_order_relaxed);
+    perf->start_allocated_bytes = atomic_load_explicit(&allocated_bytes, memory_order_relaxed);
+    perf->start = pyperf_time_us();
+}
+
+void pyperf_end(struct pyperf *perf)
+{
+    if (!perf || perf->phasec == PERF_MAX_PHASES)
+        return;
+
+    struct pyperf_phase *phase = &perf->phases[perf->phasec++];
+    phase->us = pyperf_time_us() - perf->start;
+    phase->allocations = atomic_load_explicit(&allocations, memory_order_relaxed) - perf->start_allocations;
+    phase->allocated_bytes = atomic_load_explicit(&allocated_bytes, memory_order_relaxed) - perf->start_allocated_bytes;
+    phase->peak_rss = pyperf_peak_rss();
+}
+
+struct function_span {
+    uintptr_t offset;
+    size_t index;
+};
+
+static int compare_span(const void *a, const void *b)
+{
+    const struct function_span *x = a;
+    const struct function_span *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+void pyperf_summarize(struct pyperf *perf, const struct lexer_stream *tokens, const struct vscc_context *ctx, const struct vscc_codegen_data *data)
+{
+    if (!perf)
+        return;
+
+    perf->tokens = tokens ? tokens->count : 0;
+    perf->code_bytes = data ? data->length : 0;
+    perf->data_bytes = 0;
+    if (!ctx || !data)
+        return;
+
+    size_t fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        fnc++;
+    if (!fnc)
+        return;
+
+    free(perf->functions);
+    perf->functions = calloc(fnc + 1, sizeof(struct pyperf_function));
+    perf->functionc = fnc;
+
+    /*
+     * symbols naming a function are code, the first one that does not starts
+     * the data. every function runs up to the next one in the image
+     */
+    struct pysym_table strings = { 0 };
+    struct pysym_table indices = { 0 };
+    struct function_span *spans = malloc((fnc + 1) * sizeof(struct function_span));
+    size_t spanc = 0;
+    size_t code_end = data->length;
+
+    fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next, fnc++) {
+        struct pyperf_function *out = &perf->functions[fnc];
+        snprintf(out->name, sizeof(out->name), "%s", fn->symbol_name);
+        for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next)
+            out->instructions++;
+        pysym_put(&indices, pysym_intern(&strings, fn->symbol_name, strlen(fn->symbol_name)), &perf->functions[fnc]);
+    }
+
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next) {
+        struct pyperf_function *fn = pysym_get(&indices, pysym_intern(&strings, symbol->symbol_name, strlen(symbol->symbol_name)));
+        if (fn)
+            spans[spanc++] = (struct function_span){ .offset = symbol->offset, .index = fn - perf->functions };
+        else if (symbol->offset < code_end)
+            code_end = symbol->offset;
+    }
+
+    qsort(spans, spanc, sizeof(struct function_span), compare_span);
+    for (size_t i = 0; i < spanc; i++) {
+        size_t end = i + 1 < spanc ? spans[i + 1].offset : code_end;
+        perf->functions[spans[i].index].bytes = end > spans[i].offset ? end - spans[i].offset : 0;
+    }
+
+    perf->code_bytes = code_end;
+    perf->data_bytes = data->length - code_end;
+
+    free(spans);
+    pysym_free(&indices, false);
+    pysym_free(&strings, true);
+}
+
+void pyperf_print(const struct pyperf *perf)
+{
+    int64_t total_us = 0;
+    size_t total_allocations = 0;
+    size_t total_bytes = 0;
+
+    printf("pyvscc: %-10s %12s %12s %14s %12s\n", "phase", "time (us)", "own allocs", "own bytes (B)", "peak rss (kB)");
+    for (size_t i = 0; i < perf->phasec; i++) {
+        const struct pyperf_phase *phase = &perf->phases[i];
+        printf("pyvscc: %-10s %12ld %12zu %14zu %12zu\n", phase->name, phase->us, phase->allocations, phase->allocated_bytes, phase->peak_rss);
+        total_us += phase->us;
+        total_allocations += phase->allocations;
+        total_bytes += phase->allocated_bytes;
+    }
+    printf("pyvscc: %-10s %12ld %12zu %14zu %12zu\n", "total", total_us, total_allocations, total_bytes, pyperf_peak_rss());
+
+    size_t instructions = 0;
+    for (size_t i = 0; i < perf->functionc; i++)
+        instructions += perf->functions[i].instructions;
+
+    printf("pyvscc: %zu tokens, %zu ir instructions in %zu functions, %zu bytes of code, %zu bytes of data\n",
+        perf->tokens, instructions, perf->functionc, perf->code_bytes, perf->data_bytes);
+}
+
+static void json_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(f, "\\u%04x", *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+/*
+ * allocation counts are named after pyvscc since they leave out vscc, peak 
+ * rss is the one figure that covers both
+ */
+bool pyperf_write_json(const struct pyperf *perf, const char *path, const char *source, bool optimize, size_t threads)
+{
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE *f = to_stdout ? stdout : fopen(path, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "{\n  \"source\": ");
+    json_string(f, source ? source : "");
+    fprintf(f, ",\n  \"optimize\": %s,\n  \"threads\": %zu,\n", optimize ? "true" : "false", threads);
+    fprintf(f, "  \"tokens\": %zu,\n  \"code_bytes\": %zu,\n  \"data_bytes\": %zu,\n  \"peak_rss_kb\": %zu,\n",
+        perf->tokens, perf->code_bytes, perf->data_bytes, pyperf_peak_rss());
+
+    fprintf(f, "  \"phases\": [");
+    for (size_t i = 0; i < perf->phasec; i++) {
+        const struct pyperf_phase *phase = &perf->phases[i];
+        fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+        json_string(f, phase->name);
+        fprintf(f, ", \"us\": %ld, \"pyvscc_allocations\": %zu, \"pyvscc_allocated_bytes\": %zu, \"peak_rss_kb\": %zu }",
+            phase->us, phase->allocations, phase->allocated_bytes, phase->peak_rss);
+    }
+    fprintf(f, "%s],\n", perf->phasec ? "\n  " : "");
+
+    fprintf(f, "  \"functions\": [");
+    for (size_t i = 0; i < perf->functionc; i++) {
+        const struct pyperf_function *fn = &perf->functions[i];
+        fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+        json_string(f, fn->name);
+        fprintf(f, ", \"instructions\": %zu, \"bytes\": %zu }", fn->instructions, fn->bytes);
+    }
+    fprintf(f, "%s]\n}\n", perf->functionc ? "\n  " : "");
+
+    if (to_stdout)
+        return fflush(f) == 0;
+    return fclose(f) == 0;
+}
+
+void pyperf_free(struct pyperf *perf)
+{
+    free(perf->functions);
+    perf->functions = NULL;
+    perf->functionc = 0;
+}
\ No newline at end of file
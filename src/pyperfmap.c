@@ -0,0 +1,231 @@
+#include "pyperfmap.h"
+#include "pysym.h"
+#include "pyperf.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define JITDUMP_MAGIC 0x4A695444
+#define JITDUMP_VERSION 1
+
+#define JIT_CODE_LOAD 0
+#define JIT_CODE_CLOSE 3
+
+struct jitdump_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct jitdump_record {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+/* followed by the NUL terminated name and the code */
+struct jitdump_load {
+    struct jitdump_record record;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+struct span {
+    const char *name;
+    uintptr_t start;
+    uintptr_t end;
+};
+
+static int compare_span(const void *a, const void *b)
+{
+    const struct span *x = a;
+    const struct span *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+size_t pyperfmap_code_end(const struct vscc_codegen_data *data, const struct vscc_context *ctx)
+{
+    struct pysym_table strings = { 0 };
+    struct pysym_table names = { 0 };
+    size_t code_end = data->length;
+
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        pysym_put(&names, pysym_intern(&strings, fn->symbol_name, strlen(fn->symbol_name)), fn);
+
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        if (!pysym_get(&names, pysym_intern(&strings, symbol->symbol_name, strlen(symbol->symbol_name))) && symbol->offset < code_end)
+            code_end = symbol->offset;
+
+    pysym_free(&names, false);
+    pysym_free(&strings, true);
+    return code_end;
+}
+
+/*
+ * code symbols ordered by offset, each running up to the next one. the
+ * last function ends where the data starts
+ */
+static size_t collect_spans(const struct vscc_codegen_data *data, size_t code_end, struct span **spans)
+{
+    size_t count = 0;
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        count++;
+    *spans = pyperf_malloc((count + 1) * sizeof(struct span));
+
+    count = 0;
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next)
+        if (symbol->offset < code_end)
+            (*spans)[count++] = (struct span){ .name = symbol->symbol_name, .start = symbol->offset };
+
+    qsort(*spans, count, sizeof(struct span), compare_span);
+    for (size_t i = 0; i < count; i++)
+        (*spans)[i].end = i + 1 < count ? (*spans)[i + 1].start : code_end;
+    return count;
+}
+
+bool pyperfmap_write(const struct vscc_codegen_data *data, size_t code_end, const void *base)
+{
+    char path[64];
+    snprintf(path, sizeof(path), PERFMAP_PATH, (int)getpid());
+
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    struct span *spans;
+    size_t count = collect_spans(data, code_end, &spans);
+    for (size_t i = 0; i < count; i++)
+        if (spans[i].end > spans[i].start)
+            fprintf(f, "%lx %lx %s\n", (uintptr_t)base + spans[i].start, spans[i].end - spans[i].start, spans[i].name);
+
+    free(spans);
+    return fclose(f) == 0;
+}
+
+/* perf record -k mono matches samples against these */
+static uint64_t timestamp(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool write_all(int fd, const void *buffer, size_t length)
+{
+    const char *p = buffer;
+    while (length) {
+        ssize_t written = write(fd, p, length);
+        if (written <= 0)
+            return false;
+        p += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool pyperfmap_jitdump_open(struct pyperfmap_jitdump *dump)
+{
+    char path[64];
+    snprintf(path, sizeof(path), JITDUMP_PATH, (int)getpid());
+
+    dump->index = 0;
+    dump->marker = NULL;
+    dump->fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (dump->fd < 0)
+        return false;
+
+    struct jitdump_header header = {
+        .magic = JITDUMP_MAGIC,
+        .version = JITDUMP_VERSION,
+        .total_size = sizeof(struct jitdump_header),
+        .elf_mach = EM_X86_64,
+        .pid = getpid(),
+        .timestamp = timestamp()
+    };
+
+    /* an executable mapping of the file is the marker perf looks for */
+    dump->marker_length = sysconf(_SC_PAGESIZE);
+    dump->marker = mmap(NULL, dump->marker_length, PROT_READ | PROT_EXEC, MAP_PRIVATE, dump->fd, 0);
+    if (dump->marker == MAP_FAILED || !write_all(dump->fd, &header, sizeof(header))) {
+        if (dump->marker != MAP_FAILED)
+            munmap(dump->marker, dump->marker_length);
+        dump->marker = NULL;
+        close(dump->fd);
+        dump->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool pyperfmap_jitdump_load(struct pyperfmap_jitdump *dump, const struct vscc_codegen_data *data, size_t code_end, const void *base)
+{
+    if (dump->fd < 0)
+        return false;
+
+    struct span *spans;
+    size_t count = collect_spans(data, code_end, &spans);
+    bool status = true;
+
+    for (size_t i = 0; i < count && status; i++) {
+        size_t size = spans[i].end - spans[i].start;
+        size_t name_length = strlen(spans[i].name) + 1;
+        if (spans[i].end <= spans[i].start)
+            continue;
+
+        struct jitdump_load load = {
+            .record = {
+                .id = JIT_CODE_LOAD,
+                .total_size = sizeof(struct jitdump_load) + name_length + size,
+                .timestamp = timestamp()
+            },
+            .pid = getpid(),
+            .tid = syscall(SYS_gettid),
+            .vma = (uintptr_t)base + spans[i].start,
+            .code_addr = (uintptr_t)base + spans[i].start,
+            .code_size = size,
+            .code_index = dump->index++
+        };
+
+        status = write_all(dump->fd, &load, sizeof(load))
+            && write_all(dump->fd, spans[i].name, name_length)
+            && write_all(dump->fd, (const char*)base + spans[i].start, size);
+    }
+
+    free(spans);
+    return status;
+}
+
+void pyperfmap_jitdump_close(struct pyperfmap_jitdump *dump)
+{
+    if (dump->fd < 0)
+        return;
+
+    struct jitdump_record close_record = {
+        .id = JIT_CODE_CLOSE,
+        .total_size = sizeof(struct jitdump_record),
+        .timestamp = timestamp()
+    };
+    write_all(dump->fd, &close_record, sizeof(close_record));
+
+    munmap(dump->marker, dump->marker_length);
+    close(dump->fd);
+    dump->fd = -1;
+    dump->marker = NULL;
+}
\ No newline at end of file
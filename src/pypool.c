@@ -0,0 +1,126 @@
+#include "pypool.h"
+#include "pyperf.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * every worker owns a contiguous range of job indices packed into one word 
+ * (head in the low half, tail in the high half). the owner takes jobs from 
+ * the head, idle workers steal from the tail, both with a compare-exchange
+ */
+struct range {
+    _Atomic uint64_t bounds;
+    char pad[64 - sizeof(uint64_t)];
+};
+
+struct pool {
+    struct range *ranges;
+    size_t workers;
+
+    pypool_job job;
+    void *arg;
+};
+
+struct worker {
+    struct pool *pool;
+    size_t id;
+};
+
+#define PACK(head, tail) ((uint64_t)(tail) << 32 | (uint32_t)(head))
+#define HEAD(bounds) ((uint32_t)(bounds))
+#define TAIL(bounds) ((uint32_t)((bounds) >> 32))
+
+static bool take(struct range *range, bool steal, size_t *index)
+{
+    uint64_t bounds = atomic_load(&range->bounds);
+    for (;;) {
+        uint32_t head = HEAD(bounds);
+        uint32_t tail = TAIL(bounds);
+        if (head >= tail)
+            return false;
+
+        uint64_t next = steal ? PACK(head, tail - 1) : PACK(head + 1, tail);
+        if (atomic_compare_exchange_weak(&range->bounds, &bounds, next)) {
+            *index = steal ? tail - 1 : head;
+            return true;
+        }
+    }
+}
+
+static void *work(void *arg)
+{
+    struct worker *worker = arg;
+    struct pool *pool = worker->pool;
+    size_t index;
+
+    for (;;) {
+        if (take(&pool->ranges[worker->id], false, &index)) {
+            pool->job(pool->arg, index);
+            continue;
+        }
+
+        /* own range is empty, steal from the others starting at the next worker */
+        bool stolen = false;
+        for (size_t i = 1; i < pool->workers && !stolen; i++)
+            stolen = take(&pool->ranges[(worker->id + i) % pool->workers], true, &index);
+
+        if (!stolen)
+            return NULL;
+        pool->job(pool->arg, index);
+    }
+}
+
+size_t pypool_cpus(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+}
+
+void pypool_run(size_t threads, size_t count, pypool_job job, void *arg)
+{
+    if (threads == 0)
+        threads = pypool_cpus();
+    if (threads > count)
+        threads = count;
+
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++)
+            job(arg, i);
+        return;
+    }
+
+    struct pool pool = {
+        .ranges = pyperf_aligned_alloc(64, threads * sizeof(struct range)),
+        .workers = threads,
+        .job = job,
+        .arg = arg
+    };
+
+    for (size_t i = 0; i < threads; i++)
+        atomic_init(&pool.ranges[i].bounds, PACK(count * i / threads, count * (i + 1) / threads));
+
+    struct worker *workers = pyperf_malloc(threads * sizeof(struct worker));
+    pthread_t *handles = pyperf_malloc(threads * sizeof(pthread_t));
+    size_t started = 1;
+
+    /* a worker that fails to start leaves its range to be stolen */
+    for (size_t i = 0; i < threads; i++) {
+        workers[i] = (struct worker){ .pool = &pool, .id = i };
+        if (i > 0 && pthread_create(&handles[started], NULL, work, &workers[i]) == 0)
+            started++;
+    }
+
+    work(&workers[0]);
+    for (size_t i = 1; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    free(handles);
+    free(workers);
+    free(pool.ranges);
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "pyprofile.h"
+#include "pyperf.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * counters read back from an image, 'counts' grows with the highest site seen
+ */
+struct stored_function {
+    const char *name;
+    uint64_t *counts;
+    size_t countc;
+};
+
+uint64_t pyprofile_hash(const char *name)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void pyprofile_counter_name(char *buffer, size_t size, const char *function, size_t site)
+{
+    snprintf(buffer, size, PROFILE_PREFIX "%016" PRIx64 "_%zu", pyprofile_hash(function), site);
+}
+
+bool pyprofile_store(const char *path, const struct vscc_codegen_data *data, const struct vscc_context *ctx, const void *base)
+{
+    size_t fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        fnc++;
+
+    /* hashes are used as keys directly, a zero hash is as unlikely as a collision */
+    struct stored_function *functions = pyperf_calloc(fnc + 1, sizeof(struct stored_function));
+    struct pysym_table by_hash = { 0 };
+
+    fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next, fnc++) {
+        functions[fnc].name = fn->symbol_name;
+        pysym_put(&by_hash, (const char*)(uintptr_t)pyprofile_hash(fn->symbol_name), &functions[fnc]);
+    }
+
+    for (struct vscc_symbol *symbol = data->symbols; symbol; symbol = symbol->next) {
+        uint64_t hash;
+        size_t site;
+        if (strncmp(symbol->symbol_name, PROFILE_PREFIX, strlen(PROFILE_PREFIX)) != 0 ||
+            sscanf(symbol->symbol_name + strlen(PROFILE_PREFIX), "%16" SCNx64 "_%zu", &hash, &site) != 2)
+            continue;
+
+        struct stored_function *fn = pysym_get(&by_hash, (const char*)(uintptr_t)hash);
+        if (!fn || symbol->offset + sizeof(uint64_t) > data->length)
+            continue;
+
+        if (site >= fn->countc) {
+            fn->counts = pyperf_realloc(fn->counts, (site + 1) * sizeof(uint64_t));
+            memset(fn->counts + fn->countc, 0, (site + 1 - fn->countc) * sizeof(uint64_t));
+            fn->countc = site + 1;
+        }
+        memcpy(&fn->counts[site], (const uint8_t*)base + symbol->offset, sizeof(uint64_t));
+    }
+
+    /*
+     * one line per instrumented function: name, then every counter in site order
+     */
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fprintf(f, PROFILE_HEADER "\n");
+        for (size_t i = 0; i < fnc; i++) {
+            if (!functions[i].countc)
+                continue;
+            fprintf(f, "%s", functions[i].name);
+            for (size_t j = 0; j < functions[i].countc; j++)
+                fprintf(f, " %" PRIu64, functions[i].counts[j]);
+            fprintf(f, "\n");
+        }
+    }
+
+    for (size_t i = 0; i < fnc; i++)
+        free(functions[i].counts);
+    free(functions);
+    pysym_free(&by_hash, false);
+    return f && fclose(f) == 0;
+}
+
+bool pyprofile_load(struct pyprofile *profile, const char *path)
+{
+    memset(profile, 0, sizeof(*profile));
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, f);
+    if (length < 0 || strncmp(line, PROFILE_HEADER, strlen(PROFILE_HEADER)) != 0) {
+        free(line);
+        fclose(f);
+        return false;
+    }
+
+    /* the hash goes into the cache key, a new profile means new code */
+    profile->hash = pyprofile_hash(line);
+
+    while ((length = getline(&line, &capacity, f)) > 0) {
+        profile->hash = (profile->hash ^ pyprofile_hash(line)) * 0x100000001b3ull;
+
+        char *end = strpbrk(line, " \n");
+        size_t name_length = end ? (size_t)(end - line) : (size_t)length;
+        if (name_length == 0 || name_length >= 64)
+            continue;
+
+        struct pyprofile_function *fn = pyperf_calloc(1, sizeof(struct pyprofile_function));
+        pysym_put(&profile->functions, pysym_intern(&profile->strings, line, name_length), fn);
+
+        for (char *token = line + name_length;;) {
+            uint64_t count = strtoull(token, &end, 10);
+            if (end == token)
+                break;
+
+            fn->counts = pyperf_realloc(fn->counts, (fn->countc + 1) * sizeof(uint64_t));
+            fn->counts[fn->countc++] = count;
+            token = end;
+        }
+
+        if (pyprofile_count(fn, PROFILE_ENTRY) > profile->max_entry)
+            profile->max_entry = pyprofile_count(fn, PROFILE_ENTRY);
+    }
+
+    free(line);
+    fclose(f);
+    return true;
+}
+
+void pyprofile_free(struct pyprofile *profile)
+{
+    for (size_t i = 0; i < profile->functions.capacity; i++) {
+        struct pyprofile_function *fn = profile->functions.entries[i].value;
+        if (profile->functions.entries[i].key && fn) {
+            free(fn->counts);
+            free(fn);
+        }
+    }
+
+    pysym_free(&profile->functions, false);
+    pysym_free(&profile->strings, true);
+}
+
+const struct pyprofile_function *pyprofile_function(const struct pyprofile *profile, const char *name)
+{
+    const char *key = pysym_lookup(&profile->strings, name, strlen(name));
+    return key ? pysym_get(&profile->functions, key) : NULL;
+}
+
+uint64_t pyprofile_count(const struct pyprofile_function *fn, size_t site)
+{
+    return fn && site < fn->countc ? fn->counts[site] : 0;
+}
+
+bool pyprofile_is_hot(const struct pyprofile *profile, const struct pyprofile_function *fn)
+{
+    uint64_t entries = pyprofile_count(fn, PROFILE_ENTRY);
+    return entries && entries * PROFILE_HOT_RATIO >= profile->max_entry;
+}
+
+/*
+ * functions that ran, hottest first, then the ones the profile does not 
+ * know (the runtime), then the ones that never ran
+ */
+struct ordered_function {
+    struct vscc_function *fn;
+    uint64_t entries;
+    int group;
+    size_t index;
+};
+
+static int compare_ordered(const void *a, const void *b)
+{
+    const struct ordered_function *x = a;
+    const struct ordered_function *y = b;
+
+    if (x->group != y->group)
+        return x->group - y->group;
+    if (x->entries != y->entries)
+        return x->entries > y->entries ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+void pyprofile_order_functions(struct vscc_context *ctx, const struct pyprofile *profile)
+{
+    size_t fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next)
+        fnc++;
+    if (fnc < 2)
+        return;
+
+    struct ordered_function *order = pyperf_malloc(fnc * sizeof(struct ordered_function));
+    fnc = 0;
+    for (struct vscc_function *fn = ctx->function_stream; fn; fn = fn->next, fnc++) {
+        const struct pyprofile_function *counts = pyprofile_function(profile, fn->symbol_name);
+        uint64_t entries = pyprofile_count(counts, PROFILE_ENTRY);
+        order[fnc] = (struct ordered_function){ .fn = fn, .entries = entries, .group = !counts ? 1 : entries ? 0 : 2, .index = fnc };
+    }
+
+    qsort(order, fnc, sizeof(struct ordered_function), compare_ordered);
+    for (size_t i = 0; i < fnc; i++)
+        order[i].fn->next = i + 1 < fnc ? order[i + 1].fn : NULL;
+    ctx->function_stream = order[0].fn;
+
+    free(order);
+}
\ No newline at end of file
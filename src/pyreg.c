@@ -0,0 +1,435 @@
+#include "pyreg.h"
+#include "pyperf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CALLEE_SAVED (GPR_MASK(GPR_RBX) | GPR_MASK(GPR_R12) | GPR_MASK(GPR_R13) | GPR_MASK(GPR_R14) | GPR_MASK(GPR_R15))
+#define CALLER_SAVED (GPR_MASK(GPR_RAX) | GPR_MASK(GPR_RCX) | GPR_MASK(GPR_RDX) | GPR_MASK(GPR_RSI) | GPR_MASK(GPR_RDI) | \
+    GPR_MASK(GPR_R8) | GPR_MASK(GPR_R9) | GPR_MASK(GPR_R10) | GPR_MASK(GPR_R11))
+
+/*
+ * a qword stack slot [rbp-disp], live from its first to its last access
+ */
+struct reg_slot {
+    int32_t disp;
+    bool bad;
+
+    size_t start;
+    size_t end;
+    size_t accesses;
+    bool crosses_call;
+
+    int reg;
+};
+
+struct reg_loop {
+    size_t head;
+    size_t tail;
+};
+
+struct reg_function {
+    struct pyasm_image *image;
+    struct pyasm_function *fn;
+
+    struct reg_slot *slots;
+    size_t slotc;
+
+    struct reg_loop *loops;
+    size_t loopc;
+
+    size_t *calls;
+    size_t callc;
+
+    uint16_t used;
+    bool escapes;
+};
+
+/*
+ * [rbp+disp] without an index
+ */
+static bool is_frame_access(struct pyasm_insn *insn)
+{
+    int mod = insn->modrm >> 6;
+    return insn->has_modrm && !insn->has_sib && (mod == 1 || mod == 2) && (insn->modrm & 7) == 5 && !(insn->rex & 1);
+}
+
+/*
+ * memory operands that could alias the frame without naming a slot directly
+ */
+static bool is_unknown_frame_access(struct pyasm_insn *insn)
+{
+    if (!insn->has_modrm || !insn->has_sib || (insn->rex & 1))
+        return false;
+
+    int base = insn->sib & 7;
+    return base == GPR_RSP || (base == GPR_RBP && (insn->modrm >> 6) != 0);
+}
+
+/*
+ * 64-bit instructions whose r/m operand can be a register instead
+ */
+static bool is_promotable(struct pyasm_insn *insn)
+{
+    if (!(insn->rex & 8) || insn->opsize || insn->rep)
+        return false;
+
+    if (insn->two_byte)
+        return insn->opcode == 0xaf;
+
+    int ext = (insn->modrm >> 3) & 7;
+    switch (insn->opcode) {
+    case 0x01: case 0x03: case 0x09: case 0x0b: case 0x11: case 0x13: case 0x19: case 0x1b: 
+    case 0x21: case 0x23: case 0x29: case 0x2b: case 0x31: case 0x33: case 0x39: case 0x3b:
+    case 0x69: case 0x6b: case 0x81: case 0x83: case 0x85: case 0x87: case 0x89: case 0x8b: 
+    case 0xc1: case 0xd1: case 0xd3: case 0xf7:
+        return true;
+    case 0xc7:
+        return ext == 0;
+    case 0xff:
+        return ext == 0 || ext == 1;
+    default:
+        return false;
+    }
+}
+
+static bool is_call(struct pyasm_insn *insn)
+{
+    if (insn->two_byte)
+        return insn->opcode == 0x05;
+    return insn->opcode == 0xe8 || (insn->opcode == 0xff && ((insn->modrm >> 3) & 7) == 2);
+}
+
+static int compare_disp(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t*)a;
+    int32_t y = *(const int32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static struct reg_slot *find_slot(struct reg_function *rf, int32_t disp)
+{
+    size_t lo = 0;
+    size_t hi = rf->slotc;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (rf->slots[mid].disp < disp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < rf->slotc && rf->slots[lo].disp == disp ? &rf->slots[lo] : NULL;
+}
+
+/*
+ * collect slots, loops and calls, false if the function can not be allocated safely
+ */
+static bool analyze(struct reg_function *rf)
+{
+    struct pyasm_image *image = rf->image;
+    struct pyasm_function *fn = rf->fn;
+    struct pyasm_insn *insns = &image->insns[fn->first];
+
+    if (fn->count == 0 || insns[0].opcode != 0x55 || insns[0].rex || insns[0].two_byte)
+        return false;
+
+    int32_t *disps = pyperf_malloc(fn->count * sizeof(int32_t));
+    size_t dispc = 0;
+
+    rf->loops = pyperf_malloc(fn->count * sizeof(struct reg_loop));
+    rf->calls = pyperf_malloc(fn->count * sizeof(size_t));
+
+    for (size_t i = 0; i < fn->count; i++) {
+        struct pyasm_insn *insn = &insns[i];
+
+        if (is_unknown_frame_access(insn) || (!insn->two_byte && insn->opcode == 0xff && ((insn->modrm >> 3) & 7) >= 4)) {
+            free(disps);
+            return false;
+        }
+
+        if (is_frame_access(insn)) {
+            /* arguments, address taken slots and vector accesses of unknown width */
+            if (insn->disp >= 0 || (!insn->two_byte && insn->opcode == 0x8d) || 
+                (insn->two_byte && insn->opcode != 0xaf && (insn->opcode & 0xf6) != 0xb6)) {
+                free(disps);
+                return false;
+            }
+            disps[dispc++] = insn->disp;
+        }
+
+        if (is_call(insn))
+            rf->calls[rf->callc++] = i;
+
+        if (insn->relative && !(insn->opcode == 0xe8 && !insn->two_byte)) {
+            if (insn->target < fn->start || insn->target >= fn->end)
+                rf->escapes = true;
+            else if (insn->target <= insn->offset)
+                rf->loops[rf->loopc++] = (struct reg_loop){ pyasm_find(image, insn->target) - fn->first, i };
+        }
+    }
+
+    /*
+     * one slot per distinct displacement
+     */
+    qsort(disps, dispc, sizeof(int32_t), compare_disp);
+    rf->slots = pyperf_malloc((dispc + 1) * sizeof(struct reg_slot));
+    for (size_t i = 0; i < dispc; i++)
+        if (i == 0 || disps[i] != disps[i - 1])
+            rf->slots[rf->slotc++] = (struct reg_slot){ .disp = disps[i], .start = -1, .reg = -1 };
+    free(disps);
+
+    /*
+     * neighbours closer than a qword overlap
+     */
+    for (size_t i = 0; i + 1 < rf->slotc; i++) {
+        if (rf->slots[i + 1].disp - rf->slots[i].disp < 8) {
+            rf->slots[i].bad = true;
+            rf->slots[i + 1].bad = true;
+        }
+    }
+
+    for (size_t i = 0; i < fn->count; i++) {
+        struct pyasm_insn *insn = &insns[i];
+        if (!is_frame_access(insn))
+            continue;
+
+        struct reg_slot *slot = find_slot(rf, insn->disp);
+        if (!is_promotable(insn))
+            slot->bad = true;
+        if (slot->start == (size_t)-1)
+            slot->start = i;
+        slot->end = i;
+        slot->accesses++;
+    }
+
+    return true;
+}
+
+/*
+ * a value live anywhere in a loop is live throughout it
+ */
+static void build_intervals(struct reg_function *rf)
+{
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 0; i < rf->slotc; i++) {
+            struct reg_slot *slot = &rf->slots[i];
+            for (size_t j = 0; j < rf->loopc; j++) {
+                struct reg_loop *loop = &rf->loops[j];
+                if (slot->start > loop->tail || slot->end < loop->head)
+                    continue;
+                if (slot->start > loop->head || slot->end < loop->tail) {
+                    slot->start = slot->start < loop->head ? slot->start : loop->head;
+                    slot->end = slot->end > loop->tail ? slot->end : loop->tail;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < rf->slotc; i++)
+        for (size_t j = 0; j < rf->callc; j++)
+            if (rf->calls[j] > rf->slots[i].start && rf->calls[j] < rf->slots[i].end)
+                rf->slots[i].crosses_call = true;
+}
+
+static int compare_start(const void *a, const void *b)
+{
+    const struct reg_slot *x = *(struct reg_slot *const*)a;
+    const struct reg_slot *y = *(struct reg_slot *const*)b;
+    if (x->start != y->start)
+        return (x->start > y->start) - (x->start < y->start);
+    return (x->disp > y->disp) - (x->disp < y->disp);
+}
+
+static int lowest_register(uint16_t mask)
+{
+    return __builtin_ctz(mask);
+}
+
+static void linear_scan(struct reg_function *rf, uint16_t available, struct pyreg_stats *stats)
+{
+    struct reg_slot **order = pyperf_malloc((rf->slotc + 1) * sizeof(struct reg_slot*));
+    struct reg_slot **active = pyperf_malloc((rf->slotc + 1) * sizeof(struct reg_slot*));
+    size_t orderc = 0;
+    size_t activec = 0;
+
+    for (size_t i = 0; i < rf->slotc; i++)
+        if (!rf->slots[i].bad)
+            order[orderc++] = &rf->slots[i];
+    qsort(order, orderc, sizeof(struct reg_slot*), compare_start);
+
+    for (size_t i = 0; i < orderc; i++) {
+        struct reg_slot *slot = order[i];
+
+        /*
+         * expire intervals that ended before this one starts
+         */
+        size_t kept = 0;
+        for (size_t j = 0; j < activec; j++) {
+            if (active[j]->end < slot->start)
+                available |= GPR_MASK(active[j]->reg);
+            else
+                active[kept++] = active[j];
+        }
+        activec = kept;
+
+        /*
+         * values live across a call need a register the callee preserves
+         */
+        uint16_t allowed = slot->crosses_call ? CALLEE_SAVED : CALLER_SAVED | CALLEE_SAVED;
+        uint16_t candidates = available & allowed;
+
+        if (candidates) {
+            slot->reg = lowest_register(candidates & CALLER_SAVED ? candidates & CALLER_SAVED : candidates);
+            available &= ~GPR_MASK(slot->reg);
+            active[activec++] = slot;
+            continue;
+        }
+
+        /*
+         * spill whichever compatible interval ends last
+         */
+        size_t victim = -1;
+        for (size_t j = 0; j < activec; j++)
+            if ((GPR_MASK(active[j]->reg) & allowed) && (victim == (size_t)-1 || active[j]->end > active[victim]->end))
+                victim = j;
+
+        stats->spilled++;
+        if (victim == (size_t)-1 || active[victim]->end <= slot->end)
+            continue;
+
+        slot->reg = active[victim]->reg;
+        active[victim]->reg = -1;
+        active[victim] = slot;
+    }
+
+    free(order);
+    free(active);
+}
+
+static void rewrite_access(struct pyasm_image *image, size_t index, int reg)
+{
+    struct pyasm_insn *insn = &image->insns[index];
+    struct pyasm_edit *edit = &image->edits[index];
+    const uint8_t *src = image->data->buffer + insn->offset;
+    uint8_t *dst = edit->bytes;
+
+    /* rex is always present, promotable instructions are 64-bit */
+    size_t rex_at = insn->opcode_at - (insn->two_byte ? 2 : 1);
+
+    memcpy(dst, src, rex_at);
+    dst += rex_at;
+    *dst++ = (insn->rex & ~1) | (reg >> 3);
+    memcpy(dst, src + rex_at + 1, insn->modrm_at - rex_at - 1);
+    dst += insn->modrm_at - rex_at - 1;
+    *dst++ = 0xc0 | (insn->modrm & 0x38) | (reg & 7);
+    memcpy(dst, src + insn->imm_at, insn->imm_size);
+    dst += insn->imm_size;
+
+    edit->replaced = true;
+    edit->length = dst - edit->bytes;
+    edit->rel_at = -1;
+}
+
+static size_t encode_push(uint8_t *dst, int reg, bool pop)
+{
+    size_t length = 0;
+    if (reg >= GPR_R8)
+        dst[length++] = 0x41;
+    dst[length++] = (pop ? 0x58 : 0x50) | (reg & 7);
+    return length;
+}
+
+/*
+ * save used callee saved registers around the frame, an extra copy keeps the 
+ * stack 16 byte aligned
+ */
+static void save_registers(struct reg_function *rf, uint16_t saved)
+{
+    int regs[8];
+    int regc = 0;
+
+    for (uint16_t mask = saved; mask; mask &= mask - 1)
+        regs[regc++] = lowest_register(mask);
+    if (regc & 1)
+        regs[regc++] = regs[0];
+
+    struct pyasm_edit *prologue = &rf->image->edits[rf->fn->first];
+    for (int i = 0; i < regc; i++)
+        prologue->prefix_length += encode_push(prologue->prefix + prologue->prefix_length, regs[i], false);
+
+    for (size_t i = 0; i < rf->fn->count; i++) {
+        struct pyasm_insn *insn = &rf->image->insns[rf->fn->first + i];
+        if (insn->two_byte || (insn->opcode != 0xc3 && insn->opcode != 0xc2))
+            continue;
+
+        struct pyasm_edit *epilogue = &rf->image->edits[rf->fn->first + i];
+        for (int j = regc - 1; j >= 0; j--)
+            epilogue->prefix_length += encode_push(epilogue->prefix + epilogue->prefix_length, regs[j], true);
+    }
+}
+
+static void allocate_function(struct pyasm_image *image, struct pyasm_function *fn, uint16_t clobbered, struct pyreg_stats *stats)
+{
+    struct reg_function rf = { .image = image, .fn = fn };
+
+    stats->functions++;
+    if (!analyze(&rf)) {
+        stats->skipped++;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < fn->count; i++)
+        rf.used |= pyasm_registers_used(&image->insns[fn->first + i]);
+
+    /*
+     * only registers no other function touches are assumed preserved across calls
+     */
+    uint16_t available = CALLER_SAVED & ~rf.used;
+    if (!rf.escapes)
+        available |= CALLEE_SAVED & ~rf.used & ~clobbered;
+
+    build_intervals(&rf);
+    linear_scan(&rf, available, stats);
+
+    uint16_t saved = 0;
+    for (size_t i = 0; i < fn->count; i++) {
+        struct pyasm_insn *insn = &image->insns[fn->first + i];
+        if (!is_frame_access(insn))
+            continue;
+
+        struct reg_slot *slot = find_slot(&rf, insn->disp);
+        if (slot->reg < 0)
+            continue;
+
+        rewrite_access(image, fn->first + i, slot->reg);
+        saved |= GPR_MASK(slot->reg) & CALLEE_SAVED;
+    }
+
+    for (size_t i = 0; i < rf.slotc; i++)
+        if (rf.slots[i].reg >= 0)
+            stats->promoted++;
+
+    if (saved) {
+        save_registers(&rf, saved);
+        stats->callee_saved += __builtin_popcount(saved);
+    }
+
+cleanup:
+    free(rf.slots);
+    free(rf.loops);
+    free(rf.calls);
+}
+
+void pyreg_allocate(struct pyasm_image *image, struct pyreg_stats *stats)
+{
+    uint16_t clobbered = 0;
+    for (size_t i = 0; i < image->insnc; i++)
+        clobbered |= pyasm_registers_used(&image->insns[i]);
+
+    for (size_t i = 0; i < image->functionc; i++)
+        allocate_function(image, &image->functions[i], clobbered, stats);
+}
\ No newline at end of file
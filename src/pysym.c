@@ -0,0 +1,136 @@
+#include "pysym.h"
+#include "pyperf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PYSYM_INITIAL_CAPACITY 64
+
+static uint32_t hash_string(const char *str, size_t length)
+{
+    /* fnv-1a */
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    return hash;
+}
+
+static uint32_t hash_pointer(const char *key)
+{
+    return (uint32_t)(((uintptr_t)key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static void grow(struct pysym_table *table)
+{
+    struct pysym_entry *old = table->entries;
+    size_t old_capacity = table->capacity;
+
+    table->capacity = old_capacity ? old_capacity * 2 : PYSYM_INITIAL_CAPACITY;
+    table->entries = pyperf_calloc(table->capacity, sizeof(struct pysym_entry));
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].key == NULL)
+            continue;
+
+        size_t j = old[i].hash & (table->capacity - 1);
+        while (table->entries[j].key)
+            j = (j + 1) & (table->capacity - 1);
+        table->entries[j] = old[i];
+    }
+
+    free(old);
+}
+
+static struct pysym_entry *insert(struct pysym_table *table, const char *key, uint32_t hash)
+{
+    /* keep load factor under one half */
+    if ((table->count + 1) * 2 > table->capacity)
+        grow(table);
+
+    size_t i = hash & (table->capacity - 1);
+    while (table->entries[i].key)
+        i = (i + 1) & (table->capacity - 1);
+
+    table->count++;
+    table->entries[i].key = key;
+    table->entries[i].hash = hash;
+    return &table->entries[i];
+}
+
+static const char *find_string(const struct pysym_table *strings, const char *str, size_t length, uint32_t hash)
+{
+    if (strings->capacity == 0)
+        return NULL;
+
+    for (size_t i = hash & (strings->capacity - 1); strings->entries[i].key; i = (i + 1) & (strings->capacity - 1)) {
+        const char *key = strings->entries[i].key;
+        if (strings->entries[i].hash == hash && strncmp(key, str, length) == 0 && key[length] == 0)
+            return key;
+    }
+    return NULL;
+}
+
+const char *pysym_intern(struct pysym_table *strings, const char *str, size_t length)
+{
+    uint32_t hash = hash_string(str, length);
+    const char *res = find_string(strings, str, length, hash);
+    if (res)
+        return res;
+
+    char *key = pyperf_malloc(length + 1);
+    memcpy(key, str, length);
+    key[length] = 0;
+
+    insert(strings, key, hash);
+    return key;
+}
+
+const char *pysym_lookup(const struct pysym_table *strings, const char *str, size_t length)
+{
+    return find_string(strings, str, length, hash_string(str, length));
+}
+
+void *pysym_get(const struct pysym_table *table, const char *key)
+{
+    if (table->capacity == 0)
+        return NULL;
+
+    for (size_t i = hash_pointer(key) & (table->capacity - 1); table->entries[i].key; i = (i + 1) & (table->capacity - 1)) {
+        if (table->entries[i].key == key)
+            return table->entries[i].value;
+    }
+    return NULL;
+}
+
+void pysym_put(struct pysym_table *table, const char *key, void *value)
+{
+    if (table->capacity) {
+        for (size_t i = hash_pointer(key) & (table->capacity - 1); table->entries[i].key; i = (i + 1) & (table->capacity - 1)) {
+            if (table->entries[i].key == key) {
+                table->entries[i].value = value;
+                return;
+            }
+        }
+    }
+
+    insert(table, key, hash_pointer(key))->value = value;
+}
+
+void pysym_clear(struct pysym_table *table)
+{
+    /* release rather than wipe, one large function should not slow down every later clear */
+    pysym_free(table, false);
+}
+
+void pysym_free(struct pysym_table *table, bool free_keys)
+{
+    if (free_keys) {
+        for (size_t i = 0; i < table->capacity; i++)
+            free((void*)table->entries[i].key);
+    }
+
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
\ No newline at end of file
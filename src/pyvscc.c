@@ -0,0 +1,234 @@
+#include "pyvscc.h"
+
+#include <vscc.h>
+
+#include "opt/opt.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+#include "pyopt.h"
+#include "pyinline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef uint64_t(*call_fnptr)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+struct pyvscc_module {
+    void *code;
+    size_t length;
+
+    /* offset of the heap in 'code', -1 without one */
+    uintptr_t heap;
+
+    struct pyvscc_function *functions;
+    size_t functionc;
+};
+
+/*
+ * every generated function with a symbol is callable, parameters are 
+ * counted from the ir since the symbol table only stores offsets
+ */
+static void index_functions(struct pyvscc_module *module, struct pybuild_context *ctx)
+{
+    size_t count = 0;
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn; fn = fn->next)
+        count++;
+
+    module->functions = pyperf_calloc(count, sizeof(struct pyvscc_function));
+    for (struct vscc_function *fn = ctx->vscc_ctx.function_stream; fn; fn = fn->next) {
+        const char *name = pysym_intern(&ctx->strings, fn->symbol_name, strlen(fn->symbol_name));
+        struct vscc_symbol *symbol = pysym_get(&ctx->symbols, name);
+        if (symbol == NULL)
+            continue;
+
+        struct pyvscc_function *res = &module->functions[module->functionc];
+        res->return_size = fn->return_size;
+        for (struct vscc_register *reg = fn->register_stream; reg; reg = reg->next) {
+            if (!reg->is_parameter)
+                continue;
+            if (res->paramc == PYVSCC_MAX_ARGS) {
+                res->paramc++;
+                break;
+            }
+            res->param_sizes[res->paramc++] = reg->size;
+        }
+
+        /* functions taking stack arguments can not be called through pyvscc_call */
+        if (res->paramc > PYVSCC_MAX_ARGS) {
+            memset(res, 0, sizeof(*res));
+            continue;
+        }
+
+        res->name = strdup(fn->symbol_name);
+        res->address = (uint8_t*)module->code + symbol->offset;
+        module->functionc++;
+    }
+
+    uintptr_t flush_offset = pyimpl_find_symbol(&ctx->compiled_data, PYIMPL_FLUSH);
+    for (size_t i = 0; i < module->functionc && flush_offset != -1; i++)
+        module->functions[i].flush = (uint8_t*)module->code + flush_offset;
+}
+
+struct pyvscc_module *pyvscc_compile(const char *source, size_t length, const struct pyvscc_options *options)
+{
+    struct pyvscc_options defaults = { .default_size = sizeof(uint64_t), .max_memory = 4096, .threads = 1, .optimize = false };
+    if (options == NULL)
+        options = &defaults;
+
+    struct lexer_stream tokens = { 0 };
+    if (!str_to_tokens_parallel(&tokens, source, length, options->threads)) {
+        printf("err: failed to lex source\n");
+        lexer_free(&tokens);
+        return NULL;
+    }
+
+    /* there is no entry point, every function is looked up by name */
+    struct pybuild_context ctx = {
+        .vscc_ctx = { 0 },
+        .compiled_data = { 0 },
+        .tokens = &tokens,
+        .entry_name = NULL,
+
+        .current_label = 0,
+        .labelc = 0,
+
+        .current_function = NULL,
+        .return_reg = NULL,
+        .default_size = options->default_size,
+
+        .autogen = 0,
+        .autogen_name = { 0 },
+
+        .memcpy_queue = NULL,
+        .branch_queue = NULL,
+        .chain = NULL,
+
+        .strings = { 0 },
+        .locals = { 0 },
+        .globals = { 0 },
+        .functions = { 0 },
+        .builtins = { 0 },
+        .symbols = { 0 },
+        .string_values = { 0 },
+        .arguments = NULL,
+        .deferred = NULL,
+        .inferred = 0,
+
+        .parent = NULL,
+
+        .threads = options->threads,
+        .optimize = options->optimize,
+        .regalloc = { 0 },
+        .peephole = { { 0 } },
+        .bytes_saved = 0
+    };
+
+    pyimpl_append_to_context(&ctx.vscc_ctx);
+
+    if (!parse(&ctx, &tokens)) {
+        printf("err: failed to compile\n");
+        build_free(&ctx);
+        lexer_free(&tokens);
+        return NULL;
+    }
+
+    if (options->optimize) {
+        pyinline_functions(&ctx.vscc_ctx, NULL);
+        for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn; fn = fn->next) {
+            pyopt_fold_constants(fn);
+            vscc_optfn_elim_dead_store(fn);
+        }
+    }
+
+    uintptr_t entry_offset = build(&ctx);
+    lexer_free(&tokens);
+    if (entry_offset == (uintptr_t)-1) {
+        build_free(&ctx);
+        return NULL;
+    }
+
+    struct pyvscc_module *module = pyperf_calloc(1, sizeof(struct pyvscc_module));
+    module->length = ctx.compiled_data.length;
+    module->code = mmap(NULL, module->length, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (module->code == MAP_FAILED) {
+        printf("err: could not map compiled code\n");
+        build_free(&ctx);
+        free(module);
+        return NULL;
+    }
+
+    pyimpl_set_heap_capacity(&ctx.compiled_data, options->max_memory);
+    module->heap = pyimpl_find_symbol(&ctx.compiled_data, PYIMPL_HEAP);
+    memcpy(module->code, ctx.compiled_data.buffer, module->length);
+    index_functions(module, &ctx);
+    build_free(&ctx);
+    return module;
+}
+
+void pyvscc_free(struct pyvscc_module *module)
+{
+    if (module == NULL)
+        return;
+
+    for (size_t i = 0; i < module->functionc; i++)
+        free((void*)module->functions[i].name);
+
+    /* the region is mapped by the first alloc, the image only records it */
+    struct pyimpl_heap heap = { 0 };
+    if (module->heap != -1)
+        memcpy(&heap, (uint8_t*)module->code + module->heap, sizeof(heap));
+    if (heap.base)
+        munmap((void*)(uintptr_t)heap.base, heap.capacity);
+
+    free(module->functions);
+    munmap(module->code, module->length);
+    free(module);
+}
+
+const struct pyvscc_function *pyvscc_lookup(const struct pyvscc_module *module, const char *name)
+{
+    /* lookups happen once per function, not once per call */
+    for (size_t i = 0; i < module->functionc; i++) {
+        if (strcmp(module->functions[i].name, name) == 0)
+            return &module->functions[i];
+    }
+    return NULL;
+}
+
+bool pyvscc_call(const struct pyvscc_function *fn, const struct pyvscc_value *args, size_t argc, uint64_t *result)
+{
+    if (fn == NULL || argc != fn->paramc)
+        return false;
+
+    uint64_t regs[PYVSCC_MAX_ARGS] = { 0 };
+    for (size_t i = 0; i < argc; i++) {
+        switch (args[i].type) {
+        case PYVSCC_TYPE_INT:
+            regs[i] = (uint64_t)args[i].i;
+            break;
+        case PYVSCC_TYPE_PTR:
+            if (fn->param_sizes[i] < sizeof(void*))
+                return false;
+            regs[i] = (uint64_t)(uintptr_t)args[i].p;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    /* unused registers are ignored by the callee, so one signature covers every arity */
+    uint64_t ret = ((call_fnptr)fn->address)(regs[0], regs[1], regs[2], regs[3], regs[4], regs[5]);
+    if (fn->flush)
+        ((call_fnptr)fn->flush)(0, 0, 0, 0, 0, 0);
+
+    /* narrow return values leave the upper bits of rax undefined */
+    if (fn->return_size && fn->return_size < sizeof(uint64_t))
+        ret &= (1ull << (fn->return_size * 8)) - 1;
+
+    if (result)
+        *result = ret;
+    return true;
+}
\ No newline at end of file
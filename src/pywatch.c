@@ -0,0 +1,558 @@
+#include "pywatch.h"
+
+#include <vscc.h>
+
+#include "opt/opt.h"
+#include "util.h"
+#include "lexer.h"
+#include "pyimpl.h"
+#include "pybuild.h"
+#include "pyopt.h"
+#include "pycache.h"
+#include "pycodegen.h"
+#include "pypool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef uint64_t(*entry_point_fnptr)();
+
+/*
+ * a global some cached function references, restored with its contents 
+ * when the function is not parsed again
+ */
+struct watch_global {
+    char name[64];
+    size_t size;
+    uint8_t *bytes;
+};
+
+struct watch_entry {
+    uint64_t hash;
+    struct pycodegen_piece piece;
+
+    struct watch_global *globals;
+    size_t globalc;
+
+    /* see build_requires_natives, the ir is gone once the entry is reused */
+    bool requires_natives;
+};
+
+/*
+ * a top level def up to the next one, 'header' is the length of its first line
+ */
+struct watch_chunk {
+    const char *text;
+    size_t length;
+    size_t header;
+
+    const char *name;
+    uint64_t signature;
+    uint64_t hash;
+    bool changed;
+};
+
+struct watch_session {
+    const struct pywatch_options *options;
+    struct vscc_codegen_interface interface;
+
+    /* interned function names to their cached code */
+    struct pysym_table names;
+    struct pysym_table entries;
+
+    /* 
+     * the last build picked builtins by what callers pass to untyped 
+     * parameters, a changed caller can change an unchanged callee then
+     */
+    bool inferred;
+};
+
+struct watch_job {
+    struct watch_session *session;
+    struct vscc_function **functions;
+    struct pycodegen_piece *pieces;
+    bool *ok;
+};
+
+static bool is_def(const char *line, const char *end)
+{
+    return end - line > 4 && line[0] == 'd' && line[1] == 'e' && line[2] == 'f' && (line[3] == ' ' || line[3] == '\t');
+}
+
+static bool is_name_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/*
+ * whitespace and comments only, anything else outside a def has to be parsed 
+ * together with the whole file
+ */
+static bool is_blank(const char *c, const char *end)
+{
+    while (c < end) {
+        if (*c == '#') {
+            c = memchr(c, '\n', end - c);
+            c = c ? c : end;
+        }
+        else if (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+            c++;
+        else
+            return false;
+    }
+    return true;
+}
+
+static size_t split(struct watch_session *session, const char *source, size_t length, struct watch_chunk **chunks)
+{
+    const char *end = source + length;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    for (const char *line = source; line < end;) {
+        const char *eol = memchr(line, '\n', end - line);
+        eol = eol ? eol + 1 : end;
+
+        if (is_def(line, end)) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                *chunks = pyperf_realloc(*chunks, capacity * sizeof(struct watch_chunk));
+            }
+            if (count)
+                (*chunks)[count - 1].length = line - (*chunks)[count - 1].text;
+
+            const char *name = line + 4;
+            while (name < eol && (*name == ' ' || *name == '\t'))
+                name++;
+            const char *name_end = name;
+            while (name_end < eol && is_name_char(*name_end))
+                name_end++;
+
+            (*chunks)[count++] = (struct watch_chunk){ 
+                .text = line, 
+                .header = eol - line, 
+                .name = pysym_intern(&session->names, name, name_end - name) 
+            };
+        }
+        line = eol;
+    }
+
+    if (count)
+        (*chunks)[count - 1].length = end - (*chunks)[count - 1].text;
+    return count;
+}
+
+/*
+ * code generated for a call depends on the callee's signature, so the 
+ * signature of everything a def calls is part of its hash
+ */
+static uint64_t callee_hash(struct watch_session *session, struct pysym_table *chunk_of, struct watch_chunk *chunk)
+{
+    const char *c = chunk->text + chunk->header;
+    const char *end = chunk->text + chunk->length;
+    uint64_t hash = chunk->signature;
+
+    while (c < end) {
+        if (*c == '#' || *c == '\'' || *c == '"') {
+            const char *stop = memchr(c + 1, *c == '#' ? '\n' : *c, end - c - 1);
+            c = stop ? stop + 1 : end;
+            continue;
+        }
+
+        if (!is_name_char(*c) || (*c >= '0' && *c <= '9')) {
+            c++;
+            continue;
+        }
+
+        const char *start = c;
+        while (c < end && is_name_char(*c))
+            c++;
+
+        const char *paren = c;
+        while (paren < end && (*paren == ' ' || *paren == '\t'))
+            paren++;
+        if (paren == end || *paren != '(')
+            continue;
+
+        const char *name = pysym_lookup(&session->names, start, c - start);
+        struct watch_chunk *callee = name ? pysym_get(chunk_of, name) : NULL;
+        if (callee)
+            hash = (hash ^ callee->signature) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void free_entry(struct watch_entry *entry)
+{
+    pycodegen_piece_free(&entry->piece);
+    for (size_t i = 0; i < entry->globalc; i++)
+        free(entry->globals[i].bytes);
+    free(entry->globals);
+    free(entry);
+}
+
+static void generate(void *arg, size_t index)
+{
+    struct watch_job *job = arg;
+    job->ok[index] = pycodegen_function(job->functions[index], &job->session->interface, &job->pieces[index]);
+}
+
+/*
+ * globals a freshly generated function references, with their final contents
+ */
+static void record_globals(struct watch_entry *entry, struct vscc_function *fn, struct pybuild_context *ctx)
+{
+    struct pysym_table seen = { 0 };
+    size_t capacity = 0;
+
+    for (struct vscc_instruction *insn = fn->instruction_stream; insn; insn = insn->next) {
+        struct vscc_register *regs[2 + 6] = { insn->dest, insn->src };
+        size_t regc = 2;
+
+        if (insn->opcode == O_SYSCALL) {
+            for (int k = 0; k < insn->syscall.count; k++)
+                if (insn->syscall.type[k] == M_REG)
+                    regs[regc++] = (struct vscc_register*)insn->syscall.values[k];
+        }
+
+        for (size_t i = 0; i < regc; i++) {
+            struct vscc_register *reg = regs[i];
+            if (reg == NULL || !reg->is_global || pysym_get(&seen, (const char*)reg))
+                continue;
+            pysym_put(&seen, (const char*)reg, reg);
+
+            const char *name = pysym_lookup(&ctx->strings, reg->symbol_name, strlen(reg->symbol_name));
+            struct vscc_symbol *symbol = name ? pysym_get(&ctx->symbols, name) : NULL;
+            if (symbol == NULL)
+                continue;
+
+            if (entry->globalc == capacity) {
+                capacity = capacity ? capacity * 2 : 4;
+                entry->globals = pyperf_realloc(entry->globals, capacity * sizeof(struct watch_global));
+            }
+
+            struct watch_global *global = &entry->globals[entry->globalc++];
+            strcpy(global->name, reg->symbol_name);
+            global->size = reg->size;
+            global->bytes = pyperf_malloc(reg->size ? reg->size : 1);
+            memcpy(global->bytes, ctx->compiled_data.buffer + symbol->offset, reg->size);
+        }
+    }
+
+    pysym_free(&seen, false);
+}
+
+static void run(struct watch_session *session, struct pybuild_context *ctx, uintptr_t entry_offset)
+{
+    void *exe = mmap(NULL, ctx->compiled_data.length, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (exe == MAP_FAILED) {
+        printf("err: could not map compiled code\n");
+        return;
+    }
+
+    if (session->options->line)
+        pyimpl_request_line_buffering(&ctx->compiled_data);
+    pyimpl_set_heap_capacity(&ctx->compiled_data, session->options->max_memory);
+
+    memcpy(exe, ctx->compiled_data.buffer, ctx->compiled_data.length);
+    entry_point_fnptr entry = (entry_point_fnptr)((uint8_t*)exe + entry_offset);
+    uintptr_t flush_offset = pyimpl_find_symbol(&ctx->compiled_data, PYIMPL_FLUSH);
+
+    int64_t start_time = pyperf_time_us();
+    entry();
+    if (flush_offset != -1)
+        ((entry_point_fnptr)((uint8_t*)exe + flush_offset))();
+    int64_t end_time = pyperf_time_us();
+
+    if (session->options->perf)
+        printf("pyvscc: executed for %ld us\n", end_time - start_time);
+    pyimpl_heap_release(&ctx->compiled_data, exe);
+    munmap(exe, ctx->compiled_data.length);
+}
+
+/*
+ * 'full' parses every body, used when code outside defs exists or when a 
+ * piece could not be linked on its own
+ */
+static bool rebuild(struct watch_session *session, bool full)
+{
+    const struct pywatch_options *options = session->options;
+    int64_t start_time = pyperf_time_us();
+
+    struct mapped_file file;
+    if (!file_map(options->filepath, &file)) {
+        printf("err: could not open file '%s'\n", options->filepath);
+        return false;
+    }
+
+    struct watch_chunk *chunks = NULL;
+    size_t chunkc = split(session, file.data, file.length, &chunks);
+    size_t prologue = chunkc ? (size_t)(chunks[0].text - file.data) : file.length;
+    full = full || session->inferred || !is_blank(file.data, file.data + prologue);
+
+    char flags[64];
+    snprintf(flags, sizeof(flags), "s=%zu;o=%d", options->default_size, options->optimize);
+
+    /*
+     * unchanged defs are reduced to their signature, so the parser only sees
+     * bodies that were edited
+     */
+    struct pysym_table chunk_of = { 0 };
+    size_t source_length = prologue;
+    size_t changedc = 0;
+
+    for (size_t i = 0; i < chunkc; i++) {
+        chunks[i].signature = pycache_key(chunks[i].text, chunks[i].header, flags);
+        pysym_put(&chunk_of, chunks[i].name, &chunks[i]);
+    }
+
+    for (size_t i = 0; i < chunkc; i++) {
+        struct watch_chunk *chunk = &chunks[i];
+        struct watch_entry *entry = pysym_get(&session->entries, chunk->name);
+
+        chunk->hash = pycache_key(chunk->text, chunk->length, flags) ^ callee_hash(session, &chunk_of, chunk);
+        chunk->changed = full || entry == NULL || entry->hash != chunk->hash;
+        changedc += chunk->changed;
+        source_length += (chunk->changed ? chunk->length : chunk->header) + 1;
+    }
+
+    char *source = pyperf_malloc(source_length + 1);
+    memcpy(source, file.data, prologue);
+    source_length = prologue;
+    for (size_t i = 0; i < chunkc; i++) {
+        size_t length = chunks[i].changed ? chunks[i].length : chunks[i].header;
+        memcpy(source + source_length, chunks[i].text, length);
+        source_length += length;
+        if (source[source_length - 1] != '\n')
+            source[source_length++] = '\n';
+    }
+    source[source_length] = 0;
+    file_unmap(&file);
+
+    struct lexer_stream tokens = { 0 };
+    struct pybuild_context ctx = { 
+        .tokens = &tokens, 
+        .entry_name = options->entry, 
+        .default_size = options->default_size, 
+        .threads = options->threads 
+    };
+    pyimpl_append_to_context(&ctx.vscc_ctx);
+
+    bool status = str_to_tokens_parallel(&tokens, source, source_length, options->threads) && parse(&ctx, &tokens);
+    if (status && ctx.inferred && !full) {
+        build_free(&ctx);
+        lexer_free(&tokens);
+        free(source);
+        free(chunks);
+        pysym_free(&chunk_of, false);
+        return rebuild(session, true);
+    }
+    session->inferred = ctx.inferred != 0;
+
+    if (!status)
+        printf("err: failed to compile\n");
+    int64_t parse_time = pyperf_time_us();
+
+    /*
+     * reuse cached code or queue the function, builtins are cached under 
+     * their own name
+     */
+    size_t count = 0;
+    for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn; fn = fn->next)
+        count++;
+
+    struct pycodegen_piece **pieces = pyperf_malloc((count ? count : 1) * sizeof(struct pycodegen_piece*));
+    struct watch_entry **entries = pyperf_calloc(count ? count : 1, sizeof(struct watch_entry*));
+    uint64_t *hashes = pyperf_malloc((count ? count : 1) * sizeof(uint64_t));
+    size_t *jobs = pyperf_malloc((count ? count : 1) * sizeof(size_t));
+    struct watch_job job = {
+        .session = session,
+        .functions = pyperf_malloc((count ? count : 1) * sizeof(struct vscc_function*)),
+        .pieces = pyperf_calloc(count ? count : 1, sizeof(struct pycodegen_piece)),
+        .ok = pyperf_calloc(count ? count : 1, sizeof(bool))
+    };
+    size_t jobc = 0;
+
+    size_t i = 0;
+    for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn && status; fn = fn->next, i++) {
+        const char *name = pysym_intern(&session->names, fn->symbol_name, strlen(fn->symbol_name));
+        struct watch_chunk *chunk = pysym_get(&chunk_of, name);
+        struct watch_entry *entry = pysym_get(&session->entries, name);
+
+        hashes[i] = chunk ? chunk->hash : pycache_key(fn->symbol_name, strlen(fn->symbol_name), flags);
+        if (!full && entry && entry->hash == hashes[i] && !(chunk && chunk->changed)) {
+            entries[i] = entry;
+            pieces[i] = &entry->piece;
+            ctx.requires_natives |= entry->requires_natives;
+            continue;
+        }
+
+        if (options->optimize) {
+            pyopt_fold_constants(fn);
+            vscc_optfn_elim_dead_store(fn);
+        }
+
+        jobs[jobc] = i;
+        job.functions[jobc] = fn;
+        pieces[i] = &job.pieces[jobc++];
+    }
+
+    if (status)
+        pypool_run(options->threads, jobc, generate, &job);
+    for (size_t j = 0; j < jobc && status; j++)
+        status = job.ok[j];
+
+    /*
+     * cached functions bring their globals back, the contents are written 
+     * once the layout is known
+     */
+    for (i = 0; i < count && status; i++) {
+        for (size_t j = 0; entries[i] && j < entries[i]->globalc; j++) {
+            struct watch_global *global = &entries[i]->globals[j];
+            const char *name = pysym_lookup(&ctx.strings, global->name, strlen(global->name));
+            if (name && pysym_get(&ctx.globals, name))
+                continue;
+
+            struct vscc_register *reg = vscc_alloc_global(&ctx.vscc_ctx, global->name, global->size, true);
+            pysym_put(&ctx.globals, pysym_intern(&ctx.strings, reg->symbol_name, strlen(reg->symbol_name)), reg);
+        }
+    }
+
+    bool linked = status && pycodegen_link(pieces, count, ctx.vscc_ctx.global_stream, &session->interface, &ctx.compiled_data, options->threads);
+    uintptr_t entry_offset = -1;
+
+    if (linked) {
+        entry_offset = build_linked(&ctx);
+
+        for (i = 0; i < count; i++) {
+            for (size_t j = 0; entries[i] && j < entries[i]->globalc; j++) {
+                struct watch_global *global = &entries[i]->globals[j];
+                struct vscc_symbol *symbol = pysym_get(&ctx.symbols, pysym_lookup(&ctx.strings, global->name, strlen(global->name)));
+                if (symbol)
+                    memcpy(ctx.compiled_data.buffer + symbol->offset, global->bytes, global->size);
+            }
+        }
+
+        /*
+         * cache what was generated, drop functions which no longer exist
+         */
+        struct pysym_table next = { 0 };
+        size_t j = 0;
+        i = 0;
+        for (struct vscc_function *fn = ctx.vscc_ctx.function_stream; fn; fn = fn->next, i++) {
+            const char *name = pysym_intern(&session->names, fn->symbol_name, strlen(fn->symbol_name));
+            struct watch_entry *entry = entries[i];
+
+            if (j < jobc && jobs[j] == i) {
+                entry = pysym_get(&session->entries, name);
+                if (entry)
+                    pysym_put(&session->entries, name, NULL);
+                else
+                    entry = pyperf_calloc(1, sizeof(struct watch_entry));
+
+                pycodegen_piece_free(&entry->piece);
+                for (size_t k = 0; k < entry->globalc; k++)
+                    free(entry->globals[k].bytes);
+                free(entry->globals);
+
+                entry->hash = hashes[i];
+                entry->piece = job.pieces[j++];
+                entry->globals = NULL;
+                entry->globalc = 0;
+                entry->requires_natives = build_requires_natives(fn);
+                record_globals(entry, fn, &ctx);
+            }
+            else {
+                pysym_put(&session->entries, name, NULL);
+            }
+            pysym_put(&next, name, entry);
+        }
+
+        for (size_t k = 0; k < session->entries.capacity; k++)
+            if (session->entries.entries[k].key && session->entries.entries[k].value)
+                free_entry(session->entries.entries[k].value);
+        pysym_free(&session->entries, false);
+        session->entries = next;
+        jobc = 0;
+    }
+    int64_t end_time = pyperf_time_us();
+
+    for (size_t j = 0; j < jobc; j++)
+        pycodegen_piece_free(&job.pieces[j]);
+    free(job.functions);
+    free(job.pieces);
+    free(job.ok);
+    free(jobs);
+    free(hashes);
+    free(entries);
+    free(pieces);
+    pysym_free(&chunk_of, false);
+    free(chunks);
+
+    /*
+     * a function that can not be generated on its own is retried with the
+     * whole file parsed, then the regular pipeline takes over
+     */
+    if (status && !linked && !full) {
+        build_free(&ctx);
+        lexer_free(&tokens);
+        free(source);
+        return rebuild(session, true);
+    }
+
+    if (status && !linked) {
+        printf("wrn: incremental link failed, rebuilding without reuse\n");
+        for (size_t k = 0; k < session->entries.capacity; k++)
+            if (session->entries.entries[k].key && session->entries.entries[k].value)
+                free_entry(session->entries.entries[k].value);
+        pysym_free(&session->entries, false);
+
+        build_free(&ctx);
+        pyimpl_append_to_context(&ctx.vscc_ctx);
+        status = parse(&ctx, &tokens);
+        entry_offset = status ? build(&ctx) : -1;
+        end_time = pyperf_time_us();
+    }
+
+    if (status && options->perf)
+        printf("pyvscc: rebuilt %zu of %zu functions in %ld us (%ld us parsing, %zu bytes)\n", changedc, chunkc, end_time - start_time, 
+            parse_time - start_time, ctx.compiled_data.length);
+
+    if (status && entry_offset == -1 && !ctx.natives_missing)
+        printf("err: entry point not found\n");
+    else if (status && entry_offset != -1)
+        run(session, &ctx, entry_offset);
+
+    build_free(&ctx);
+    lexer_free(&tokens);
+    free(source);
+    return status;
+}
+
+int pywatch_run(const struct pywatch_options *options)
+{
+    struct watch_session session = { .options = options };
+    vscc_codegen_implement_x64(&session.interface, ABI_SYSV);
+
+    struct stat last = { 0 };
+    for (;;) {
+        struct stat st;
+        if (stat(options->filepath, &st) < 0) {
+            printf("err: could not watch file '%s'\n", options->filepath);
+            return 1;
+        }
+
+        if (st.st_mtim.tv_sec != last.st_mtim.tv_sec || st.st_mtim.tv_nsec != last.st_mtim.tv_nsec || st.st_size != last.st_size) {
+            last = st;
+            rebuild(&session, false);
+            fflush(stdout);
+        }
+
+        usleep(WATCH_POLL_MS * 1000);
+    }
+}
\ No newline at end of file
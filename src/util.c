@@ -1,11 +1,60 @@
 #include "util.h"
+#include "pyperf.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool file_map(const char *file_path, struct mapped_file *file)
+{
+    struct stat st;
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    /* 
+     * reserve one byte past the end so the source is always NUL-terminated,
+     * even if the file size is a multiple of the page size
+     */
+    file->length = st.st_size;
+    file->mapped_length = st.st_size + 1;
+
+    void *base = mmap(NULL, file->mapped_length, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    if (file->length && mmap(base, file->length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, file->mapped_length);
+        close(fd);
+        return false;
+    }
+
+    close(fd);
+    file->data = base;
+    return true;
+}
+
+void file_unmap(struct mapped_file *file)
+{
+    munmap((void*)file->data, file->mapped_length);
+    file->data = NULL;
+}
+
 char *file_to_str(const char *file_path)
 {
     FILE *f = fopen(file_path, "rb");
-    int fsize;
+    long fsize;
     char *buffer;
 
     if (f == NULL)
@@ -15,10 +64,11 @@ char *file_to_str(const char *file_path)
     fsize = ftell(f);
     fseek(f, 0L, SEEK_SET);
 
-    buffer = malloc(fsize);
+    buffer = pyperf_malloc(fsize + 1);
 
     fread(buffer, fsize, 1, f);
     fclose(f);
 
+    buffer[fsize] = 0;
     return buffer;
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+def print_from_a_function_with_a_long_shared_name_1():
+	print("first\n")
+	return 0
+
+def print_from_a_function_with_a_long_shared_name_2():
+	print("second\n")
+	return 0
+
+def main():
+	print_from_a_function_with_a_long_shared_name_1()
+	print_from_a_function_with_a_long_shared_name_2()
+	return 0
\ No newline at end of file
@@ -0,0 +1,39 @@
+def main():
+	print(0)
+	print(' ')
+	n = 0
+	n -= 42
+	print(n)
+	print(' ')
+	print(1234567890)
+	print('\n')
+	i = find('hello', 108)
+	print(i)
+	print(' ')
+	i = find('hello', 122)
+	print(i)
+	print('\n')
+	d = strcmp('abc', 'abc')
+	print(d)
+	print(' ')
+	d = strcmp('abc', 'abd')
+	if d < 0:
+		print('less')
+	print(' ')
+	d = strcmp('abcd', 'abc')
+	if d > 0:
+		print('greater')
+	print('\n')
+	p = alloc(32)
+	store(p, 0, 5)
+	store(p, 3, 1234)
+	v = load(p, 3)
+	print(v)
+	print(' ')
+	v = load(p, 0)
+	print(v)
+	print('\n')
+	r = free(p)
+	print(r)
+	print('\n')
+	return 0
\ No newline at end of file
@@ -0,0 +1,143 @@
+def step_0(a, b):
+	x = a
+	x += b
+	return x
+
+def step_1(a, b):
+	x = a
+	x *= 2
+	x = step_0(x, b)
+	x -= 1
+	return x
+
+def step_2(a, b):
+	x = a
+	x *= 2
+	x = step_1(x, b)
+	x -= 2
+	return x
+
+def step_3(a, b, c):
+	x = step_2(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_4(a, b):
+	x = a
+	x *= 2
+	x = step_3(x, b, a)
+	x -= 4
+	return x
+
+def step_5(a, b):
+	x = a
+	x *= 2
+	x = step_4(x, b)
+	x -= 5
+	return x
+
+def step_6(a, b, c):
+	x = step_5(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_7(a, b):
+	x = a
+	x *= 2
+	x = step_6(x, b, a)
+	x -= 7
+	return x
+
+def step_8(a, b):
+	x = a
+	x *= 2
+	x = step_7(x, b)
+	x -= 8
+	return x
+
+def step_9(a, b, c):
+	x = step_8(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_10(a, b):
+	x = a
+	x *= 2
+	x = step_9(x, b, a)
+	x -= 10
+	return x
+
+def step_11(a, b):
+	x = a
+	x *= 2
+	x = step_10(x, b)
+	x -= 11
+	return x
+
+def step_12(a, b, c):
+	x = step_11(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_13(a, b):
+	x = a
+	x *= 2
+	x = step_12(x, b, a)
+	x -= 13
+	return x
+
+def step_14(a, b):
+	x = a
+	x *= 2
+	x = step_13(x, b)
+	x -= 14
+	return x
+
+def step_15(a, b, c):
+	x = step_14(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_16(a, b):
+	x = a
+	x *= 2
+	x = step_15(x, b, a)
+	x -= 16
+	return x
+
+def step_17(a, b):
+	x = a
+	x *= 2
+	x = step_16(x, b)
+	x -= 17
+	return x
+
+def step_18(a, b, c):
+	x = step_17(a, c)
+	x += b
+	print(x)
+	print('\n')
+	return x
+
+def step_19(a, b):
+	x = a
+	x *= 2
+	x = step_18(x, b, a)
+	x -= 19
+	return x
+
+def main():
+	result = step_19(1, 2)
+	print(result)
+	print('\n')
+	return 0
\ No newline at end of file
@@ -0,0 +1,18 @@
+def main():
+	i = 7
+	for i in range(0):
+		print(1)
+	print(i)
+	print('\n')
+	for i in range(5):
+		print(i)
+		i = 100
+	print('\n')
+	print(i)
+	print('\n')
+	for j in range(10, 0, -3):
+		print(j)
+	print('\n')
+	print(j)
+	print('\n')
+	return 0
\ No newline at end of file
@@ -0,0 +1,32 @@
+def clamp(v, hi):
+	if v > hi:
+		return hi
+	return v
+
+def count_to(n):
+	c = 0
+	while c < n:
+		c += 1
+	return c
+
+def twice(v):
+	x = count_to(v)
+	x += count_to(v)
+	return x
+
+def main():
+	i = 0
+	total = 0
+	while i < 6:
+		x = clamp(i, 3)
+		total += x
+		i += 1
+	print(total)
+	print('\n')
+	y = twice(4)
+	print(y)
+	print('\n')
+	z = clamp(y, 5)
+	print(z)
+	print('\n')
+	return 0
\ No newline at end of file
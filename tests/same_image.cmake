@@ -0,0 +1,13 @@
+# writes SOURCE as an executable once with -j 1 and once with -j 4, the 
+# parallel code generator has to produce the same bytes as vscc_codegen
+foreach(threads 1 4)
+    execute_process(COMMAND ${PYVSCC} -i ${SOURCE} -a ${OUTPUT}.${threads} -j ${threads} RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "pyvscc -j ${threads} exited with ${status}")
+    endif()
+endforeach()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.1 ${OUTPUT}.4 RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "images written with -j 1 and -j 4 differ")
+endif()
\ No newline at end of file
@@ -0,0 +1,59 @@
+# runs SOURCE once plainly and once with ARGS (flags separated by spaces), 
+# both runs have to print the same and exit with the same status. with -a 
+# both runs write an executable to OUTPUT and run that instead, with -c the
+# second run with ARGS has to load from the cache what the first one stored
+separate_arguments(ARGS)
+
+function(run_pyvscc flags output_var status_var)
+    list(FIND flags -a aot)
+    list(FIND flags -c cache)
+    if(NOT aot EQUAL -1)
+        math(EXPR path "${aot} + 1")
+        list(INSERT flags ${path} ${OUTPUT})
+        file(REMOVE ${OUTPUT})
+    elseif(NOT cache EQUAL -1)
+        math(EXPR path "${cache} + 1")
+        list(INSERT flags ${path} ${OUTPUT}.cache)
+    endif()
+
+    execute_process(COMMAND ${PYVSCC} -i ${SOURCE} ${flags} OUTPUT_VARIABLE output RESULT_VARIABLE status)
+    if(NOT aot EQUAL -1)
+        if(NOT status EQUAL 0)
+            message(FATAL_ERROR "pyvscc ${flags} exited with ${status}")
+        endif()
+        execute_process(COMMAND ${OUTPUT} OUTPUT_VARIABLE output RESULT_VARIABLE status)
+    endif()
+
+    set(${output_var} "${output}" PARENT_SCOPE)
+    set(${status_var} "${status}" PARENT_SCOPE)
+endfunction()
+
+function(expect_same flags)
+    run_pyvscc("${flags}" output status)
+    string(REPLACE ";" " " shown "${flags}")
+
+    if(NOT status STREQUAL expected_status)
+        message(FATAL_ERROR "pyvscc ${shown} exited with ${status} instead of ${expected_status}")
+    endif()
+
+    if(NOT output STREQUAL expected)
+        message(FATAL_ERROR "pyvscc ${shown} printed\n${output}\ninstead of\n${expected}")
+    endif()
+endfunction()
+
+# an executable exits with what the entry returned, pyvscc does not
+list(FIND ARGS -a aot)
+if(aot EQUAL -1)
+    run_pyvscc("" expected expected_status)
+else()
+    run_pyvscc("-a" expected expected_status)
+endif()
+
+list(FIND ARGS -c cache)
+if(NOT cache EQUAL -1)
+    file(REMOVE_RECURSE ${OUTPUT}.cache)
+    file(MAKE_DIRECTORY ${OUTPUT}.cache)
+    expect_same("${ARGS}")
+endif()
+
+expect_same("${ARGS}")
\ No newline at end of file
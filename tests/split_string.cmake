@@ -0,0 +1,17 @@
+# a string spanning more lines than a lexer chunk, full of def lines, followed
+# by enough functions that -j 4 splits the source; no split may land inside it
+set(lines "")
+foreach(i RANGE 8000)
+    string(APPEND lines "def s${i}():\n\treturn 0\n")
+endforeach()
+
+set(functions "")
+foreach(i RANGE 4000)
+    string(APPEND functions "def f${i}():\n\tx = ${i}\n\treturn x\n\n")
+endforeach()
+
+set(SOURCE ${OUTPUT})
+file(WRITE ${SOURCE} "def main():\n\ts = '\n${lines}'\n\tprint('ok\\n')\n\treturn 0\n\n${functions}")
+
+set(ARGS "-j 4")
+include(${CMAKE_CURRENT_LIST_DIR}/same_output.cmake)
\ No newline at end of file
@@ -0,0 +1,7 @@
+def show(s):
+	print(s)
+
+def main():
+	show('text\n')
+	show(5)
+	return 0
\ No newline at end of file
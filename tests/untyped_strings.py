@@ -0,0 +1,15 @@
+def show(s):
+	print(s)
+
+def relay(t, n):
+	show(t)
+	print(n)
+	print('\n')
+	return 0
+
+def main():
+	show('direct\n')
+	relay('relayed\n', 7)
+	x = 'copied\n'
+	relay(x, 8)
+	return 0
\ No newline at end of file